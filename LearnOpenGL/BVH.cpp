@@ -0,0 +1,457 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const int NUM_BINS = 16;
+static const uint32_t MAX_LEAF_SIZE = 8;
+static const int MAX_DEPTH = 60;                                    // Keeps the fixed size traversal stacks below safe
+static const int STACK_SIZE = 64;
+
+// SAH costs, relative to testing a single object's box
+static const float TRAVERSAL_COST = 1.0f;
+static const float INTERSECTION_COST = 1.0f;
+
+// The slab test: returns the distance at which the ray enters the box, or INFINITY if it misses it
+static float intersectRay(const Ray &ray, const glm::vec3 &inverseDirection, const glm::vec3 &min, const glm::vec3 &max, float maxDistance)
+{
+    glm::vec3 t0 = (min - ray.origin) * inverseDirection;
+    glm::vec3 t1 = (max - ray.origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+    return enter <= exit ? enter : INFINITY;
+}
+
+// ===============================
+// Public member functions
+// ===============================
+
+BVH::BVH()
+{
+    
+}
+
+void BVH::build(const std::vector<AABB> &bounds)
+{
+    clear();
+    if (bounds.empty()) return;
+    
+    objectBounds = bounds;
+    objectIndices.resize(bounds.size());
+    centroids.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i)
+    {
+        objectIndices[i] = static_cast<uint32_t>(i);
+        centroids[i] = bounds[i].getCenter();
+    }
+    
+    // A binary tree with leaves of at least one object never has more than 2n - 1 nodes
+    nodes.reserve(2 * bounds.size() - 1);
+    nodes.push_back(Node());
+    buildNode(0, 0, static_cast<uint32_t>(bounds.size()), 0);
+    
+    centroids.clear();
+    centroids.shrink_to_fit();
+}
+
+/*
+ * When objects move the tree's topology is usually still good enough, so rather than rebuilding
+ * we only recompute the node bounds. Children always come after their parent in the node array,
+ * which lets us do that in a single backwards pass. The quality of the tree slowly degrades as
+ * objects drift away from where they were when it was built; rebuild once that starts to show.
+ */
+void BVH::refit(const std::vector<AABB> &bounds)
+{
+    if (bounds.size() != objectBounds.size())
+    {
+        build(bounds);
+        return;
+    }
+    
+    objectBounds = bounds;
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        const Node &node = nodes[i];
+        if (node.isLeaf())
+            setBounds(static_cast<uint32_t>(i), getRangeBounds(node.leftOrFirst, node.count));
+        else
+            setBounds(static_cast<uint32_t>(i), mergeAABB(nodes[i + 1].getBounds(), nodes[node.leftOrFirst].getBounds()));
+    }
+}
+
+void BVH::clear()
+{
+    nodes.clear();
+    objectIndices.clear();
+    objectBounds.clear();
+}
+
+/*
+ * Appends the indices of the objects whose boxes touch the frustum to visible. Whole subtrees are
+ * skipped as soon as their box is outside, and accepted without further tests as soon as it's
+ * entirely inside.
+ */
+size_t BVH::queryFrustum(const Frustum &frustum, std::vector<size_t> &visible, CullStats *stats) const
+{
+    size_t numVisibleBefore = visible.size();
+    
+    uint32_t stack[STACK_SIZE];
+    int stackSize = 0;
+    if (!nodes.empty()) stack[stackSize++] = 0;
+    
+    while (stackSize > 0)
+    {
+        uint32_t nodeIndex = stack[--stackSize];
+        const Node &node = nodes[nodeIndex];
+        
+        FrustumTest test = frustum.classify(node.getBounds());
+        if (test == FRUSTUM_OUTSIDE) continue;
+        if (test == FRUSTUM_INSIDE)
+        {
+            addSubtree(nodeIndex, visible);
+            continue;
+        }
+        
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+                if (frustum.intersects(objectBounds[objectIndices[i]]))
+                    visible.push_back(objectIndices[i]);
+        }
+        else
+        {
+            stack[stackSize++] = node.leftOrFirst;
+            stack[stackSize++] = nodeIndex + 1;
+        }
+    }
+    
+    size_t numVisible = visible.size() - numVisibleBefore;
+    if (stats)
+    {
+        stats->tested += objectIndices.size();
+        stats->culled += objectIndices.size() - numVisible;
+        stats->drawn += numVisible;
+    }
+    return numVisible;
+}
+
+/*
+ * Finds the closest object box the ray enters within maxDistance. Children are visited nearest
+ * first, so that once a hit is found most of the far side of the tree can be skipped.
+ */
+bool BVH::raycast(const Ray &ray, RayHit &hit, float maxDistance) const
+{
+    if (nodes.empty()) return false;
+    
+    glm::vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    float closest = maxDistance;
+    bool found = false;
+    
+    uint32_t stack[STACK_SIZE];
+    int stackSize = 0;
+    if (intersectRay(ray, inverseDirection, nodes[0].min, nodes[0].max, closest) != INFINITY)
+        stack[stackSize++] = 0;
+    
+    while (stackSize > 0)
+    {
+        const Node &node = nodes[stack[--stackSize]];
+        
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+            {
+                const AABB &box = objectBounds[objectIndices[i]];
+                float distance = intersectRay(ray, inverseDirection, box.min, box.max, closest);
+                if (distance == INFINITY) continue;
+                
+                closest = distance;
+                hit.object = objectIndices[i];
+                hit.distance = distance;
+                found = true;
+            }
+            continue;
+        }
+        
+        uint32_t nearChild = static_cast<uint32_t>(&node - &nodes[0]) + 1;
+        uint32_t farChild = node.leftOrFirst;
+        float nearDistance = intersectRay(ray, inverseDirection, nodes[nearChild].min, nodes[nearChild].max, closest);
+        float farDistance = intersectRay(ray, inverseDirection, nodes[farChild].min, nodes[farChild].max, closest);
+        if (farDistance < nearDistance)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+        
+        // Push the far child first so the near one is popped next
+        if (farDistance != INFINITY) stack[stackSize++] = farChild;
+        if (nearDistance != INFINITY) stack[stackSize++] = nearChild;
+    }
+    return found;
+}
+
+/*
+ * Builds a tree over a synthetic scene of small boxes scattered through a 1000 unit cube, then times
+ * frustum queries and picking rays against it and against testing every box in turn, the way the
+ * scene was culled before. Needs no GL context. Both ways have to find the same objects, or the
+ * benchmark says so.
+ */
+void BVH::benchmark(std::ostream &stream, size_t objectCount)
+{
+    static const int RUNS = 5;
+    static const int QUERY_COUNT = 64;                              // Camera poses, and rays, per run
+    typedef std::chrono::high_resolution_clock Clock;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+    
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> pickCoordinate(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> pickSize(0.5f, 4.0f);
+    std::uniform_real_distribution<float> pickUnit(-1.0f, 1.0f);
+    std::vector<AABB> bounds(objectCount);
+    for (auto &box: bounds)
+    {
+        glm::vec3 center(pickCoordinate(random), pickCoordinate(random), pickCoordinate(random));
+        glm::vec3 halfSize(pickSize(random), pickSize(random), pickSize(random));
+        box.min = center - halfSize;
+        box.max = center + halfSize;
+    }
+    
+    // Cameras inside the scene looking in random directions, and rays through the middle of their views
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    std::vector<Frustum> frustums(QUERY_COUNT);
+    std::vector<Ray> rays(QUERY_COUNT);
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        rays[i].origin = glm::vec3(pickCoordinate(random), pickCoordinate(random), pickCoordinate(random));
+        rays[i].direction = glm::normalize(glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random)) + glm::vec3(0.0f, 0.0f, 0.01f));
+        frustums[i].update(projection * glm::lookAt(rays[i].origin, rays[i].origin + rays[i].direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+    
+    BVH bvh;
+    double buildMs = 1e30;
+    double refitMs = 1e30;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        auto startTime = Clock::now();
+        bvh.build(bounds);
+        Milliseconds elapsed = Clock::now() - startTime;
+        buildMs = std::min(buildMs, elapsed.count());
+        
+        startTime = Clock::now();
+        bvh.refit(bounds);
+        elapsed = Clock::now() - startTime;
+        refitMs = std::min(refitMs, elapsed.count());
+    }
+    
+    std::vector<size_t> visible;
+    visible.reserve(objectCount);
+    double queryMs = 1e30;
+    double bruteQueryMs = 1e30;
+    size_t queryVisible = 0;
+    size_t bruteVisible = 0;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        queryVisible = bruteVisible = 0;
+        auto startTime = Clock::now();
+        for (const auto &frustum: frustums)
+        {
+            visible.clear();
+            queryVisible += bvh.queryFrustum(frustum, visible);
+        }
+        Milliseconds elapsed = Clock::now() - startTime;
+        queryMs = std::min(queryMs, elapsed.count());
+        
+        startTime = Clock::now();
+        for (const auto &frustum: frustums)
+        {
+            visible.clear();
+            for (size_t i = 0; i < bounds.size(); ++i)
+                if (frustum.intersects(bounds[i])) visible.push_back(i);
+            bruteVisible += visible.size();
+        }
+        elapsed = Clock::now() - startTime;
+        bruteQueryMs = std::min(bruteQueryMs, elapsed.count());
+    }
+    
+    double raycastMs = 1e30;
+    double bruteRaycastMs = 1e30;
+    size_t mismatchedHits = 0;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        std::vector<float> distances(QUERY_COUNT, INFINITY);
+        auto startTime = Clock::now();
+        for (int i = 0; i < QUERY_COUNT; ++i)
+        {
+            RayHit hit;
+            if (bvh.raycast(rays[i], hit)) distances[i] = hit.distance;
+        }
+        Milliseconds elapsed = Clock::now() - startTime;
+        raycastMs = std::min(raycastMs, elapsed.count());
+        
+        mismatchedHits = 0;
+        startTime = Clock::now();
+        for (int i = 0; i < QUERY_COUNT; ++i)
+        {
+            glm::vec3 inverseDirection(1.0f / rays[i].direction.x, 1.0f / rays[i].direction.y, 1.0f / rays[i].direction.z);
+            float closest = INFINITY;
+            for (const auto &box: bounds)
+                closest = std::min(closest, intersectRay(rays[i], inverseDirection, box.min, box.max, closest));
+            if (closest != distances[i]) ++mismatchedHits;
+        }
+        elapsed = Clock::now() - startTime;
+        bruteRaycastMs = std::min(bruteRaycastMs, elapsed.count());
+    }
+    
+    stream << "BVH: " << objectCount << " boxes, " << bvh.getNodeCount() << " nodes, build " << buildMs << " ms, refit " << refitMs << " ms (best of " << RUNS << ")" << std::endl;
+    stream << "  " << QUERY_COUNT << " frustum queries: BVH " << queryMs << " ms, every box " << bruteQueryMs << " ms, "
+           << queryVisible / QUERY_COUNT << " visible on average" << (queryVisible == bruteVisible ? "" : " (MISMATCH)") << std::endl;
+    stream << "  " << QUERY_COUNT << " picking rays:    BVH " << raycastMs << " ms, every box " << bruteRaycastMs << " ms"
+           << (mismatchedHits ? " (MISMATCH)" : "") << std::endl;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+/*
+ * Binned SAH: the objects' centroids are sorted into a fixed number of equally sized bins along each
+ * axis, and every boundary between two bins is evaluated as a candidate split. The cost of a split is
+ * the chance that a ray (or frustum) that hits this node also hits each child, i.e. the ratio of their
+ * surface areas, times the number of objects in that child.
+ */
+void BVH::buildNode(uint32_t nodeIndex, uint32_t first, uint32_t count, int depth)
+{
+    setBounds(nodeIndex, getRangeBounds(first, count));
+    nodes[nodeIndex].leftOrFirst = first;
+    nodes[nodeIndex].count = count;
+    if (count <= 2 || depth >= MAX_DEPTH) return;
+    
+    AABB centroidBounds;
+    centroidBounds.min = centroidBounds.max = centroids[objectIndices[first]];
+    for (uint32_t i = first + 1; i < first + count; ++i)
+    {
+        centroidBounds.min = glm::min(centroidBounds.min, centroids[objectIndices[i]]);
+        centroidBounds.max = glm::max(centroidBounds.max, centroids[objectIndices[i]]);
+    }
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = INFINITY;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] <= 0.0f) continue;
+        float scale = NUM_BINS / extent[axis];
+        
+        AABB binBounds[NUM_BINS];
+        uint32_t binCounts[NUM_BINS] = { 0 };
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            uint32_t object = objectIndices[i];
+            int bin = std::min(NUM_BINS - 1, static_cast<int>((centroids[object][axis] - centroidBounds.min[axis]) * scale));
+            binBounds[bin] = binCounts[bin] ? mergeAABB(binBounds[bin], objectBounds[object]) : objectBounds[object];
+            ++binCounts[bin];
+        }
+        
+        // Sweep from the right to get the area and count of everything right of each boundary...
+        float rightArea[NUM_BINS];
+        uint32_t rightCount[NUM_BINS];
+        AABB accumulated;
+        uint32_t accumulatedCount = 0;
+        for (int bin = NUM_BINS - 1; bin > 0; --bin)
+        {
+            if (binCounts[bin]) accumulated = accumulatedCount ? mergeAABB(accumulated, binBounds[bin]) : binBounds[bin];
+            accumulatedCount += binCounts[bin];
+            rightArea[bin] = accumulatedCount ? getSurfaceArea(accumulated) : 0.0f;
+            rightCount[bin] = accumulatedCount;
+        }
+        
+        // ...then from the left, evaluating the split between bin - 1 and bin as we go
+        accumulatedCount = 0;
+        for (int bin = 1; bin < NUM_BINS; ++bin)
+        {
+            if (binCounts[bin - 1]) accumulated = accumulatedCount ? mergeAABB(accumulated, binBounds[bin - 1]) : binBounds[bin - 1];
+            accumulatedCount += binCounts[bin - 1];
+            if (accumulatedCount == 0 || rightCount[bin] == 0) continue;
+            
+            float cost = getSurfaceArea(accumulated) * accumulatedCount + rightArea[bin] * rightCount[bin];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = bin;
+            }
+        }
+    }
+    
+    float area = getSurfaceArea(nodes[nodeIndex].getBounds());
+    float leafCost = INTERSECTION_COST * count;
+    float splitCost = area > 0.0f ? TRAVERSAL_COST + INTERSECTION_COST * bestCost / area : INFINITY;
+    if (splitCost >= leafCost && count <= MAX_LEAF_SIZE) return;
+    
+    uint32_t leftCount = 0;
+    if (bestAxis >= 0)
+    {
+        // Partition with exactly the same binning arithmetic, so objects land on the side they were costed on
+        float scale = NUM_BINS / extent[bestAxis];
+        float minimum = centroidBounds.min[bestAxis];
+        uint32_t *middle = std::partition(&objectIndices[first], &objectIndices[first] + count, [&](uint32_t object)
+        {
+            return std::min(NUM_BINS - 1, static_cast<int>((centroids[object][bestAxis] - minimum) * scale)) < bestSplit;
+        });
+        leftCount = static_cast<uint32_t>(middle - &objectIndices[first]);
+    }
+    
+    // Every centroid is in the same spot (or SAH preferred a leaf that's too big): split down the middle
+    if (leftCount == 0 || leftCount == count)
+    {
+        leftCount = count / 2;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        std::nth_element(&objectIndices[first], &objectIndices[first] + leftCount, &objectIndices[first] + count, [&](uint32_t a, uint32_t b)
+        {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+    }
+    
+    // The left child goes right after this node; the right child after the whole left subtree
+    uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(Node());
+    buildNode(leftIndex, first, leftCount, depth + 1);
+    
+    uint32_t rightIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(Node());
+    buildNode(rightIndex, first + leftCount, count - leftCount, depth + 1);
+    
+    nodes[nodeIndex].leftOrFirst = rightIndex;
+    nodes[nodeIndex].count = 0;
+}
+
+AABB BVH::getRangeBounds(uint32_t first, uint32_t count) const
+{
+    AABB box = objectBounds[objectIndices[first]];
+    for (uint32_t i = first + 1; i < first + count; ++i)
+        box = mergeAABB(box, objectBounds[objectIndices[i]]);
+    return box;
+}
+
+void BVH::setBounds(uint32_t nodeIndex, const AABB &box)
+{
+    nodes[nodeIndex].min = box.min;
+    nodes[nodeIndex].max = box.max;
+}
+
+void BVH::addSubtree(uint32_t nodeIndex, std::vector<size_t> &visible) const
+{
+    const Node &node = nodes[nodeIndex];
+    if (node.isLeaf())
+    {
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+            visible.push_back(objectIndices[i]);
+        return;
+    }
+    addSubtree(nodeIndex + 1, visible);
+    addSubtree(node.leftOrFirst, visible);
+}
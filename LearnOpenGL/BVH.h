@@ -0,0 +1,71 @@
+#ifndef __LearnOpenGL__BVH__
+#define __LearnOpenGL__BVH__
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+#include "Frustum.h"
+
+struct RayHit
+{
+    size_t object;
+    float distance;
+};
+
+/*
+ * A bounding volume hierarchy over a set of objects, each given by its AABB. Objects are referred to
+ * by their index in the vector that was passed to build(), so callers can keep their own per-object
+ * data in a parallel array.
+ *
+ * The tree is built top-down with the surface area heuristic and stored as a flat array of nodes in
+ * depth-first order: an interior node's left child always directly follows it, and only the index of
+ * the right child has to be stored. That keeps each node down to 32 bytes, two per cache line.
+ */
+class BVH
+{
+    
+public:
+    
+    BVH();
+    void build(const std::vector<AABB> &objectBounds);
+    void refit(const std::vector<AABB> &objectBounds);
+    void clear();
+    
+    size_t queryFrustum(const Frustum &frustum, std::vector<size_t> &visible, CullStats *stats = nullptr) const;
+    bool raycast(const Ray &ray, RayHit &hit, float maxDistance = INFINITY) const;
+    
+    size_t getObjectCount() const { return objectIndices.size(); }
+    size_t getNodeCount() const { return nodes.size(); }
+    
+    static void benchmark(std::ostream &stream, size_t objectCount = 100000);
+    
+private:
+    
+    struct Node
+    {
+        glm::vec3 min;
+        uint32_t leftOrFirst;                                       // Right child index for interior nodes, first object for leaves
+        glm::vec3 max;
+        uint32_t count;                                             // Number of objects in a leaf, 0 for interior nodes
+        
+        bool isLeaf() const { return count > 0; }
+        AABB getBounds() const { AABB box; box.min = min; box.max = max; return box; }
+    };
+    
+    std::vector<Node> nodes;
+    std::vector<uint32_t> objectIndices;                           // Leaves own contiguous ranges of this array
+    std::vector<AABB> objectBounds;
+    std::vector<glm::vec3> centroids;                               // Only needed while building
+    
+    void buildNode(uint32_t nodeIndex, uint32_t first, uint32_t count, int depth);
+    AABB getRangeBounds(uint32_t first, uint32_t count) const;
+    void setBounds(uint32_t nodeIndex, const AABB &box);
+    void addSubtree(uint32_t nodeIndex, std::vector<size_t> &visible) const;
+    
+};
+
+#endif
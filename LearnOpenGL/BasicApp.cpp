@@ -1,4 +1,5 @@
 #include "BasicApp.h"
+#include "GlState.h"
 
 // ===============================
 // Public member functions
@@ -49,7 +50,7 @@ void BasicApp::setupWindow()
         return;
     }
     
-    glViewport(0, 0, viewportWidth, viewportHeight);                // Tell OpenGL the size of the rendering window
+    GlState::getInstance().viewport(0, 0, viewportWidth, viewportHeight);   // Tell OpenGL the size of the rendering window
 }
 
 void BasicApp::registerCallbacks()
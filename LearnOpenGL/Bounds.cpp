@@ -0,0 +1,91 @@
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Positions are read through a byte stride, so they can be pulled straight out of an interleaved Vertex array
+static const glm::vec3 &positionAt(const glm::vec3 *positions, size_t index, size_t stride)
+{
+    return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const unsigned char*>(positions) + index * stride);
+}
+
+AABB computeAABB(const glm::vec3 *positions, size_t count, size_t stride)
+{
+    AABB box;
+    box.min = box.max = glm::vec3(0.0f);
+    if (count == 0) return box;
+    
+    box.min = box.max = positionAt(positions, 0, stride);
+    for (size_t i = 1; i < count; ++i)
+    {
+        const glm::vec3 &p = positionAt(positions, i, stride);
+        box.min = glm::min(box.min, p);
+        box.max = glm::max(box.max, p);
+    }
+    return box;
+}
+
+/*
+ * Centering the sphere on the box and taking the farthest vertex as the radius is not the minimal
+ * bounding sphere, but it is always at least as tight as the sphere around the box itself and it
+ * only takes one extra pass over the vertices.
+ */
+BoundingSphere computeBoundingSphere(const AABB &box, const glm::vec3 *positions, size_t count, size_t stride)
+{
+    BoundingSphere sphere;
+    sphere.center = box.getCenter();
+    
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 offset = positionAt(positions, i, stride) - sphere.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    sphere.radius = std::sqrt(radiusSquared);
+    return sphere;
+}
+
+AABB mergeAABB(const AABB &a, const AABB &b)
+{
+    AABB result;
+    result.min = glm::min(a.min, b.min);
+    result.max = glm::max(a.max, b.max);
+    return result;
+}
+
+float getSurfaceArea(const AABB &box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+/*
+ * Rather than transforming all eight corners, transform the center and project the extents onto each
+ * world axis (Arvo's method): the new half-size along an axis is the sum of |M_ij| * extent_j.
+ */
+AABB transformAABB(const AABB &box, const glm::mat4 &model)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4(box.getCenter(), 1.0f));
+    glm::vec3 extents = box.getExtents();
+    glm::vec3 worldExtents = glm::abs(glm::vec3(model[0])) * extents.x +
+                             glm::abs(glm::vec3(model[1])) * extents.y +
+                             glm::abs(glm::vec3(model[2])) * extents.z;
+    
+    AABB result;
+    result.min = center - worldExtents;
+    result.max = center + worldExtents;
+    return result;
+}
+
+// A non-uniform scale stretches the sphere into an ellipsoid, so grow the radius by the largest axis scale
+BoundingSphere transformBoundingSphere(const BoundingSphere &sphere, const glm::mat4 &model)
+{
+    float scaleSquared = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                  std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                           glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+    
+    BoundingSphere result;
+    result.center = glm::vec3(model * glm::vec4(sphere.center, 1.0f));
+    result.radius = sphere.radius * std::sqrt(scaleSquared);
+    return result;
+}
@@ -0,0 +1,39 @@
+#ifndef __LearnOpenGL__Bounds__
+#define __LearnOpenGL__Bounds__
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+/*
+ * Bounding volumes are computed once, in object space, when a mesh is created. They only need to be
+ * moved into world space (which is cheap) when an object is tested for visibility.
+ */
+AABB computeAABB(const glm::vec3 *positions, size_t count, size_t stride);
+BoundingSphere computeBoundingSphere(const AABB &box, const glm::vec3 *positions, size_t count, size_t stride);
+AABB mergeAABB(const AABB &a, const AABB &b);
+float getSurfaceArea(const AABB &box);
+AABB transformAABB(const AABB &box, const glm::mat4 &model);
+BoundingSphere transformBoundingSphere(const BoundingSphere &sphere, const glm::mat4 &model);
+
+#endif
@@ -71,6 +71,24 @@ void Camera::processScroll(GLfloat yoffset)
         camFOV = 45.0f;
 }
 
+/*
+ * Returns the world space ray that starts at the camera and passes through the window coordinates
+ * (x, y), e.g. the cursor position, for picking. This assumes the same perspective projection that
+ * main.cpp builds from getFOV() and the window's aspect ratio.
+ */
+Ray Camera::getRay(GLfloat x, GLfloat y, GLfloat width, GLfloat height) const
+{
+    // Window coordinates start at the top left, normalized device coordinates at the bottom left
+    GLfloat ndcX = 2.0f * x / width - 1.0f;
+    GLfloat ndcY = 1.0f - 2.0f * y / height;
+    GLfloat tanHalfFOV = tan(glm::radians(camFOV) * 0.5f);
+    
+    Ray ray;
+    ray.origin = camPosition;
+    ray.direction = glm::normalize(camFront + camRight * (ndcX * tanHalfFOV * width / height) + camUp * (ndcY * tanHalfFOV));
+    return ray;
+}
+
 // ===============================
 // Private member functions
 // ===============================
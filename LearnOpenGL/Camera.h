@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "Bounds.h"
 
 enum Direction
 {
@@ -32,6 +33,7 @@ public:
     GLfloat getYaw() const { return camYaw; }
     GLfloat getPitch() const { return camPitch; }
     GLfloat getFOV() const { return camFOV; }
+    Ray getRay(GLfloat x, GLfloat y, GLfloat width, GLfloat height) const;
     void processKeyboard(Direction dir, GLfloat deltaTime);
     void processMouse(GLfloat xoffset, GLfloat yoffset, GLboolean constrainPitch = true);
     void processScroll(GLfloat yoffset);
@@ -0,0 +1,59 @@
+#include "FrameHistogram.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+// Upper bounds of all but the last bucket, in milliseconds
+static const double BUCKET_LIMITS[] = { 4.0, 8.0, 12.0, 16.7, 20.0, 33.3, 50.0, 100.0 };
+static const size_t BUCKET_COUNT = sizeof(BUCKET_LIMITS) / sizeof(BUCKET_LIMITS[0]) + 1;
+static const size_t BAR_WIDTH = 40;
+
+// ===============================
+// Public member functions
+// ===============================
+
+void FrameHistogram::record(double frameMs)
+{
+    frameTimes.push_back(frameMs);
+}
+
+void FrameHistogram::reset()
+{
+    frameTimes.clear();
+}
+
+// Nearest rank, e.g. 0.99 for the 99th percentile
+double FrameHistogram::getPercentile(double percentile) const
+{
+    if (frameTimes.empty()) return 0.0;
+
+    std::vector<double> sorted(frameTimes);
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(percentile * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+double FrameHistogram::getMax() const
+{
+    return frameTimes.empty() ? 0.0 : *std::max_element(frameTimes.begin(), frameTimes.end());
+}
+
+void FrameHistogram::print(std::ostream &stream, const std::string &title) const
+{
+    size_t counts[BUCKET_COUNT] = {};
+    for (double frameMs: frameTimes)
+        ++counts[std::upper_bound(BUCKET_LIMITS, BUCKET_LIMITS + BUCKET_COUNT - 1, frameMs) - BUCKET_LIMITS];
+    size_t largest = std::max<size_t>(1, *std::max_element(counts, counts + BUCKET_COUNT));
+
+    stream << title << ": " << frameTimes.size() << " frames, median " << getPercentile(0.5) << " ms, 99th percentile "
+           << getPercentile(0.99) << " ms, worst " << getMax() << " ms" << std::endl;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        std::stringstream label;
+        if (i + 1 < BUCKET_COUNT) label << "<= " << BUCKET_LIMITS[i];
+        else label << " > " << BUCKET_LIMITS[BUCKET_COUNT - 2];
+        stream << std::setw(10) << label.str() << " ms |" << std::string(counts[i] * BAR_WIDTH / largest, '#');
+        if (counts[i]) stream << " " << counts[i];
+        stream << std::endl;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef __LearnOpenGL__FrameHistogram__
+#define __LearnOpenGL__FrameHistogram__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Collects frame times and prints them as a histogram, with buckets around the 60 and 30 Hz frame
+ * budgets, so that hitches (e.g. from loading assets mid-session) stand out from the average.
+ */
+class FrameHistogram
+{
+
+public:
+
+    void record(double frameMs);
+    void reset();
+    size_t getFrameCount() const { return frameTimes.size(); }
+    double getPercentile(double percentile) const;
+    double getMax() const;
+    void print(std::ostream &stream, const std::string &title) const;
+
+private:
+
+    std::vector<double> frameTimes;
+
+};
+
+#endif
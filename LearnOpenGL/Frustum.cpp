@@ -0,0 +1,178 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE 1
+#endif
+
+// ===============================
+// Public member functions
+// ===============================
+
+Frustum::Frustum()
+{
+    // Start out with planes that accept everything
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+        planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, INFINITY);
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+    update(viewProjection);
+}
+
+/*
+ * Gribb and Hartmann: a clip space point is visible when -w <= x, y, z <= w, and each of those six
+ * inequalities turns into a world space plane once it's written in terms of the rows of the
+ * view-projection matrix. glm matrices are column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+ */
+void Frustum::update(const glm::mat4 &viewProjection)
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i)
+        row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    
+    planes[FRUSTUM_LEFT] = row[3] + row[0];
+    planes[FRUSTUM_RIGHT] = row[3] - row[0];
+    planes[FRUSTUM_BOTTOM] = row[3] + row[1];
+    planes[FRUSTUM_TOP] = row[3] - row[1];
+    planes[FRUSTUM_NEAR] = row[3] + row[2];
+    planes[FRUSTUM_FAR] = row[3] - row[2];
+    
+    // Normalize so that plane equations give real distances, which the sphere tests rely on
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+/*
+ * Brings the frustum into an object's local space, so that object space bounds can be tested against
+ * it directly. A plane transforms by the transpose of the matrix that maps local points to world space.
+ */
+Frustum Frustum::transformed(const glm::mat4 &model) const
+{
+    Frustum result;
+    glm::mat4 transposed = glm::transpose(model);
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        result.planes[i] = transposed * planes[i];
+        result.planes[i] /= glm::length(glm::vec3(result.planes[i]));
+    }
+    return result;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const
+{
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+        if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+            return false;
+    return true;
+}
+
+/*
+ * A box is entirely behind a plane when its corner that lies furthest along the plane normal (the
+ * "positive vertex") is. Like the sphere test this is conservative: boxes near the frustum's corners
+ * can pass even though they're not actually visible.
+ */
+bool Frustum::intersects(const AABB &box) const
+{
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        glm::vec3 normal(planes[i]);
+        glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x,
+                           normal.y >= 0.0f ? box.max.y : box.min.y,
+                           normal.z >= 0.0f ? box.max.z : box.min.z);
+        if (glm::dot(normal, positive) + planes[i].w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Also checks the "negative vertex" so that a box that's entirely inside every plane can be reported
+ * as such; a hierarchy can then accept everything below it without any further tests.
+ */
+FrustumTest Frustum::classify(const AABB &box) const
+{
+    FrustumTest result = FRUSTUM_INSIDE;
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        glm::vec3 normal(planes[i]);
+        glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x,
+                           normal.y >= 0.0f ? box.max.y : box.min.y,
+                           normal.z >= 0.0f ? box.max.z : box.min.z);
+        if (glm::dot(normal, positive) + planes[i].w < 0.0f)
+            return FRUSTUM_OUTSIDE;
+        
+        glm::vec3 negative(normal.x >= 0.0f ? box.min.x : box.max.x,
+                           normal.y >= 0.0f ? box.min.y : box.max.y,
+                           normal.z >= 0.0f ? box.min.z : box.max.z);
+        if (glm::dot(normal, negative) + planes[i].w < 0.0f)
+            result = FRUSTUM_INTERSECTS;
+    }
+    return result;
+}
+
+/*
+ * Tests a batch of world space spheres and appends the indices of those that touch the frustum to
+ * visible, returning how many were appended. With SSE the spheres are tested four at a time against
+ * each plane in turn.
+ */
+size_t Frustum::cullSpheres(const BoundingSphere *spheres, size_t count, std::vector<size_t> &visible, CullStats *stats) const
+{
+    size_t numVisible = 0;
+    size_t i = 0;
+    
+#ifdef FRUSTUM_USE_SSE
+    __m128 nx[NUM_FRUSTUM_PLANES], ny[NUM_FRUSTUM_PLANES], nz[NUM_FRUSTUM_PLANES], d[NUM_FRUSTUM_PLANES];
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; ++p)
+    {
+        nx[p] = _mm_set1_ps(planes[p].x);
+        ny[p] = _mm_set1_ps(planes[p].y);
+        nz[p] = _mm_set1_ps(planes[p].z);
+        d[p] = _mm_set1_ps(planes[p].w);
+    }
+    
+    for (; i + 4 <= count; i += 4)
+    {
+        const BoundingSphere *s = spheres + i;
+        __m128 cx = _mm_setr_ps(s[0].center.x, s[1].center.x, s[2].center.x, s[3].center.x);
+        __m128 cy = _mm_setr_ps(s[0].center.y, s[1].center.y, s[2].center.y, s[3].center.y);
+        __m128 cz = _mm_setr_ps(s[0].center.z, s[1].center.z, s[2].center.z, s[3].center.z);
+        __m128 negativeRadius = _mm_setr_ps(-s[0].radius, -s[1].radius, -s[2].radius, -s[3].radius);
+        
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < NUM_FRUSTUM_PLANES; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz[p], cz), d[p]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+        }
+        
+        int outsideMask = _mm_movemask_ps(outside);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if (outsideMask & (1 << lane)) continue;
+            visible.push_back(i + lane);
+            ++numVisible;
+        }
+    }
+#endif
+    
+    // Whatever doesn't fill a whole batch (or everything, without SSE)
+    for (; i < count; ++i)
+    {
+        if (!intersects(spheres[i])) continue;
+        visible.push_back(i);
+        ++numVisible;
+    }
+    
+    if (stats)
+    {
+        stats->tested += count;
+        stats->culled += count - numVisible;
+        stats->drawn += numVisible;
+    }
+    return numVisible;
+}
@@ -0,0 +1,65 @@
+#ifndef __LearnOpenGL__Frustum__
+#define __LearnOpenGL__Frustum__
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+
+// Per-frame visibility counters: every object tested is either culled or drawn
+struct CullStats
+{
+    size_t tested;
+    size_t culled;
+    size_t drawn;
+    
+    CullStats() : tested(0), culled(0), drawn(0) {}
+    void reset() { tested = culled = drawn = 0; }
+};
+
+enum FrustumPlane
+{
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR,
+    NUM_FRUSTUM_PLANES
+};
+
+enum FrustumTest
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+/*
+ * The six planes of a camera's view volume, in world space. Each plane is stored as (normal, d) with
+ * a unit normal that points into the frustum, so a point p is inside a plane when dot(normal, p) + d
+ * is non-negative and that value is also its distance to the plane.
+ */
+class Frustum
+{
+    
+public:
+    
+    Frustum();
+    Frustum(const glm::mat4 &viewProjection);
+    void update(const glm::mat4 &viewProjection);
+    Frustum transformed(const glm::mat4 &model) const;
+    const glm::vec4 &getPlane(FrustumPlane plane) const { return planes[plane]; }
+    
+    bool intersects(const BoundingSphere &sphere) const;
+    bool intersects(const AABB &box) const;
+    FrustumTest classify(const AABB &box) const;
+    size_t cullSpheres(const BoundingSphere *spheres, size_t count, std::vector<size_t> &visible, CullStats *stats = nullptr) const;
+    
+private:
+    
+    glm::vec4 planes[NUM_FRUSTUM_PLANES];
+    
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "GlState.h"
+
+#include <iomanip>
+
+// ===============================
+// Public member functions
+// ===============================
+
+/*
+ * GLEW's entry points are function pointers that are only filled in by glewInit(), so we can't take
+ * their addresses up front; the table forwards to them at call time instead.
+ */
+const GlDispatch &GlDispatch::getDefault()
+{
+    static const GlDispatch dispatch =
+    {
+        [](GLuint program) { glUseProgram(program); },
+        [](GLuint array) { glBindVertexArray(array); },
+        [](GLenum target, GLuint buffer) { glBindBuffer(target, buffer); },
+        [](GLenum target, GLuint index, GLuint buffer) { glBindBufferBase(target, index, buffer); },
+        [](GLenum texture) { glActiveTexture(texture); },
+        [](GLenum target, GLuint texture) { glBindTexture(target, texture); },
+        [](GLenum capability) { glEnable(capability); },
+        [](GLenum capability) { glDisable(capability); },
+        [](GLenum func) { glDepthFunc(func); },
+        [](GLboolean flag) { glDepthMask(flag); },
+        [](GLenum sourceFactor, GLenum destinationFactor) { glBlendFunc(sourceFactor, destinationFactor); },
+        [](GLint x, GLint y, GLsizei width, GLsizei height) { glViewport(x, y, width, height); },
+        [](GLuint program) { glDeleteProgram(program); },
+        [](GLsizei n, const GLuint *arrays) { glDeleteVertexArrays(n, arrays); },
+        [](GLsizei n, const GLuint *buffers) { glDeleteBuffers(n, buffers); },
+        [](GLsizei n, const GLuint *textures) { glDeleteTextures(n, textures); }
+    };
+    return dispatch;
+}
+
+GlState::GlState(const GlDispatch &dispatch) : gl(dispatch)
+{
+    invalidate();
+    resetCounters();
+}
+
+GlState &GlState::getInstance()
+{
+    static GlState state(GlDispatch::getDefault());
+    return state;
+}
+
+void GlState::useProgram(GLuint program)
+{
+    bool issue = this->program != program;
+    if (issue) gl.useProgram(program);
+    this->program = program;
+    count(GL_STATE_PROGRAM, issue);
+}
+
+// The element array buffer binding is part of the vertex array object, so it changes along with it
+void GlState::bindVertexArray(GLuint array)
+{
+    bool issue = vertexArray != array;
+    if (issue)
+    {
+        gl.bindVertexArray(array);
+        buffers[getBufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+    vertexArray = array;
+    count(GL_STATE_VERTEX_ARRAY, issue);
+}
+
+void GlState::bindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = getBufferSlot(target);
+    bool issue = slot == -1 || buffers[slot] != buffer;
+    if (issue) gl.bindBuffer(target, buffer);
+    if (slot != -1) buffers[slot] = buffer;
+    count(GL_STATE_BUFFER, issue);
+}
+
+// Binding to an indexed binding point also binds the buffer to the target's generic binding point
+void GlState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    bool tracked = target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BINDINGS;
+    bool issue = !tracked || uniformBindings[index] != buffer;
+    if (issue)
+    {
+        gl.bindBufferBase(target, index, buffer);
+        int slot = getBufferSlot(target);
+        if (slot != -1) buffers[slot] = buffer;
+    }
+    if (tracked) uniformBindings[index] = buffer;
+    count(GL_STATE_BUFFER, issue);
+}
+
+void GlState::activeTexture(GLenum texture)
+{
+    bool issue = activeUnit != texture;
+    if (issue) gl.activeTexture(texture);
+    activeUnit = texture;
+    count(GL_STATE_ACTIVE_TEXTURE, issue);
+}
+
+// Only GL_TEXTURE_2D bindings are shadowed (it's the only target we use); others always go through
+void GlState::bindTexture(GLenum target, GLuint texture)
+{
+    GLuint unit = activeUnit - GL_TEXTURE0;
+    bool tracked = target == GL_TEXTURE_2D && activeUnit != UNKNOWN && unit < MAX_TEXTURE_UNITS;
+    bool issue = !tracked || textures[unit] != texture;
+    if (issue) gl.bindTexture(target, texture);
+    if (tracked) textures[unit] = texture;
+    count(GL_STATE_TEXTURE, issue);
+}
+
+void GlState::depthFunc(GLenum func)
+{
+    bool issue = depthFunction != func;
+    if (issue) gl.depthFunc(func);
+    depthFunction = func;
+    count(GL_STATE_DEPTH, issue);
+}
+
+void GlState::depthMask(GLboolean flag)
+{
+    GLuint writes = flag ? GL_TRUE : GL_FALSE;
+    bool issue = depthWrites != writes;
+    if (issue) gl.depthMask(flag);
+    depthWrites = writes;
+    count(GL_STATE_DEPTH, issue);
+}
+
+void GlState::blendFunc(GLenum sourceFactor, GLenum destinationFactor)
+{
+    bool issue = blendSource != sourceFactor || blendDestination != destinationFactor;
+    if (issue) gl.blendFunc(sourceFactor, destinationFactor);
+    blendSource = sourceFactor;
+    blendDestination = destinationFactor;
+    count(GL_STATE_BLEND, issue);
+}
+
+void GlState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    bool issue = !viewportKnown || viewportRect[0] != x || viewportRect[1] != y || viewportRect[2] != width || viewportRect[3] != height;
+    if (issue) gl.viewport(x, y, width, height);
+    viewportRect[0] = x;
+    viewportRect[1] = y;
+    viewportRect[2] = width;
+    viewportRect[3] = height;
+    viewportKnown = true;
+    count(GL_STATE_VIEWPORT, issue);
+}
+
+/*
+ * A program that is deleted while in use stays in use (and keeps its name) until another one replaces
+ * it, so unlike the other objects it doesn't change what's bound.
+ */
+void GlState::deleteProgram(GLuint program)
+{
+    if (program) gl.deleteProgram(program);
+}
+
+void GlState::deleteVertexArray(GLuint array)
+{
+    if (!array) return;
+    gl.deleteVertexArrays(1, &array);
+    if (vertexArray == array)
+    {
+        vertexArray = 0;
+        buffers[getBufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void GlState::deleteBuffer(GLuint buffer)
+{
+    if (!buffer) return;
+    gl.deleteBuffers(1, &buffer);
+    for (GLuint &binding: buffers)
+        if (binding == buffer) binding = 0;
+    for (GLuint &binding: uniformBindings)
+        if (binding == buffer) binding = 0;
+}
+
+void GlState::deleteTexture(GLuint texture)
+{
+    if (!texture) return;
+    gl.deleteTextures(1, &texture);
+    for (GLuint &binding: textures)
+        if (binding == texture) binding = 0;
+}
+
+// Forget everything, e.g. after code that doesn't go through us has touched the context
+void GlState::invalidate()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    for (GLuint &binding: buffers)
+        binding = UNKNOWN;
+    for (GLuint &binding: uniformBindings)
+        binding = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (GLuint &binding: textures)
+        binding = UNKNOWN;
+    capabilities.clear();
+    depthFunction = UNKNOWN;
+    depthWrites = UNKNOWN;
+    blendSource = UNKNOWN;
+    blendDestination = UNKNOWN;
+    viewportKnown = false;
+}
+
+void GlState::resetCounters()
+{
+    for (int i = 0; i < GL_STATE_CATEGORY_COUNT; ++i)
+        counters.issued[i] = counters.skipped[i] = 0;
+}
+
+void GlState::printCounters(std::ostream &stream) const
+{
+    static const char *CATEGORY_NAMES[GL_STATE_CATEGORY_COUNT] =
+    {
+        "program", "vertex array", "buffer", "active texture", "texture", "capability", "depth", "blend", "viewport"
+    };
+
+    size_t totalIssued = 0;
+    size_t totalSkipped = 0;
+    stream << "GL state calls (issued / skipped):" << std::endl;
+    for (int i = 0; i < GL_STATE_CATEGORY_COUNT; ++i)
+    {
+        if (counters.issued[i] == 0 && counters.skipped[i] == 0) continue;
+        stream << "  " << std::left << std::setw(16) << CATEGORY_NAMES[i] << std::right
+               << std::setw(8) << counters.issued[i] << " / " << std::setw(8) << counters.skipped[i] << std::endl;
+        totalIssued += counters.issued[i];
+        totalSkipped += counters.skipped[i];
+    }
+    stream << "  " << std::left << std::setw(16) << "total" << std::right
+           << std::setw(8) << totalIssued << " / " << std::setw(8) << totalSkipped << std::endl;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+void GlState::setCapability(GLenum capability, GLboolean enabled)
+{
+    auto it = capabilities.find(capability);
+    bool issue = it == capabilities.end() || it->second != enabled;
+    if (issue)
+    {
+        if (enabled) gl.enable(capability);
+        else gl.disable(capability);
+    }
+    capabilities[capability] = enabled;
+    count(GL_STATE_CAPABILITY, issue);
+}
+
+int GlState::getBufferSlot(GLenum target)
+{
+    switch (target)
+    {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_DRAW_INDIRECT_BUFFER: return 3;
+        case GL_PIXEL_UNPACK_BUFFER: return 4;
+        case GL_PIXEL_PACK_BUFFER: return 5;
+        case GL_COPY_READ_BUFFER: return 6;
+        case GL_COPY_WRITE_BUFFER: return 7;
+        default: return -1;
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef __LearnOpenGL__GlState__
+#define __LearnOpenGL__GlState__
+
+#include <iostream>
+#include <unordered_map>
+#include <GL/glew.h>
+
+/*
+ * The GL entry points GlState calls. getDefault() forwards to the real driver; filling one of these
+ * with your own functions lets GlState run (and be checked) without a GL context.
+ */
+struct GlDispatch
+{
+    void (*useProgram)(GLuint program);
+    void (*bindVertexArray)(GLuint array);
+    void (*bindBuffer)(GLenum target, GLuint buffer);
+    void (*bindBufferBase)(GLenum target, GLuint index, GLuint buffer);
+    void (*activeTexture)(GLenum texture);
+    void (*bindTexture)(GLenum target, GLuint texture);
+    void (*enable)(GLenum capability);
+    void (*disable)(GLenum capability);
+    void (*depthFunc)(GLenum func);
+    void (*depthMask)(GLboolean flag);
+    void (*blendFunc)(GLenum sourceFactor, GLenum destinationFactor);
+    void (*viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*deleteProgram)(GLuint program);
+    void (*deleteVertexArrays)(GLsizei n, const GLuint *arrays);
+    void (*deleteBuffers)(GLsizei n, const GLuint *buffers);
+    void (*deleteTextures)(GLsizei n, const GLuint *textures);
+
+    static const GlDispatch &getDefault();
+};
+
+enum GlStateCategory
+{
+    GL_STATE_PROGRAM,
+    GL_STATE_VERTEX_ARRAY,
+    GL_STATE_BUFFER,                                                // Including indexed (glBindBufferBase) bindings
+    GL_STATE_ACTIVE_TEXTURE,
+    GL_STATE_TEXTURE,
+    GL_STATE_CAPABILITY,                                            // glEnable / glDisable
+    GL_STATE_DEPTH,
+    GL_STATE_BLEND,
+    GL_STATE_VIEWPORT,
+    GL_STATE_CATEGORY_COUNT
+};
+
+struct GlStateCounters
+{
+    size_t issued[GL_STATE_CATEGORY_COUNT];                         // Calls that reached the driver
+    size_t skipped[GL_STATE_CATEGORY_COUNT];                        // Calls dropped because nothing would have changed
+};
+
+/*
+ * Shadows the GL state we change most often and drops calls that would set it to what it already is,
+ * so code can bind what it needs without first checking, or afterwards resetting, what was bound. All
+ * binds, program switches and the few fixed function settings we use go through getInstance(), which
+ * belongs to the one GL context we render with. Objects must be deleted through it as well: OpenGL
+ * unbinds deleted objects and reuses their names, which the shadow copy has to know about.
+ *
+ * State we haven't seen set yet (or that was changed behind our back and invalidate()d) is unknown,
+ * and the next call that sets it always goes through.
+ */
+class GlState
+{
+
+public:
+
+    explicit GlState(const GlDispatch &dispatch);
+    static GlState &getInstance();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint array);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void activeTexture(GLenum texture);
+    void bindTexture(GLenum target, GLuint texture);
+    void enable(GLenum capability) { setCapability(capability, GL_TRUE); }
+    void disable(GLenum capability) { setCapability(capability, GL_FALSE); }
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean flag);
+    void blendFunc(GLenum sourceFactor, GLenum destinationFactor);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void deleteProgram(GLuint program);
+    void deleteVertexArray(GLuint array);
+    void deleteBuffer(GLuint buffer);
+    void deleteTexture(GLuint texture);
+    void invalidate();
+
+    const GlStateCounters &getCounters() const { return counters; }
+    void resetCounters();
+    void printCounters(std::ostream &stream) const;
+
+private:
+
+    void setCapability(GLenum capability, GLboolean enabled);
+    void count(GlStateCategory category, bool issue) { ++(issue ? counters.issued : counters.skipped)[category]; }
+    static int getBufferSlot(GLenum target);
+
+    static const GLuint UNKNOWN = 0xFFFFFFFF;                       // Never a valid name or enum
+    static const int BUFFER_SLOTS = 8;                              // Targets getBufferSlot() knows about
+    static const int MAX_UNIFORM_BINDINGS = 16;
+    static const int MAX_TEXTURE_UNITS = 32;
+
+    const GlDispatch &gl;
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffers[BUFFER_SLOTS];
+    GLuint uniformBindings[MAX_UNIFORM_BINDINGS];
+    GLenum activeUnit;                                              // GL_TEXTURE0 + i
+    GLuint textures[MAX_TEXTURE_UNITS];                             // GL_TEXTURE_2D, per unit
+    std::unordered_map<GLenum, GLboolean> capabilities;
+    GLenum depthFunction;
+    GLuint depthWrites;                                             // GL_TRUE, GL_FALSE or UNKNOWN
+    GLenum blendSource;
+    GLenum blendDestination;
+    GLint viewportRect[4];
+    bool viewportKnown;
+    GlStateCounters counters;
+
+};
+
+#endif
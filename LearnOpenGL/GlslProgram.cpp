@@ -1,16 +1,24 @@
-#include "glslProgram.h"
+#include "GlslProgram.h"
+
+#include <algorithm>
+#include <chrono>
+#include "GlState.h"
+#include "ProgramCache.h"
+#include "Profiler.h"
 
 // ===============================
 // Public member functions
 // ===============================
 
-GlslProgram::GlslProgram()
+GlslProgram::GlslProgram() : vertShaderID(0), fragShaderID(0), programID(0), bLoaded(false), linkCount(0)
 {
     
 }
 
 void GlslProgram::setupProgramFromFile(const std::string &vertShaderPath, const std::string &fragShaderPath)
 {
+    this->vertShaderPath = vertShaderPath;
+    this->fragShaderPath = fragShaderPath;
     std::string vertShaderSource = loadFileToString(vertShaderPath);
     std::string fragShaderSource = loadFileToString(fragShaderPath);
     compileProgram(vertShaderSource, fragShaderSource);
@@ -21,48 +29,77 @@ void GlslProgram::setupProgramFromSource(const std::string &vertShaderSrc, const
     compileProgram(vertShaderSrc, fragShaderSrc);
 }
 
-bool GlslProgram::isLoaded() const
+/*
+ * Rebuilds the program from the files it was set up from. The new program only replaces the old one
+ * once it has compiled and linked, so a typo in the middle of editing a shader leaves the last good
+ * version running. Uniform locations are introspected anew (handles keep their indices) and the
+ * uniform block bindings made so far are applied to the new program. Plain uniform values are not
+ * carried over, so anything that isn't set every frame has to be set again by the caller.
+ */
+bool GlslProgram::reload()
 {
-    return bLoaded;
+    if (vertShaderPath.empty() || fragShaderPath.empty()) return false;
+    
+    GLuint newProgramID = buildProgram(loadFileToString(vertShaderPath), loadFileToString(fragShaderPath));
+    if (newProgramID == 0)
+    {
+        std::cerr << "Failed to reload " << vertShaderPath << " and " << fragShaderPath << ", keeping the previous program." << std::endl;
+        return false;
+    }
+    
+    GlState::getInstance().deleteProgram(programID);
+    programID = newProgramID;
+    bLoaded = true;
+    ++linkCount;
+    introspectUniforms();
+    for (const auto &binding: blockBindings)
+        bindUniformBlock(binding.first, binding.second);
+    return true;
 }
 
-void GlslProgram::begin() const
+bool GlslProgram::isLoaded() const
 {
-    glUseProgram(programID);
+    return bLoaded;
 }
 
-void GlslProgram::end() const
+/*
+ * There's no matching end(): the program stays in use until whatever is drawn next binds its own, so
+ * switching straight from one program to the next costs one call instead of two (none at all when it's
+ * this program again).
+ */
+void GlslProgram::begin() const
 {
-    glUseProgram(0);
+    GlState::getInstance().useProgram(programID);
 }
 
 /* 
  * Note that finding the uniform location does not require you to use the shader program first, but
  * updating a uniform does require you to first use the program (by calling glUseProgram), because it 
  * sets the uniform on the currently active shader program. So, these calls will only work between
- * glslProgram::begin and glslProgram end.
+ * glslProgram::begin and glslProgram end. Locations come from the table built by introspectUniforms(),
+ * so we never have to ask the driver for them while rendering.
  */
 void GlslProgram::setUniform1f(const std::string &uniformName, float v1) const
 {
-    GLint uniformLocation = glGetUniformLocation(programID, uniformName.c_str());
+    GLint uniformLocation = findUniformLocation(uniformName);
     if (uniformLocation != -1) glUniform1f(uniformLocation, v1);
 }
 
 void GlslProgram::setUniform2f(const std::string &uniformName, float v1, float v2) const
 {
-    GLint uniformLocation = glGetUniformLocation(programID, uniformName.c_str());
+    GLint uniformLocation = findUniformLocation(uniformName);
     if (uniformLocation != -1) glUniform2f(uniformLocation, v1, v2);
 }
 
 void GlslProgram::setUniform3f(const std::string &uniformName, float v1, float v2, float v3) const
 {
-    GLint uniformLocation = glGetUniformLocation(programID, uniformName.c_str());
+    GLint uniformLocation = findUniformLocation(uniformName);
     if (uniformLocation != -1) glUniform3f(uniformLocation, v1, v2, v3);
 }
 
 void GlslProgram::setUniform4f(const std::string &uniformName, float v1, float v2, float v3, float v4) const
 {
-    GLint uniformLocation = glGetUniformLocation(programID, uniformName.c_str());
+    GLint uniformLocation = findUniformLocation(uniformName);
     if (uniformLocation != -1) glUniform4f(uniformLocation, v1, v2, v3, v4);
 }
 
@@ -75,7 +112,7 @@ void GlslProgram::setUniform4x4Matrix(const std::string &uniformName, const glm:
      * 3) Should the matrix be transposed?
      * 4) The actual matrix data, transformed into an OpenGL-ready format
      */
-    GLuint uniformLoc = glGetUniformLocation(programID, uniformName.c_str());
+    GLint uniformLoc = findUniformLocation(uniformName);
     if (uniformLoc != -1) glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
@@ -85,16 +122,102 @@ void GlslProgram::setUniformSampler2D(const std::string &samplerName, GLint loca
      * Note that we're using glUniform1i to set the location or texture unit of the uniform samplers.
      * By setting them via glUniform1i we make sure each uniform sampler corresponds to the proper texture unit.
      */
-    glActiveTexture(GL_TEXTURE0 + location);
-    GLint uniformLocation = glGetUniformLocation(programID, samplerName.c_str());
+    GlState::getInstance().activeTexture(GL_TEXTURE0 + location);
+    GLint uniformLocation = findUniformLocation(samplerName);
     if (uniformLocation != -1) glUniform1i(uniformLocation, location);
 }
 
 void GlslProgram::setUniformSampler2D(const std::string &samplerName, const Image &img, GLint texUnit) const
 {
-    glActiveTexture(GL_TEXTURE0 + texUnit);
+    GlState::getInstance().activeTexture(GL_TEXTURE0 + texUnit);
+    img.bind();
+    GLint uniformLocation = findUniformLocation(samplerName);
+    if (uniformLocation != -1) glUniform1i(uniformLocation, texUnit);
+}
+
+/*
+ * GLSL 330 can't declare a block's binding point in the shader itself, so we look the block up by
+ * name and attach it to one here. Any buffer bound to that point with glBindBufferBase is then
+ * visible to every program whose block shares it.
+ */
+bool GlslProgram::bindUniformBlock(const std::string &blockName, GLuint bindingPoint) const
+{
+    GLuint blockIndex = glGetUniformBlockIndex(programID, blockName.c_str());
+    if (blockIndex == GL_INVALID_INDEX)
+    {
+        std::cerr << "WARNING: " << blockName << " is not an active uniform block of program " << programID << "." << std::endl;
+        return false;
+    }
+    glUniformBlockBinding(programID, blockIndex, bindingPoint);
+    
+    // Remembered so that reload() can bind the same blocks on the new program
+    auto it = std::find_if(blockBindings.begin(), blockBindings.end(), [&](const std::pair<std::string, GLuint> &binding) { return binding.first == blockName; });
+    if (it == blockBindings.end())
+        blockBindings.push_back(std::make_pair(blockName, bindingPoint));
+    else
+        it->second = bindingPoint;
+    return true;
+}
+
+UniformHandle GlslProgram::getUniform(const std::string &uniformName)
+{
+    for (size_t i = 0; i < handleNames.size(); ++i)
+    {
+        if (handleNames[i] == uniformName)
+            return UniformHandle(static_cast<GLint>(i));
+    }
+    handleNames.push_back(uniformName);
+    handleLocations.push_back(findUniformLocation(uniformName));
+    return UniformHandle(static_cast<GLint>(handleNames.size() - 1));
+}
+
+void GlslProgram::set(UniformHandle handle, GLint v) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniform1i(uniformLocation, v);
+}
+
+void GlslProgram::set(UniformHandle handle, float v) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniform1f(uniformLocation, v);
+}
+
+void GlslProgram::set(UniformHandle handle, const glm::vec2 &v) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniform2f(uniformLocation, v.x, v.y);
+}
+
+void GlslProgram::set(UniformHandle handle, const glm::vec3 &v) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniform3f(uniformLocation, v.x, v.y, v.z);
+}
+
+void GlslProgram::set(UniformHandle handle, const glm::vec4 &v) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniform4f(uniformLocation, v.x, v.y, v.z, v.w);
+}
+
+void GlslProgram::set(UniformHandle handle, const glm::mat3 &m) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniformMatrix3fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(m));
+}
+
+void GlslProgram::set(UniformHandle handle, const glm::mat4 &m) const
+{
+    GLint uniformLocation = getLocation(handle);
+    if (uniformLocation != -1) glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(m));
+}
+
+void GlslProgram::setSampler2D(UniformHandle handle, const Image &img, GLint texUnit) const
+{
+    GlState::getInstance().activeTexture(GL_TEXTURE0 + texUnit);
     img.bind();
-    GLint uniformLocation = glGetUniformLocation(programID, samplerName.c_str());
+    GLint uniformLocation = getLocation(handle);
     if (uniformLocation != -1) glUniform1i(uniformLocation, texUnit);
 }
 
@@ -102,26 +225,56 @@ void GlslProgram::setUniformSampler2D(const std::string &samplerName, const Imag
 // Private member functions
 // ===============================
 
+// Read the whole file in one go rather than line by line, which copied the source once per line
 std::string GlslProgram::loadFileToString(const std::string &filePath)
 {
-    std::string fileData;
-    std::fstream stream(filePath);
-    if (stream.is_open())
-    {
-        std::string line = "";
-        while (std::getline(stream, line))
-            fileData += "\n" + line;
-        stream.close();
-    }
-    else
+    std::ifstream stream(filePath, std::ios::binary);
+    if (!stream.is_open())
     {
         std::cerr << "Failed to open file stream." << std::endl;
+        return std::string();
     }
+    
+    stream.seekg(0, std::ios::end);
+    std::string fileData(static_cast<size_t>(stream.tellg()), '\0');
+    stream.seekg(0, std::ios::beg);
+    stream.read(&fileData[0], fileData.size());
     return fileData;
 }
 
 void GlslProgram::compileProgram(const std::string &vertShaderSrc, const std::string &fragShaderSrc)
 {
+    programID = buildProgram(vertShaderSrc, fragShaderSrc);
+    bLoaded = programID != 0;
+    if (!bLoaded) return;
+    ++linkCount;
+    introspectUniforms();
+}
+
+/*
+ * Programs we've linked before are handed to the driver as a binary from the ProgramCache, which skips
+ * compiling and linking altogether. Anything the cache can't provide, including binaries the driver
+ * rejects, is built from source as usual and then stored for the next launch.
+ */
+GLuint GlslProgram::buildProgram(const std::string &vertShaderSrc, const std::string &fragShaderSrc)
+{
+    ProfileScope zone("Shader compile");
+    auto startTime = std::chrono::high_resolution_clock::now();
+    ProgramCache &cache = ProgramCache::getInstance();
+    bool useCache = cache.isSupported();
+    uint64_t cacheKey = useCache ? cache.computeKey(vertShaderSrc, fragShaderSrc) : 0;
+    if (useCache)
+    {
+        GLuint cachedProgramID = glCreateProgram();
+        if (cache.load(cachedProgramID, cacheKey))
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+            std::cout << "Loaded cached program binary in " << elapsed.count() << " ms." << std::endl;
+            return cachedProgramID;
+        }
+        GlState::getInstance().deleteProgram(cachedProgramID);
+    }
+    
     vertShaderID = glCreateShader(GL_VERTEX_SHADER);
     fragShaderID = glCreateShader(GL_FRAGMENT_SHADER);
     
@@ -143,13 +296,14 @@ void GlslProgram::compileProgram(const std::string &vertShaderSrc, const std::st
     {
         std::cerr << "ERROR: compiling vertex shader.\n";
         char buffer[MAX_LOG_LENGTH];
-        glGetShaderInfoLog(vertShaderID, MAX_LOG_LENGTH, NULL, buffer);
+        GLsizei logLength = 0;
+        glGetShaderInfoLog(vertShaderID, MAX_LOG_LENGTH, &logLength, buffer);
         
-        for (int i = 0; i < MAX_LOG_LENGTH; ++i)
+        for (int i = 0; i < logLength; ++i)
             std::cerr << buffer[i];
         glDeleteShader(vertShaderID);
-        bLoaded = false;
-        return;
+        glDeleteShader(fragShaderID);
+        return 0;
     }
     
     success = 0;
@@ -163,39 +317,103 @@ void GlslProgram::compileProgram(const std::string &vertShaderSrc, const std::st
     {
         std::cerr << "ERROR: compiling fragment shader.\n";
         char buffer[MAX_LOG_LENGTH];
-        glGetShaderInfoLog(fragShaderID, MAX_LOG_LENGTH, NULL, buffer);
+        GLsizei logLength = 0;
+        glGetShaderInfoLog(fragShaderID, MAX_LOG_LENGTH, &logLength, buffer);
         
-        for (int i = 0; i < MAX_LOG_LENGTH; ++i)
+        for (int i = 0; i < logLength; ++i)
             std::cerr << buffer[i];
+        glDeleteShader(vertShaderID);
         glDeleteShader(fragShaderID);
-        bLoaded = false;
-        return;
+        return 0;
     }
     
-    programID = glCreateProgram();
-    glAttachShader(programID, vertShaderID);
-    glAttachShader(programID, fragShaderID);
+    GLuint newProgramID = glCreateProgram();
+    if (useCache) glProgramParameteri(newProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(newProgramID, vertShaderID);
+    glAttachShader(newProgramID, fragShaderID);
     
     success = 0;
-    glLinkProgram(programID);
-    glGetProgramiv(programID, GL_LINK_STATUS, &success);
+    glLinkProgram(newProgramID);
+    glGetProgramiv(newProgramID, GL_LINK_STATUS, &success);
     
     if(!success)
     {
         std::cerr << "ERROR: linking program object.\n";
         char buffer[MAX_LOG_LENGTH];
-        glGetProgramInfoLog(programID, MAX_LOG_LENGTH, NULL, buffer);
+        GLsizei logLength = 0;
+        glGetProgramInfoLog(newProgramID, MAX_LOG_LENGTH, &logLength, buffer);
         
-        for (int i = 0; i < MAX_LOG_LENGTH; ++i)
+        for (int i = 0; i < logLength; ++i)
             std::cerr << buffer[i];
-        bLoaded = false;
-        return;
+        glDeleteShader(vertShaderID);
+        glDeleteShader(fragShaderID);
+        GlState::getInstance().deleteProgram(newProgramID);
+        return 0;
     }
     
     // Once we've linked our shaders into a program object, we don't need them anymore
     glDeleteShader(vertShaderID);
     glDeleteShader(fragShaderID);
-    bLoaded = true;
+    if (useCache) cache.store(newProgramID, cacheKey);
+    
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    std::cout << "Successfully loaded shader sources in " << elapsed.count() << " ms." << std::endl;
+    return newProgramID;
+}
+
+/*
+ * Ask the driver once for every active uniform and remember where it lives. Arrays are only reported
+ * by the name of their first element (e.g. "uBones[0]"), so we also resolve the remaining elements
+ * and the bare array name. Uniforms that live in a uniform block have no location and are skipped.
+ */
+void GlslProgram::introspectUniforms()
+{
+    uniformLocations.clear();
+    reportedUniforms.clear();
+    
+    GLint numUniforms = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    
+    std::vector<GLchar> nameBuffer(maxNameLength + 1);
+    for (GLint i = 0; i < numUniforms; ++i)
+    {
+        GLsizei nameLength = 0;
+        GLint arraySize = 0;
+        GLenum type;
+        glGetActiveUniform(programID, i, static_cast<GLsizei>(nameBuffer.size()), &nameLength, &arraySize, &type, nameBuffer.data());
+        
+        std::string name(nameBuffer.data(), nameLength);
+        GLint location = glGetUniformLocation(programID, name.c_str());
+        if (location == -1) continue;
+        uniformLocations[name] = location;
+        
+        const std::string arraySuffix = "[0]";
+        if (name.size() > arraySuffix.size() && name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0)
+        {
+            std::string baseName = name.substr(0, name.size() - arraySuffix.size());
+            uniformLocations[baseName] = location;
+            for (GLint element = 1; element < arraySize; ++element)
+            {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations[elementName] = glGetUniformLocation(programID, elementName.c_str());
+            }
+        }
+    }
+    
+    // Handles handed out earlier keep their indices, but need to point at the new locations
+    for (size_t i = 0; i < handleNames.size(); ++i)
+        handleLocations[i] = findUniformLocation(handleNames[i]);
+}
+
+GLint GlslProgram::findUniformLocation(const std::string &uniformName) const
+{
+    auto it = uniformLocations.find(uniformName);
+    if (it != uniformLocations.end()) return it->second;
     
-    std::cout << "Successfully loaded shader sources." << std::endl;
+    // Unknown (or optimized away) uniforms used to be silently ignored, which made typos hard to spot
+    if (bLoaded && reportedUniforms.insert(uniformName).second)
+        std::cerr << "WARNING: " << uniformName << " is not an active uniform of program " << programID << "." << std::endl;
+    return -1;
 }
\ No newline at end of file
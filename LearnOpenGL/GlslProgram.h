@@ -4,6 +4,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -11,6 +13,19 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "Image.h"
 
+/*
+ * A handle is an index into the program's table of resolved uniform locations, so setting a uniform
+ * through one is a plain array lookup: no strings are built, hashed or passed to the driver.
+ */
+struct UniformHandle
+{
+    GLint index;
+    
+    UniformHandle() : index(-1) {}
+    explicit UniformHandle(GLint i) : index(i) {}
+    bool isValid() const { return index != -1; }
+};
+
 class GlslProgram
 {
     
@@ -19,9 +34,12 @@ public:
     GlslProgram();
     void setupProgramFromFile(const std::string &vertShaderPath, const std::string &fragShaderPath);
     void setupProgramFromSource(const std::string &vertShaderSrc, const std::string &fragShaderSrc);
+    bool reload();
+    const std::string &getVertShaderPath() const { return vertShaderPath; }
+    const std::string &getFragShaderPath() const { return fragShaderPath; }
     void begin() const;
-    void end() const;
     bool isLoaded() const;
+    unsigned int getLinkCount() const { return linkCount; }
     void setUniform1f(const std::string &uniformName, float v1) const;
     void setUniform2f(const std::string &uniformName, float v1, float v2) const;
     void setUniform3f(const std::string &uniformName, float v1, float v2, float v3) const;
@@ -29,6 +47,18 @@ public:
     void setUniform4x4Matrix(const std::string &uniformName, const glm::mat4 &matrix) const;
     void setUniformSampler2D(const std::string &samplerName, GLint location) const;
     void setUniformSampler2D(const std::string &samplerName, const Image &img, GLint texUnit) const;
+    bool bindUniformBlock(const std::string &blockName, GLuint bindingPoint) const;
+    
+    UniformHandle getUniform(const std::string &uniformName);
+    bool hasUniform(const std::string &uniformName) const { return uniformLocations.count(uniformName) != 0; }
+    void set(UniformHandle handle, GLint v) const;
+    void set(UniformHandle handle, float v) const;
+    void set(UniformHandle handle, const glm::vec2 &v) const;
+    void set(UniformHandle handle, const glm::vec3 &v) const;
+    void set(UniformHandle handle, const glm::vec4 &v) const;
+    void set(UniformHandle handle, const glm::mat3 &m) const;
+    void set(UniformHandle handle, const glm::mat4 &m) const;
+    void setSampler2D(UniformHandle handle, const Image &img, GLint texUnit) const;
     
 private:
     
@@ -36,10 +66,24 @@ private:
     GLuint fragShaderID;
     GLuint programID;
     bool bLoaded;
+    unsigned int linkCount;                                         // Bumped by every successful (re)link, which resets all uniform values
+    std::string vertShaderPath;                                     // Empty for programs set up from source
+    std::string fragShaderPath;
+    mutable std::vector<std::pair<std::string, GLuint>> blockBindings;
     static const int MAX_LOG_LENGTH = 4096;
     
+    // Uniform locations, introspected once after linking
+    std::unordered_map<std::string, GLint> uniformLocations;
+    std::vector<std::string> handleNames;
+    std::vector<GLint> handleLocations;
+    mutable std::unordered_set<std::string> reportedUniforms;
+    
     std::string loadFileToString(const std::string &filePath);
     void compileProgram(const std::string &vertShaderSrc, const std::string &fragShaderSrc);
+    GLuint buildProgram(const std::string &vertShaderSrc, const std::string &fragShaderSrc);
+    void introspectUniforms();
+    GLint findUniformLocation(const std::string &uniformName) const;
+    GLint getLocation(UniformHandle handle) const { return handle.index != -1 ? handleLocations[handle.index] : -1; }
     
 };
 
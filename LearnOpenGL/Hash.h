@@ -0,0 +1,26 @@
+#ifndef __LearnOpenGL__Hash__
+#define __LearnOpenGL__Hash__
+
+#include <cstddef>
+#include <cstdint>
+
+static const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV1A_PRIME = 1099511628211ULL;
+
+/*
+ * 64-bit FNV-1a: not cryptographic, but fast and more than good enough to tell cache keys, edited
+ * source files and vertices apart. Pass the previous result as hash to continue hashing where the
+ * last call left off.
+ */
+inline uint64_t fnv1a(const void *data, size_t length, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+#endif
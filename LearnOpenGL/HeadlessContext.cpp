@@ -0,0 +1,176 @@
+#include "HeadlessContext.h"
+
+#include <cstring>
+#include <iostream>
+#include <SOIL/SOIL.h>
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// ===============================
+// Public member functions
+// ===============================
+
+HeadlessContext::HeadlessContext(int width, int height) : width(width), height(height), display(nullptr), context(nullptr),
+                                                          framebuffer(0), colorBuffer(0), depthBuffer(0)
+{
+    if (!createContext()) return;
+    createFramebuffer();
+}
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef __linux__
+    if (!context) return;
+    if (framebuffer)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+#endif
+}
+
+// Without a buffer swap to wait on, this is what makes a frame's time include the rendering itself
+void HeadlessContext::finishFrame() const
+{
+    glFinish();
+}
+
+/*
+ * Saves the framebuffer's current contents as a BMP. OpenGL's rows go from the bottom up, image files'
+ * from the top down, so the rows are flipped on the way.
+ */
+bool HeadlessContext::writeFrame(const std::string &path)
+{
+    if (!isValid()) return false;
+
+    const size_t rowSize = width * 3;
+    pixels.resize(rowSize * height);
+    flippedPixels.resize(pixels.size());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    for (int y = 0; y < height; ++y)
+        std::memcpy(&flippedPixels[y * rowSize], &pixels[(height - 1 - y) * rowSize], rowSize);
+
+    if (!SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_BMP, width, height, 3, &flippedPixels[0]))
+    {
+        std::cerr << "Failed to write frame " << path << ": " << SOIL_last_result() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+/*
+ * Mesa's surfaceless platform needs neither a display server nor a GPU. EGL_KHR_no_config_context and
+ * EGL_KHR_surfaceless_context (both of which Mesa has) let us skip picking a config and creating a
+ * surface, since we never draw to anything but our own framebuffer.
+ */
+bool HeadlessContext::createContext()
+{
+#ifdef __linux__
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        std::cout << "Failed to initialize EGL." << std::endl;
+        return false;
+    }
+    display = eglDisplay;
+
+    const char *extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "EGL " << major << "." << minor << " can't render OpenGL without a surface." << std::endl;
+        eglTerminate(eglDisplay);
+        return false;
+    }
+
+    EGLConfig config = (EGLConfig)0;
+    if (!std::strstr(extensions, "EGL_KHR_no_config_context"))
+    {
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint configCount = 0;
+        eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount);
+    }
+
+    const EGLint contextAttributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 3,                               // The same 3.3 core profile we ask GLFW for
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        std::cout << "Failed to create a headless OpenGL 3.3 context." << std::endl;
+        if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+        return false;
+    }
+    context = eglContext;
+
+    /*
+     * A GLEW built for GLX loads the OpenGL entry points first and only then looks for a GLX display,
+     * which an EGL context doesn't have; the entry points are all we need.
+     */
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (status == GLEW_ERROR_NO_GLX_DISPLAY) status = GLEW_OK;
+#endif
+    if (status != GLEW_OK)
+    {
+        std::cout << "Failed to initialize GLEW." << std::endl;
+        return false;
+    }
+
+    std::cout << "Rendering headless on " << glGetString(GL_RENDERER) << " (EGL " << major << "." << minor << ")." << std::endl;
+    return true;
+#else
+    std::cout << "Headless rendering needs EGL, which this platform doesn't have." << std::endl;
+    return false;
+#endif
+}
+
+bool HeadlessContext::createFramebuffer()
+{
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Failed to create a " << width << "x" << height << " framebuffer." << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        framebuffer = colorBuffer = depthBuffer = 0;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef __LearnOpenGL__HeadlessContext__
+#define __LearnOpenGL__HeadlessContext__
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * An OpenGL 3.3 core context without a window, for machines without a display or a GPU (Mesa's
+ * llvmpipe renders on the CPU). The context comes from EGL on Mesa's surfaceless platform, so there is
+ * no default framebuffer: everything is drawn into a framebuffer object of the requested size, which is
+ * bound when the context is created and which writeFrame() reads back.
+ *
+ * EGL is only there on Linux; elsewhere the context is never valid.
+ */
+class HeadlessContext
+{
+
+public:
+
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+    bool isValid() const { return framebuffer != 0; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    void finishFrame() const;
+    bool writeFrame(const std::string &path);
+
+private:
+
+    int width;
+    int height;
+    void *display;                                                  // EGLDisplay and EGLContext, kept out of the header
+    void *context;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    std::vector<unsigned char> pixels;                              // Read back by writeFrame(), reused from frame to frame
+    std::vector<unsigned char> flippedPixels;
+
+    bool createContext();
+    bool createFramebuffer();
+
+};
+
+#endif
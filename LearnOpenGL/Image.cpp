@@ -1,26 +1,73 @@
 #include "Image.h"
+#include <algorithm>
+#include <cstring>
+#include "GlState.h"
+#include "Profiler.h"
 
 // ===============================
 // Public member functions
 // ===============================
 
-Image::Image()
+Image::Image(bool retainPixels) : width(0), height(0), pixelData(nullptr), compressed(false), gpuBytes(0), textureID(0), retainPixelData(retainPixels)
 {
     
 }
 
 void Image::loadImage(const std::string &imagePath, int imageWidth, int imageHeight)
 {
+    ProfileScope zone("Texture load");
     width = imageWidth;
     height = imageHeight;
+    decode(imagePath);
+    upload();
+}
+
+/*
+ * Decoding only touches CPU memory, so unlike upload() it doesn't need a GL context and
+ * can safely run on a worker thread (see TextureLoader). KTX files made by TextureTool
+ * already hold block compressed data and a complete mip chain, so they're just read in.
+ */
+bool Image::decode(const std::string &imagePath)
+{
+    ProfileScope zone("Texture decode");
+    const std::string extension = ".ktx";
+    if (imagePath.size() >= extension.size() && imagePath.compare(imagePath.size() - extension.size(), extension.size(), extension) == 0)
+    {
+        std::shared_ptr<CompressedTexture> texture(new CompressedTexture());
+        if (!readKTX(imagePath, *texture)) return false;
+        compressedData = texture;
+        compressed = true;
+        width = texture->width;
+        height = texture->height;
+        return true;
+    }
+    
     pixelData = SOIL_load_image(imagePath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+    return pixelData != nullptr;
+}
+
+void Image::upload()
+{
+    ProfileScope zone("Texture upload");
+    createTexture();
     
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);            // Subsequent commands will affect this texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (compressedData)
+    {
+        // The blocks go straight to the GPU as they are, and we don't have to generate any mipmaps
+        gpuBytes = 0;
+        for (size_t level = 0; level < compressedData->levels.size(); ++level)
+        {
+            const std::vector<uint8_t> &blocks = compressedData->levels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), compressedData->internalFormat, std::max(1, width >> level), std::max(1, height >> level),
+                                   0, static_cast<GLsizei>(blocks.size()), blocks.data());
+            gpuBytes += blocks.size();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressedData->levels.size()) - 1);
+        
+        if (!retainPixelData) clearPixelData();
+        GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
     
     /*
      * The parameters of glTexImage2D are as follows:
@@ -35,17 +82,106 @@ void Image::loadImage(const std::string &imagePath, int imageWidth, int imageHei
      */
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixelData);
     glGenerateMipmap(GL_TEXTURE_2D);                    // Ask OpenGL to generate mipmaps for us
+    gpuBytes = static_cast<size_t>(width) * height * 3 * 4 / 3;
+    
+    if (!retainPixelData) clearPixelData();             // The GPU has its own copy now
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);    // Unbind the texture object (best practice)
+}
+
+/*
+ * Copies of an Image share its texture and pixels, so this must only be called by whoever owns
+ * them, e.g. the TextureCache once the last handle is gone.
+ */
+void Image::release()
+{
+    GlState::getInstance().deleteTexture(textureID);
+    textureID = 0;
+    clearPixelData();
+}
+
+// How many bytes of decoded data (pixels or compressed blocks) there are to upload
+size_t Image::getDataSize() const
+{
+    if (!compressedData) return pixelData ? static_cast<size_t>(width) * height * 3 : 0;
+    
+    size_t size = 0;
+    for (const auto &level: compressedData->levels)
+        size += level.size();
+    return size;
+}
+
+// Copies the decoded data into destination (e.g. a mapped buffer), compressed levels back to back
+void Image::copyData(void *destination) const
+{
+    if (!compressedData)
+    {
+        if (pixelData) std::memcpy(destination, pixelData, getDataSize());
+        return;
+    }
+    
+    unsigned char *out = static_cast<unsigned char*>(destination);
+    for (const auto &level: compressedData->levels)
+    {
+        std::memcpy(out, level.data(), level.size());
+        out += level.size();
+    }
+}
+
+/*
+ * Like upload(), except that the data is taken from the currently bound GL_PIXEL_UNPACK_BUFFER at the
+ * given offset, where copyData() has put it. Returns without waiting for OpenGL to read it.
+ */
+void Image::uploadFromBuffer(GLintptr offset)
+{
+    createTexture();
+    
+    if (compressedData)
+    {
+        gpuBytes = 0;
+        for (size_t level = 0; level < compressedData->levels.size(); ++level)
+        {
+            GLsizei size = static_cast<GLsizei>(compressedData->levels[level].size());
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), compressedData->internalFormat, std::max(1, width >> level), std::max(1, height >> level),
+                                   0, size, (const GLvoid*)(offset + gpuBytes));
+            gpuBytes += size;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressedData->levels.size()) - 1);
+    }
+    else
+    {
+        // With a buffer bound, the pointer is read as an offset into it
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, (const GLvoid*)offset);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        gpuBytes = static_cast<size_t>(width) * height * 3 * 4 / 3;
+    }
     
-    //SOIL_free_image_data(pixelData);                  // We'd generally want this here...
-    glBindTexture(GL_TEXTURE_2D, 0);                    // Unbind the texture object (best practice)
+    if (!retainPixelData) clearPixelData();
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);
 }
 
 void Image::bind() const
 {
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, textureID);
 }
 
 void Image::unbind() const
 {
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
\ No newline at end of file
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+// Generates and binds a new texture object with our usual sampling parameters
+void Image::createTexture()
+{
+    glGenTextures(1, &textureID);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, textureID);    // Subsequent commands will affect this texture
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
@@ -1,31 +1,49 @@
 #ifndef __LearnOpenGL__image__
 #define __LearnOpenGL__image__
 
+#include <memory>
 #include <string>
 #include <GL/glew.h>
 #include <SOIL/SOIL.h>
+#include "TextureCompression.h"
 
 class Image
 {
     
 public:
     
-    Image();
+    explicit Image(bool retainPixels = false);
     void loadImage(const std::string &imagePath, int imageWidth, int imageHeight);
+    bool decode(const std::string &imagePath);
+    void upload();
+    void uploadFromBuffer(GLintptr offset);
+    size_t getDataSize() const;
+    void copyData(void *destination) const;
     void bind() const;
     void unbind() const;
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     unsigned char* getPixelData() const { return pixelData; }
-    void clearPixelData() { if (pixelData) SOIL_free_image_data(pixelData); }
+    void clearPixelData() { if (pixelData) SOIL_free_image_data(pixelData); pixelData = nullptr; compressedData.reset(); }
+    bool isDecoded() const { return pixelData || compressedData; }
+    bool isCompressed() const { return compressed; }
+    size_t getGPUBytes() const { return gpuBytes; }
+    void release();
     GLuint getTextureRef() const { return textureID; }
+    bool retainsPixelData() const { return retainPixelData; }
     
 private:
     
+    void createTexture();
+    
     int width;
     int height;
     unsigned char* pixelData;
+    std::shared_ptr<CompressedTexture> compressedData;      // Instead of pixelData for .ktx files
+    bool compressed;
+    size_t gpuBytes;
     GLuint textureID;
+    bool retainPixelData;                                   // Keep the pixels after upload() for CPU readback
     
 };
 
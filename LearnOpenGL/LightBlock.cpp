@@ -0,0 +1,146 @@
+#include "LightBlock.h"
+
+#include <cstring>
+#include <iostream>
+#include "GlState.h"
+
+// ===============================
+// Public member functions
+// ===============================
+
+LightBlock::LightBlock() : data(), uboID(0), dirtyRegions(REGION_POINT_LIGHTS + MAX_POINT_LIGHTS, true)
+{
+    
+}
+
+LightBlock::~LightBlock()
+{
+    GlState::getInstance().deleteBuffer(uboID);
+}
+
+void LightBlock::setup()
+{
+    GlState &state = GlState::getInstance();
+    glGenBuffers(1, &uboID);
+    state.bindBuffer(GL_UNIFORM_BUFFER, uboID);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), &data, GL_DYNAMIC_DRAW);
+
+    // Attach the whole buffer to the shared binding point: any program bound with bindProgram() now sees it
+    state.bindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, uboID);
+    dirtyRegions.assign(dirtyRegions.size(), false);
+}
+
+/*
+ * Neighbouring dirty regions are merged so that, e.g., moving every point light at once
+ * still costs a single glBufferSubData call.
+ */
+void LightBlock::upload()
+{
+    if (!uboID) return;
+    
+    GlState::getInstance().bindBuffer(GL_UNIFORM_BUFFER, uboID);
+    int numRegions = static_cast<int>(dirtyRegions.size());
+    for (int first = 0; first < numRegions; ++first)
+    {
+        if (!dirtyRegions[first]) continue;
+
+        int last = first;
+        while (last + 1 < numRegions && dirtyRegions[last + 1])
+            ++last;
+
+        size_t offset = getRegionOffset(first);
+        size_t size = getRegionOffset(last) + getRegionSize(last) - offset;
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, reinterpret_cast<const unsigned char*>(&data) + offset);
+
+        for (int region = first; region <= last; ++region)
+            dirtyRegions[region] = false;
+        first = last;
+    }
+}
+
+void LightBlock::bindProgram(GlslProgram &program) const
+{
+    program.bindUniformBlock("LightBlock", LIGHT_BLOCK_BINDING);
+}
+
+void LightBlock::setDirLight(const DirLightData &light)
+{
+    update(REGION_DIR_LIGHT, &data.dirLight, &light, sizeof(light));
+}
+
+void LightBlock::setSpotLight(const SpotLightData &light)
+{
+    update(REGION_SPOT_LIGHT, &data.spotLight, &light, sizeof(light));
+}
+
+void LightBlock::setPointLight(int index, const PointLightData &light)
+{
+    if (index < 0 || index >= MAX_POINT_LIGHTS)
+    {
+        std::cerr << "Point light index " << index << " is out of range (max " << MAX_POINT_LIGHTS << ")." << std::endl;
+        return;
+    }
+    update(REGION_POINT_LIGHTS + index, &data.pointLights[index], &light, sizeof(light));
+}
+
+int LightBlock::addPointLight(const PointLightData &light)
+{
+    int index = data.numPointLights;
+    if (index >= MAX_POINT_LIGHTS)
+    {
+        std::cerr << "Cannot add more than " << MAX_POINT_LIGHTS << " point lights." << std::endl;
+        return -1;
+    }
+    setNumPointLights(index + 1);
+    setPointLight(index, light);
+    return index;
+}
+
+void LightBlock::setNumPointLights(int count)
+{
+    if (count < 0) count = 0;
+    if (count > MAX_POINT_LIGHTS) count = MAX_POINT_LIGHTS;
+    GLint numPointLights = count;
+    update(REGION_HEADER, &data.numPointLights, &numPointLights, sizeof(numPointLights));
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+void LightBlock::update(int region, void *dest, const void *src, size_t size)
+{
+    if (std::memcmp(dest, src, size) == 0) return;
+    std::memcpy(dest, src, size);
+    dirtyRegions[region] = true;
+}
+
+size_t LightBlock::getRegionOffset(int region) const
+{
+    switch (region)
+    {
+        case REGION_HEADER:
+            return 0;
+        case REGION_DIR_LIGHT:
+            return offsetof(LightBlockData, dirLight);
+        case REGION_SPOT_LIGHT:
+            return offsetof(LightBlockData, spotLight);
+        default:
+            return offsetof(LightBlockData, pointLights) + (region - REGION_POINT_LIGHTS) * sizeof(PointLightData);
+    }
+}
+
+size_t LightBlock::getRegionSize(int region) const
+{
+    switch (region)
+    {
+        case REGION_HEADER:
+            return offsetof(LightBlockData, dirLight);
+        case REGION_DIR_LIGHT:
+            return sizeof(DirLightData);
+        case REGION_SPOT_LIGHT:
+            return sizeof(SpotLightData);
+        default:
+            return sizeof(PointLightData);
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef __LearnOpenGL__LightBlock__
+#define __LearnOpenGL__LightBlock__
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "GlslProgram.h"
+
+// The uniform buffer binding point that every program's LightBlock is attached to
+static const GLuint LIGHT_BLOCK_BINDING = 0;
+
+// Must match MAX_POINT_LIGHTS in shaders/multilight.frag
+static const int MAX_POINT_LIGHTS = 64;
+
+/*
+ * These structs mirror the std140 layout of the LightBlock uniform block in shaders/multilight.frag.
+ * Under std140 a vec3 is aligned to 16 bytes, so the GLSL structs interleave their vec3s with a float
+ * wherever possible and the padding members below fill in the remaining gaps. The static_asserts at
+ * the bottom of this file will catch any drift between the two.
+ */
+struct DirLightData
+{
+    glm::vec3 direction;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+
+struct PointLightData
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float padding;
+};
+
+struct SpotLightData
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutoff;
+    glm::vec3 specular;
+    float outerCutoff;
+};
+
+struct LightBlockData
+{
+    GLint numPointLights;
+    GLint padding[3];
+    DirLightData dirLight;
+    SpotLightData spotLight;
+    PointLightData pointLights[MAX_POINT_LIGHTS];
+};
+
+static_assert(sizeof(DirLightData) == 64, "DirLightData must match the std140 layout of DirLight");
+static_assert(sizeof(PointLightData) == 64, "PointLightData must match the std140 layout of PointLight");
+static_assert(sizeof(SpotLightData) == 80, "SpotLightData must match the std140 layout of SpotLight");
+static_assert(offsetof(LightBlockData, dirLight) == 16, "LightBlockData must match the std140 layout of LightBlock");
+static_assert(offsetof(LightBlockData, spotLight) == 80, "LightBlockData must match the std140 layout of LightBlock");
+static_assert(offsetof(LightBlockData, pointLights) == 160, "LightBlockData must match the std140 layout of LightBlock");
+
+/*
+ * A CPU-side copy of the scene's lights, backed by a single uniform buffer that every program shares
+ * through LIGHT_BLOCK_BINDING. Setters only mark a light as dirty when its data actually changes, and
+ * upload() sends just the dirty byte ranges to the GPU.
+ */
+class LightBlock
+{
+
+public:
+
+    LightBlock();
+    ~LightBlock();
+    LightBlock(const LightBlock &) = delete;
+    LightBlock &operator=(const LightBlock &) = delete;
+
+    void setup();
+    void upload();
+    void bindProgram(GlslProgram &program) const;
+
+    void setDirLight(const DirLightData &light);
+    void setSpotLight(const SpotLightData &light);
+    void setPointLight(int index, const PointLightData &light);
+    int addPointLight(const PointLightData &light);
+    void setNumPointLights(int count);
+
+    const DirLightData &getDirLight() const { return data.dirLight; }
+    const SpotLightData &getSpotLight() const { return data.spotLight; }
+    const PointLightData &getPointLight(int index) const { return data.pointLights[index]; }
+    int getNumPointLights() const { return data.numPointLights; }
+
+private:
+
+    // Dirty regions: the header, the directional light, the spotlight, then one per point light
+    enum Region
+    {
+        REGION_HEADER,
+        REGION_DIR_LIGHT,
+        REGION_SPOT_LIGHT,
+        REGION_POINT_LIGHTS
+    };
+
+    LightBlockData data;
+    GLuint uboID;
+    std::vector<bool> dirtyRegions;
+
+    void update(int region, void *dest, const void *src, size_t size);
+    size_t getRegionOffset(int region) const;
+    size_t getRegionSize(int region) const;
+
+};
+
+#endif
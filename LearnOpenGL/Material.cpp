@@ -0,0 +1,73 @@
+#include "Material.h"
+#include "GlState.h"
+
+#include <sstream>
+
+// ===============================
+// Public member functions
+// ===============================
+
+/*
+ * Units count from 1, as they always have for mesh textures: unit 0 is left to textures the caller binds
+ * itself. Each texture type is numbered on its own, so a mesh with a diffuse and a specular map binds
+ * material.texture_diffuse0 and material.texture_specular0.
+ */
+Material::Material(GlslProgram &program, const std::vector<Texture> &textures, float shininess) :
+                   program(&program), shininess(shininess), linkCount(0)
+{
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        size_t number = 0;
+        for (size_t j = 0; j < i; ++j)
+            if (textures[j].type == textures[i].type) ++number;
+        std::stringstream ss;
+        ss << number;
+        std::string name = "material." + textures[i].type + ss.str();
+        
+        // Programs that don't light anything (e.g. the lamps') sample none of the textures, and have no shininess
+        if (!program.hasUniform(name)) continue;
+        MaterialSampler sampler;
+        sampler.img = textures[i].img;
+        sampler.unit = static_cast<GLint>(i + 1);
+        sampler.uniform = program.getUniform(name);
+        samplers.push_back(sampler);
+    }
+    if (program.hasUniform("material.shininess"))
+        shininessUniform = program.getUniform("material.shininess");
+}
+
+/*
+ * Expects the program to be in use. Sampler uniforms keep their values until the program is linked
+ * again (see GlslProgram::reload()), so they're only set the first time and after a reload.
+ */
+void Material::bind() const
+{
+    if (linkCount != program->getLinkCount())
+    {
+        for (const auto &sampler: samplers)
+            program->set(sampler.uniform, sampler.unit);
+        linkCount = program->getLinkCount();
+    }
+
+    GlState &state = GlState::getInstance();
+    for (const auto &sampler: samplers)
+    {
+        state.activeTexture(GL_TEXTURE0 + sampler.unit);
+        sampler.img->bind();
+    }
+    program->set(shininessUniform, shininess);
+}
+
+/*
+ * Looks up the material resolved for program in a list with one per program, such as a mesh keeps for
+ * the programs it's drawn with, and resolves it from textures and shininess the first time program comes along.
+ */
+const Material &Material::find(std::vector<Material> &materials, GlslProgram &program, const std::vector<Texture> &textures, float shininess)
+{
+    for (const auto &material: materials)
+    {
+        if (material.program == &program) return material;
+    }
+    materials.push_back(Material(program, textures, shininess));
+    return materials.back();
+}
@@ -0,0 +1,56 @@
+#ifndef __LearnOpenGL__Material__
+#define __LearnOpenGL__Material__
+
+#include <string>
+#include <vector>
+#include <scene.h>
+#include "TextureCache.h"
+#include "GlslProgram.h"
+
+static const float MATERIAL_DEFAULT_SHININESS = 32.0f;
+
+struct Texture
+{
+    TextureHandle img;                                              // Shared with every other mesh that uses the same file
+    std::string type;
+    aiString path;
+};
+
+// One of a material's textures, with the unit it's bound to and the sampler that reads it
+struct MaterialSampler
+{
+    TextureHandle img;
+    GLint unit;
+    UniformHandle uniform;
+};
+
+/*
+ * A set of textures, plus the scalar parameters that go with them, resolved against one program. The
+ * sampler names ("material." + type + index) are built and looked up once, when the material is created;
+ * each texture gets a fixed unit, and the samplers are pointed at their units whenever the program has
+ * been (re)linked since the last bind. Binding the material is then just the texture binds and the
+ * scalar uniforms: no strings, no lookups and no allocations.
+ */
+class Material
+{
+
+public:
+
+    Material(GlslProgram &program, const std::vector<Texture> &textures, float shininess = MATERIAL_DEFAULT_SHININESS);
+    void bind() const;
+    const GlslProgram *getProgram() const { return program; }
+    float getShininess() const { return shininess; }
+
+    static const Material &find(std::vector<Material> &materials, GlslProgram &program, const std::vector<Texture> &textures, float shininess);
+
+private:
+
+    GlslProgram *program;
+    std::vector<MaterialSampler> samplers;
+    UniformHandle shininessUniform;
+    float shininess;
+    mutable unsigned int linkCount;                                 // The program's link count when we last set the sampler units
+
+};
+
+#endif
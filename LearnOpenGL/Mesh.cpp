@@ -1,69 +1,329 @@
 #include "Mesh.h"
+#include "Transform.h"
+#include "GlState.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
 
 // ===============================
 // Public member functions
 // ===============================
 
-Mesh::Mesh(const std::vector<Vertex> &meshVertices, const std::vector<GLuint> &meshIndices, const std::vector<Texture> &meshTextures) : vertices(meshVertices), indices(meshIndices), textures(meshTextures)
+/*
+ * Meshes that belong to a Model are created with createBuffers set to false: the Model packs all of
+ * them into one set of buffers instead and hands each mesh its range through setArenaRange().
+ */
+Mesh::Mesh(const std::vector<Vertex> &meshVertices, const std::vector<GLuint> &meshIndices, const std::vector<Texture> &meshTextures, float meshShininess, bool createBuffers) :
+            vertices(meshVertices), indices(meshIndices), textures(meshTextures), shininess(meshShininess), VAO(0), VBO(0), EBO(0),
+            vertexCount(static_cast<GLsizei>(meshVertices.size())), indexCount(static_cast<GLsizei>(meshIndices.size())), baseVertex(0), firstIndex(0), indexType(GL_UNSIGNED_INT),
+            instanceVBO(0), instanceCapacity(0)
 {
-    setupMesh();
+    MeshLOD full = { 0, indexCount, 0.0f };
+    lods.push_back(full);
+    
+    computeBounds();
+    if (createBuffers) setupMesh();
 }
 
+// The VAO is left bound: GlState skips binding it again for the next draw of this mesh (or Model)
 void Mesh::draw(GlslProgram &program) const
 {
-    GLuint id = 0;
-    for (const auto &tex: textures)
+    GlState::getInstance().bindVertexArray(VAO);
+    drawSubmesh(program);
+}
+
+// Like draw(), but expects the caller to have bound the VAO, so a Model can draw all of its meshes with one bind
+void Mesh::drawSubmesh(GlslProgram &program, size_t lod) const
+{
+    bindTextures(program);
+    drawElements(lod);
+}
+
+// Just the draw call: the VAO, the program and the textures are all up to the caller (e.g. a RenderQueue)
+void Mesh::drawElements(size_t lod) const
+{
+    glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, getIndexOffset(lods[lod].firstIndex), baseVertex);
+}
+
+/*
+ * Draws one copy of the mesh per model matrix with a single draw call. The matrices (and the normal
+ * matrices we derive from them here) are streamed into a per-mesh instance buffer whose attributes
+ * advance once per instance rather than once per vertex, so the vertex shader has to read them from
+ * INSTANCE_MODEL_ATTRIBUTE and INSTANCE_NORMAL_ATTRIBUTE (see shaders/lighting_instanced.vert)
+ * instead of from uniforms.
+ */
+void Mesh::drawInstanced(GlslProgram &program, const std::vector<glm::mat4> &modelMatrices) const
+{
+    if (modelMatrices.empty()) return;
+    bindTextures(program);
+    drawInstancedElements(modelMatrices);
+}
+
+// drawInstanced() without binding the textures
+void Mesh::drawInstancedElements(const std::vector<glm::mat4> &modelMatrices) const
+{
+    if (modelMatrices.empty()) return;
+    if (!instanceVBO) setupInstancing();
+    
+    instanceData.resize(modelMatrices.size());
+    for (size_t i = 0; i < modelMatrices.size(); ++i)
+    {
+        instanceData[i].model = modelMatrices[i];
+        instanceData[i].normalMatrix = computeNormalMatrix(modelMatrices[i]);
+    }
+    
+    GlState &state = GlState::getInstance();
+    state.bindVertexArray(VAO);
+    state.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    bindInstanceAttributes();
+    
+    GLsizeiptr size = instanceData.size() * sizeof(InstanceData);
+    if (size > instanceCapacity)
     {
-        std::stringstream ss;
-        ss << id++;
-        program.setUniformSampler2D("material." + tex.type + ss.str(), tex.img, id);
+        glBufferData(GL_ARRAY_BUFFER, size, &instanceData[0], GL_STREAM_DRAW);
+        instanceCapacity = size;
     }
-    glActiveTexture(GL_TEXTURE0);
+    else
+    {
+        // Orphan the old storage first so we don't have to wait for the GPU to finish reading it
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, &instanceData[0]);
+    }
+    
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, getIndexOffset(), static_cast<GLsizei>(modelMatrices.size()), baseVertex);
+}
+
+void Mesh::setArenaRange(GLuint arenaVAO, GLint arenaBaseVertex, GLuint arenaFirstIndex, GLenum arenaIndexType)
+{
+    VAO = arenaVAO;
+    baseVertex = arenaBaseVertex;
+    firstIndex = arenaFirstIndex;
+    indexType = arenaIndexType;
+}
+
+// Once the vertices and indices are on the GPU we only ever need their counts and the mesh's bounds
+void Mesh::releaseCPUData()
+{
+    std::vector<Vertex>().swap(vertices);
+    std::vector<GLuint>().swap(indices);
+    std::vector<GLuint>().swap(lodIndexData);
+}
+
+/*
+ * Replaces the simplified levels of detail. Each LOD's firstIndex counts from the start of the mesh's
+ * own indices, i.e. lodIndices is expected to end up directly after them in the index buffer; only
+ * meshes drawn from a Model's arena can use them.
+ */
+void Mesh::setLODs(const std::vector<GLuint> &lodIndices, const std::vector<MeshLOD> &meshLODs)
+{
+    lodIndexData = lodIndices;
+    lods.resize(1);
+    lods.insert(lods.end(), meshLODs.begin(), meshLODs.end());
+}
+
+/*
+ * Picks the coarsest LOD whose error, once projected onto the screen, stays within maxPixelError.
+ * pixelsPerUnit is how many pixels one object space unit covers at the object's distance.
+ */
+size_t Mesh::selectLOD(float pixelsPerUnit, float maxPixelError) const
+{
+    size_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= maxPixelError)
+        ++lod;
+    return lod;
+}
+
+/*
+ * Structs have a great property in C++ that their memory layout is sequential.
+ * Thanks to this useful property we can directly pass a pointer to a large list
+ * of Vertex structs as the buffer's data and they translate perfectly to what
+ * glBufferData expects as its argument. Describes that layout to the currently
+ * bound VAO, reading from the currently bound GL_ARRAY_BUFFER.
+ *
+ * The compact layout feeds the same three attributes. OpenGL converts each one back to
+ * floats as it's fetched, so the shaders don't need to know which layout they're reading.
+ */
+void Mesh::setupVertexAttributes(VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_COMPACT)
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, position));
+        
+        // Packed 2_10_10_10 formats always have four components; the shader simply ignores w
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, normal));
+        
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, texCoord));
+        return;
+    }
+    
+    // Vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+   
+    // Vertex Normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+    
+    // Vertex Texture Coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoord));
+}
+
+/*
+ * Fills visibleMatrices with the model matrices whose instance of this mesh could be on screen, ready
+ * to be handed to drawInstanced().
+ */
+void Mesh::cullInstances(const Frustum &frustum, const std::vector<glm::mat4> &modelMatrices, std::vector<glm::mat4> &visibleMatrices, CullStats &stats) const
+{
+    instanceSpheres.resize(modelMatrices.size());
+    for (size_t i = 0; i < modelMatrices.size(); ++i)
+        instanceSpheres[i] = transformBoundingSphere(boundingSphere, modelMatrices[i]);
+    
+    visibleInstances.clear();
+    frustum.cullSpheres(instanceSpheres.empty() ? nullptr : &instanceSpheres[0], instanceSpheres.size(), visibleInstances, &stats);
+    
+    visibleMatrices.clear();
+    for (size_t index: visibleInstances)
+        visibleMatrices.push_back(modelMatrices[index]);
+}
+
+/*
+ * Draws instanceCount copies of the mesh at random places, first with one draw call (and three matrix
+ * uniforms) per copy through program, which has to read them the way shaders/lighting.vert does, then
+ * with a single instanced call through instancedProgram (see shaders/lighting_instanced.vert). Submit
+ * is how long the CPU takes to issue the calls; total also waits for the GPU to finish drawing. Needs
+ * the GL context, and leaves whatever it drew in the framebuffer.
+ */
+void Mesh::benchmarkInstancing(std::ostream &stream, GlslProgram &program, GlslProgram &instancedProgram, const glm::mat4 &viewProjection, size_t instanceCount) const
+{
+    static const int RUNS = 5;
+    typedef std::chrono::high_resolution_clock Clock;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+    
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> pickCoordinate(-50.0f, 50.0f);
+    std::vector<glm::mat4> modelMatrices(instanceCount);
+    for (auto &model: modelMatrices)
+        model = glm::translate(glm::mat4(), glm::vec3(pickCoordinate(random), pickCoordinate(random), pickCoordinate(random) - 60.0f));
     
-    // Draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    UniformHandle modelUniform = program.getUniform("uModel");
+    UniformHandle modelViewProjectionUniform = program.getUniform("uModelViewProjection");
+    UniformHandle normalMatrixUniform = program.getUniform("uNormalMatrix");
+    UniformHandle viewProjectionUniform = instancedProgram.getUniform("uViewProjection");
+    GlState &state = GlState::getInstance();
     
-    // Unbind the VAO
-    glBindVertexArray(0);
+    double submitMs[2] = { 1e30, 1e30 };
+    double totalMs[2] = { 1e30, 1e30 };
+    for (int run = 0; run < RUNS; ++run)
+    {
+        for (int instanced = 0; instanced < 2; ++instanced)
+        {
+            glFinish();
+            auto startTime = Clock::now();
+            if (instanced)
+            {
+                instancedProgram.begin();
+                instancedProgram.set(viewProjectionUniform, viewProjection);
+                drawInstanced(instancedProgram, modelMatrices);
+            }
+            else
+            {
+                program.begin();
+                state.bindVertexArray(VAO);
+                bindTextures(program);
+                for (const auto &model: modelMatrices)
+                {
+                    program.set(modelUniform, model);
+                    program.set(modelViewProjectionUniform, viewProjection * model);
+                    program.set(normalMatrixUniform, computeNormalMatrix(model));
+                    drawElements();
+                }
+            }
+            Milliseconds submitted = Clock::now() - startTime;
+            glFinish();
+            Milliseconds finished = Clock::now() - startTime;
+            submitMs[instanced] = std::min(submitMs[instanced], submitted.count());
+            totalMs[instanced] = std::min(totalMs[instanced], finished.count());
+        }
+    }
+    
+    stream << "Instancing: " << instanceCount << " copies of a " << indexCount / 3 << " triangle mesh (best of " << RUNS << ")" << std::endl;
+    stream << "  one draw per copy: " << instanceCount << " draw calls, submit " << submitMs[0] << " ms, total " << totalMs[0] << " ms" << std::endl;
+    stream << "  instanced:         1 draw call, submit " << submitMs[1] << " ms, total " << totalMs[1] << " ms" << std::endl;
 }
 
 // ===============================
 // Private member functions
 // ===============================
 
+void Mesh::computeBounds()
+{
+    const glm::vec3 *positions = vertices.empty() ? nullptr : &vertices[0].position;
+    aabb = computeAABB(positions, vertices.size(), sizeof(Vertex));
+    boundingSphere = computeBoundingSphere(aabb, positions, vertices.size(), sizeof(Vertex));
+}
+
 void Mesh::setupMesh()
 {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
     
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GlState &state = GlState::getInstance();
+    state.bindVertexArray(VAO);
+    state.bindBuffer(GL_ARRAY_BUFFER, VBO);
     
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
     
-    /*
-     * Structs have a great property in C++ that their memory layout is sequential.
-     * Thanks to this useful property we can directly pass a pointer to a large list 
-     * of Vertex structs as the buffer's data and they translate perfectly to what 
-     * glBufferData expects as its argument.
-     */
+    setupVertexAttributes();
     
-    // Vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-   
-    // Vertex Normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
-    
-    // Vertex Texture Coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoord));
-    
-    glBindVertexArray(0);
-}
\ No newline at end of file
+    // Unbind the VAO, so that nobody else's element array buffer binding ends up in it
+    state.bindVertexArray(0);
+}
+
+void Mesh::setupInstancing() const
+{
+    glGenBuffers(1, &instanceVBO);
+}
+
+/*
+ * A vertex attribute can be at most a vec4, so a mat4 takes up four consecutive locations
+ * and a mat3 three. glVertexAttribDivisor(location, 1) tells OpenGL to advance these
+ * attributes once per instance instead of once per vertex. The pointers are set on every
+ * instanced draw since meshes that share their Model's VAO each have their own instance
+ * buffer; expects the VAO and instanceVBO to be bound.
+ */
+void Mesh::bindInstanceAttributes() const
+{
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        GLuint location = INSTANCE_MODEL_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    for (GLuint column = 0; column < 3; ++column)
+    {
+        GLuint location = INSTANCE_NORMAL_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+const GLvoid *Mesh::getIndexOffset(GLuint offset) const
+{
+    return (GLvoid*)((firstIndex + offset) * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+}
+
+// The first draw with a program resolves the mesh's material for it; after that this only binds textures and sets the shininess
+void Mesh::bindTextures(GlslProgram &program) const
+{
+    Material::find(materials, program, textures, shininess).bind();
+}
@@ -1,7 +1,8 @@
 #ifndef __LearnOpenGL__Mesh__
 #define __LearnOpenGL__Mesh__
 
-#include <sstream>
+#include <cstdint>
+#include <iostream>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp>
@@ -10,8 +11,14 @@
 #include <Importer.hpp>
 #include <scene.h>
 #include <postprocess.h>
-#include "Image.h"
+#include "TextureCache.h"
 #include "GlslProgram.h"
+#include "Material.h"
+#include "Frustum.h"
+
+// Per-instance matrices occupy one attribute location per column
+static const GLuint INSTANCE_MODEL_ATTRIBUTE = 3;
+static const GLuint INSTANCE_NORMAL_ATTRIBUTE = 7;
 
 struct Vertex
 {
@@ -20,11 +27,40 @@ struct Vertex
     glm::vec2 texCoord;
 };
 
-struct Texture
+/*
+ * The layout selected with VERTEX_FORMAT_COMPACT: half the size of Vertex. See VertexCompression.h for
+ * how each attribute is encoded.
+ */
+struct CompactVertex
+{
+    uint16_t position[4];                                           // x, y, z and one unused value to keep the normal aligned
+    uint32_t normal;
+    uint16_t texCoord[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay tightly packed");
+
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_COMPACT
+};
+
+/*
+ * One level of detail: a range of the mesh's indices (relative to the start of its own index data) and
+ * its simplification error in object space units, as described by simplifyMesh().
+ */
+struct MeshLOD
+{
+    GLuint firstIndex;
+    GLsizei indexCount;
+    float error;
+};
+
+struct InstanceData
 {
-    Image img;
-    std::string type;
-    aiString path;
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
 };
 
 class Mesh
@@ -32,24 +68,73 @@ class Mesh
 
 public:
     
-    Mesh(const std::vector<Vertex> &meshVertices, const std::vector<GLuint> &meshIndices, const std::vector<Texture> &meshTextures);
+    Mesh(const std::vector<Vertex> &meshVertices, const std::vector<GLuint> &meshIndices, const std::vector<Texture> &meshTextures, float meshShininess, bool createBuffers = true);
     const std::vector<Vertex> &getVertices() const { return vertices; }
     const std::vector<GLuint> &getIndices() const { return indices; }
     const std::vector<Texture> &getTextures() const { return textures; }
+    float getShininess() const { return shininess; }
+    GLsizei getVertexCount() const { return vertexCount; }
+    GLsizei getIndexCount() const { return indexCount; }
+    GLint getBaseVertex() const { return baseVertex; }
+    GLuint getFirstIndex() const { return firstIndex; }
+    GLuint getVAO() const { return VAO; }
+    const AABB &getAABB() const { return aabb; }
+    const BoundingSphere &getBoundingSphere() const { return boundingSphere; }
     void draw(GlslProgram &program) const;
+    void drawSubmesh(GlslProgram &program, size_t lod = 0) const;
+    void drawInstanced(GlslProgram &program, const std::vector<glm::mat4> &modelMatrices) const;
+    void drawElements(size_t lod = 0) const;
+    void drawInstancedElements(const std::vector<glm::mat4> &modelMatrices) const;
+    void bindTextures(GlslProgram &program) const;
+    void setArenaRange(GLuint arenaVAO, GLint arenaBaseVertex, GLuint arenaFirstIndex, GLenum arenaIndexType);
+    void releaseCPUData();
+    void setLODs(const std::vector<GLuint> &lodIndices, const std::vector<MeshLOD> &meshLODs);
+    const std::vector<GLuint> &getLODIndices() const { return lodIndexData; }
+    size_t getLODCount() const { return lods.size(); }
+    const MeshLOD &getLOD(size_t lod) const { return lods[lod]; }
+    size_t selectLOD(float pixelsPerUnit, float maxPixelError) const;
+    void cullInstances(const Frustum &frustum, const std::vector<glm::mat4> &modelMatrices, std::vector<glm::mat4> &visibleMatrices, CullStats &stats) const;
+    void benchmarkInstancing(std::ostream &stream, GlslProgram &program, GlslProgram &instancedProgram, const glm::mat4 &viewProjection, size_t instanceCount = 10000) const;
+    
+    static void setupVertexAttributes(VertexFormat format = VERTEX_FORMAT_FLOAT);
     
 private:
     
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    float shininess;
+    mutable std::vector<Material> materials;                        // textures and shininess resolved for each program the mesh has been drawn with
+    
+    // LOD 0 is the full mesh; the others index into lodIndexData, which is uploaded right after indices
+    std::vector<MeshLOD> lods;
+    std::vector<GLuint> lodIndexData;
+    
+    // Object space bounds, computed once in the constructor
+    AABB aabb;
+    BoundingSphere boundingSphere;
     
-    // Render data
+    // Render data. When the mesh lives in its Model's shared arena, VBO and EBO stay 0 and VAO is the
+    // arena's; baseVertex and firstIndex then locate the mesh inside the arena's buffers.
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLenum indexType;
+    mutable GLuint instanceVBO;
+    mutable GLsizeiptr instanceCapacity;
+    mutable std::vector<InstanceData> instanceData;
+    mutable std::vector<BoundingSphere> instanceSpheres;
+    mutable std::vector<size_t> visibleInstances;
     
+    void computeBounds();
     void setupMesh();
+    void setupInstancing() const;
+    void bindInstanceAttributes() const;
+    const GLvoid *getIndexOffset(GLuint offset = 0) const;
 };
 
 #endif
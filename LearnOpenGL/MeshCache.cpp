@@ -0,0 +1,281 @@
+#include "MeshCache.h"
+#include "Hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MESH_CACHE_MAGIC[4] = { 'L', 'G', 'M', 'C' };
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Whether size bytes at offset fit in limit, written so that huge values from a corrupt file can't overflow
+static bool inBounds(uint64_t offset, uint64_t size, uint64_t limit)
+{
+    return offset <= limit && size <= limit - offset;
+}
+
+// ===============================
+// Public member functions
+// ===============================
+
+MeshCache::MeshCache() : mappedData(nullptr), mappedSize(0), header(nullptr), entries(nullptr), textureRefs(nullptr)
+{
+
+}
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+bool MeshCache::open(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags)
+{
+    close();
+
+    int fd = ::open(cachePath.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(MeshCacheHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                                                    // The mapping stays valid after the descriptor is closed
+    if (data == MAP_FAILED) return false;
+
+    mappedData = static_cast<unsigned char*>(data);
+    mappedSize = info.st_size;
+    header = reinterpret_cast<const MeshCacheHeader*>(mappedData);
+
+    // Anything that doesn't match exactly is treated as a stale cache and re-imported
+    if (std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header->version != VERSION ||
+        header->sourceHash != sourceHash ||
+        header->importFlags != importFlags ||
+        header->vertexSize != sizeof(Vertex) ||
+        header->fileSize != mappedSize)
+    {
+        close();
+        return false;
+    }
+
+    uint64_t tableEnd = sizeof(MeshCacheHeader) + header->meshCount * sizeof(MeshCacheEntry) + header->textureCount * sizeof(MeshCacheTextureRef);
+    if (tableEnd > mappedSize)
+    {
+        close();
+        return false;
+    }
+    entries = reinterpret_cast<const MeshCacheEntry*>(mappedData + sizeof(MeshCacheHeader));
+    textureRefs = reinterpret_cast<const MeshCacheTextureRef*>(entries + header->meshCount);
+
+    /*
+     * Everything the accessors below hand out points into the mapping, so a truncated or corrupt file
+     * has to be caught here: every blob and string has to lie entirely within the file, and every LOD
+     * within its mesh's index data.
+     */
+    for (uint32_t i = 0; i < header->meshCount; ++i)
+    {
+        const MeshCacheEntry &entry = entries[i];
+        if (!inBounds(entry.vertexOffset, uint64_t(entry.vertexCount) * sizeof(Vertex), mappedSize) ||
+            !inBounds(entry.indexOffset, uint64_t(entry.indexCount) * sizeof(GLuint), mappedSize) ||
+            !inBounds(entry.lodOffset, uint64_t(entry.lodCount) * sizeof(MeshLOD) + uint64_t(entry.lodIndexCount) * sizeof(GLuint), mappedSize) ||
+            !inBounds(entry.firstTexture, entry.textureCount, header->textureCount))
+        {
+            close();
+            return false;
+        }
+        const MeshLOD *lods = getLODs(i);
+        for (uint32_t lod = 0; lod < entry.lodCount; ++lod)
+        {
+            if (lods[lod].indexCount < 0 || !inBounds(lods[lod].firstIndex, lods[lod].indexCount, uint64_t(entry.indexCount) + entry.lodIndexCount))
+            {
+                close();
+                return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < header->textureCount; ++i)
+    {
+        const MeshCacheTextureRef &ref = textureRefs[i];
+        if (!inBounds(ref.typeOffset, ref.typeLength, mappedSize) || !inBounds(ref.pathOffset, ref.pathLength, mappedSize))
+        {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MeshCache::close()
+{
+    if (mappedData) munmap(mappedData, mappedSize);
+    mappedData = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    textureRefs = nullptr;
+}
+
+const Vertex* MeshCache::getVertices(uint32_t meshIndex) const
+{
+    return reinterpret_cast<const Vertex*>(mappedData + entries[meshIndex].vertexOffset);
+}
+
+const GLuint* MeshCache::getIndices(uint32_t meshIndex) const
+{
+    return reinterpret_cast<const GLuint*>(mappedData + entries[meshIndex].indexOffset);
+}
+
+// The simplified levels only: LOD 0, the full mesh, isn't stored
+const MeshLOD* MeshCache::getLODs(uint32_t meshIndex) const
+{
+    return reinterpret_cast<const MeshLOD*>(mappedData + entries[meshIndex].lodOffset);
+}
+
+const GLuint* MeshCache::getLODIndices(uint32_t meshIndex) const
+{
+    return reinterpret_cast<const GLuint*>(getLODs(meshIndex) + entries[meshIndex].lodCount);
+}
+
+std::string MeshCache::getTextureType(uint32_t textureIndex) const
+{
+    const MeshCacheTextureRef &ref = textureRefs[textureIndex];
+    return std::string(reinterpret_cast<const char*>(mappedData + ref.typeOffset), ref.typeLength);
+}
+
+std::string MeshCache::getTexturePath(uint32_t textureIndex) const
+{
+    const MeshCacheTextureRef &ref = textureRefs[textureIndex];
+    return std::string(reinterpret_cast<const char*>(mappedData + ref.pathOffset), ref.pathLength);
+}
+
+bool MeshCache::write(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags, const std::vector<Mesh> &meshes)
+{
+    MeshCacheHeader fileHeader;
+    std::memcpy(fileHeader.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    fileHeader.version = VERSION;
+    fileHeader.sourceHash = sourceHash;
+    fileHeader.importFlags = importFlags;
+    fileHeader.vertexSize = sizeof(Vertex);
+    fileHeader.meshCount = static_cast<uint32_t>(meshes.size());
+    fileHeader.textureCount = 0;
+    for (const auto &mesh: meshes)
+        fileHeader.textureCount += static_cast<uint32_t>(mesh.getTextures().size());
+
+    // Lay out the tables first so that we know where the string table and the blobs begin
+    std::vector<MeshCacheEntry> fileEntries(meshes.size());
+    std::vector<MeshCacheTextureRef> fileTextureRefs;
+    std::string stringTable;
+    uint64_t stringTableOffset = sizeof(MeshCacheHeader) + fileEntries.size() * sizeof(MeshCacheEntry) + fileHeader.textureCount * sizeof(MeshCacheTextureRef);
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        fileEntries[i].firstTexture = static_cast<uint32_t>(fileTextureRefs.size());
+        fileEntries[i].textureCount = static_cast<uint32_t>(meshes[i].getTextures().size());
+        fileEntries[i].shininess = meshes[i].getShininess();
+        for (const auto &tex: meshes[i].getTextures())
+        {
+            MeshCacheTextureRef ref;
+            ref.typeOffset = static_cast<uint32_t>(stringTableOffset + stringTable.size());
+            ref.typeLength = static_cast<uint32_t>(tex.type.size());
+            stringTable += tex.type;
+            ref.pathOffset = static_cast<uint32_t>(stringTableOffset + stringTable.size());
+            ref.pathLength = static_cast<uint32_t>(tex.path.length);
+            stringTable.append(tex.path.C_Str(), tex.path.length);
+            fileTextureRefs.push_back(ref);
+        }
+    }
+
+    uint64_t offset = stringTableOffset + stringTable.size();
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        fileEntries[i].vertexCount = static_cast<uint32_t>(meshes[i].getVertices().size());
+        fileEntries[i].indexCount = static_cast<uint32_t>(meshes[i].getIndices().size());
+        fileEntries[i].vertexOffset = offset = alignOffset(offset, BLOB_ALIGNMENT);
+        offset += fileEntries[i].vertexCount * sizeof(Vertex);
+        fileEntries[i].indexOffset = offset = alignOffset(offset, BLOB_ALIGNMENT);
+        offset += fileEntries[i].indexCount * sizeof(GLuint);
+        fileEntries[i].lodCount = static_cast<uint32_t>(meshes[i].getLODCount() - 1);
+        fileEntries[i].lodIndexCount = static_cast<uint32_t>(meshes[i].getLODIndices().size());
+        fileEntries[i].lodOffset = offset = alignOffset(offset, BLOB_ALIGNMENT);
+        offset += fileEntries[i].lodCount * sizeof(MeshLOD) + fileEntries[i].lodIndexCount * sizeof(GLuint);
+    }
+    fileHeader.fileSize = offset;
+
+    // Write to a temporary file and rename it into place, so a crash never leaves a torn cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        std::cerr << "Failed to open mesh cache for writing: " << cachePath << std::endl;
+        return false;
+    }
+
+    static const char padding[BLOB_ALIGNMENT] = {};
+    stream.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    stream.write(reinterpret_cast<const char*>(fileEntries.data()), fileEntries.size() * sizeof(MeshCacheEntry));
+    stream.write(reinterpret_cast<const char*>(fileTextureRefs.data()), fileTextureRefs.size() * sizeof(MeshCacheTextureRef));
+    stream.write(stringTable.data(), stringTable.size());
+
+    uint64_t written = stringTableOffset + stringTable.size();
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        stream.write(padding, fileEntries[i].vertexOffset - written);
+        stream.write(reinterpret_cast<const char*>(meshes[i].getVertices().data()), fileEntries[i].vertexCount * sizeof(Vertex));
+        written = fileEntries[i].vertexOffset + fileEntries[i].vertexCount * sizeof(Vertex);
+
+        stream.write(padding, fileEntries[i].indexOffset - written);
+        stream.write(reinterpret_cast<const char*>(meshes[i].getIndices().data()), fileEntries[i].indexCount * sizeof(GLuint));
+        written = fileEntries[i].indexOffset + fileEntries[i].indexCount * sizeof(GLuint);
+
+        stream.write(padding, fileEntries[i].lodOffset - written);
+        for (uint32_t lod = 1; lod <= fileEntries[i].lodCount; ++lod)
+            stream.write(reinterpret_cast<const char*>(&meshes[i].getLOD(lod)), sizeof(MeshLOD));
+        stream.write(reinterpret_cast<const char*>(meshes[i].getLODIndices().data()), fileEntries[i].lodIndexCount * sizeof(GLuint));
+        written = fileEntries[i].lodOffset + fileEntries[i].lodCount * sizeof(MeshLOD) + fileEntries[i].lodIndexCount * sizeof(GLuint);
+    }
+    stream.close();
+
+    if (!stream || std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::cerr << "Failed to write mesh cache: " << cachePath << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Not cryptographic, but more than good enough to notice that a source asset has been edited since its cache was written
+uint64_t MeshCache::hashSource(const std::string &sourcePath, uint32_t importFlags)
+{
+    uint64_t hash = fnv1a(&importFlags, sizeof(importFlags));
+
+    int fd = ::open(sourcePath.c_str(), O_RDONLY);
+    if (fd == -1) return hash;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            hash = fnv1a(data, info.st_size, hash);
+            munmap(data, info.st_size);
+        }
+    }
+    ::close(fd);
+    return hash;
+}
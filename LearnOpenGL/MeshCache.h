@@ -0,0 +1,98 @@
+#ifndef __LearnOpenGL__MeshCache__
+#define __LearnOpenGL__MeshCache__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "Mesh.h"
+
+/*
+ * A mesh cache file is laid out as follows (all offsets are in bytes from the start of the file):
+ * 1) A MeshCacheHeader
+ * 2) MeshCacheEntry[meshCount]
+ * 3) MeshCacheTextureRef[textureCount]
+ * 4) The string table that texture types and paths point into
+ * 5) Per-mesh vertex blobs (Vertex[vertexCount]), index blobs (GLuint[indexCount]) and LOD blobs
+ *    (MeshLOD[lodCount] for the simplified levels, followed by their GLuint[lodIndexCount] indices)
+ * Every blob starts on a 16-byte boundary, so once the file is mapped into memory the vertex and
+ * index data can be handed to std::vector or glBufferData without any further decoding.
+ */
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t importFlags;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint64_t fileSize;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t lodOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    uint32_t lodIndexCount;
+    float shininess;
+};
+
+struct MeshCacheTextureRef
+{
+    uint32_t typeOffset;
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+class MeshCache
+{
+
+public:
+
+    MeshCache();
+    ~MeshCache();
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    bool open(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags);
+    void close();
+    bool isOpen() const { return mappedData != nullptr; }
+    uint32_t getMeshCount() const { return header->meshCount; }
+    const MeshCacheEntry &getEntry(uint32_t meshIndex) const { return entries[meshIndex]; }
+    const Vertex *getVertices(uint32_t meshIndex) const;
+    const GLuint *getIndices(uint32_t meshIndex) const;
+    const MeshLOD *getLODs(uint32_t meshIndex) const;
+    const GLuint *getLODIndices(uint32_t meshIndex) const;
+    std::string getTextureType(uint32_t textureIndex) const;
+    std::string getTexturePath(uint32_t textureIndex) const;
+
+    static bool write(const std::string &cachePath, uint64_t sourceHash, uint32_t importFlags, const std::vector<Mesh> &meshes);
+    static uint64_t hashSource(const std::string &sourcePath, uint32_t importFlags);
+    static std::string getCachePath(const std::string &sourcePath) { return sourcePath + ".meshcache"; }
+
+private:
+
+    unsigned char *mappedData;
+    size_t mappedSize;
+    const MeshCacheHeader *header;
+    const MeshCacheEntry *entries;
+    const MeshCacheTextureRef *textureRefs;
+
+    // Version 2: meshes are stored after the import-time vertex cache optimization
+    // Version 3: meshes carry their simplified LODs, so loading from the cache skips simplification
+    // Version 4: meshes carry their material's shininess
+    // Version 5: a shininess of 0 (what Assimp reports for OBJ materials without one) is stored as the default
+    static const uint32_t VERSION = 5;
+    static const uint64_t BLOB_ALIGNMENT = 16;
+
+};
+
+#endif
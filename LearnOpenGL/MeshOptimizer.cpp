@@ -0,0 +1,280 @@
+#include "MeshOptimizer.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring parameters
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static const GLuint NO_VERTEX = 0xffffffff;
+
+// Hashes and compares vertices bit for bit, so welding only ever merges truly identical vertices
+struct VertexBitsHash
+{
+    size_t operator()(const Vertex &vertex) const
+    {
+        return static_cast<size_t>(fnv1a(&vertex, sizeof(Vertex)));
+    }
+};
+
+struct VertexBitsEqual
+{
+    bool operator()(const Vertex &a, const Vertex &b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+/*
+ * A vertex's score is higher the more recently it was used (the three vertices of the last triangle
+ * are deliberately scored a little lower, so we don't keep fanning around the same spot) and the
+ * fewer triangles still need it, which gets lonely vertices out of the way before they're evicted.
+ */
+static float scoreVertex(int cachePosition, GLuint remainingTriangles)
+{
+    if (remainingTriangles == 0) return -1.0f;
+    
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = LAST_TRIANGLE_SCORE;
+        else
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+// ===============================
+// Public functions
+// ===============================
+
+VertexCacheStats &VertexCacheStats::operator+=(const VertexCacheStats &other)
+{
+    triangles += other.triangles;
+    vertices += other.vertices;
+    misses += other.misses;
+    return *this;
+}
+
+void weldVertices(std::vector<Vertex> &vertices, std::vector<GLuint> &indices)
+{
+    std::unordered_map<Vertex, GLuint, VertexBitsHash, VertexBitsEqual> unique;
+    unique.reserve(vertices.size());
+    
+    std::vector<GLuint> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        auto inserted = unique.insert(std::make_pair(vertices[i], static_cast<GLuint>(welded.size())));
+        if (inserted.second) welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+    
+    for (auto &index: indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+/*
+ * Greedily emits triangles one at a time, always picking the one whose vertices score highest in a
+ * simulated LRU cache. Only the triangles that touch cached vertices need rescoring after each step,
+ * which keeps the whole pass linear in the number of triangles.
+ */
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+    
+    // Per vertex adjacency: the triangles that use each vertex, packed into one array
+    std::vector<GLuint> triangleOffsets(vertexCount + 1, 0);
+    for (GLuint index: indices)
+        ++triangleOffsets[index + 1];
+    for (size_t i = 0; i < vertexCount; ++i)
+        triangleOffsets[i + 1] += triangleOffsets[i];
+    
+    std::vector<GLuint> adjacentTriangles(indices.size());
+    std::vector<GLuint> remainingTriangles(vertexCount, 0);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            GLuint vertex = indices[triangle * 3 + corner];
+            adjacentTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]++] = static_cast<GLuint>(triangle);
+        }
+    }
+    
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        vertexScores[i] = scoreVertex(-1, remainingTriangles[i]);
+    
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+        triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+    
+    // Room for a full cache plus the three vertices about to be pushed in front of it
+    GLuint cache[FORSYTH_CACHE_SIZE + 3];
+    size_t cacheCount = 0;
+    
+    std::vector<GLuint> optimized;
+    optimized.reserve(indices.size());
+    size_t searchStart = 0;                                         // Everything before this has already been emitted
+    
+    GLuint bestTriangle = 0;
+    float bestScore = -1.0f;
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        if (triangleScores[triangle] > bestScore)
+        {
+            bestScore = triangleScores[triangle];
+            bestTriangle = static_cast<GLuint>(triangle);
+        }
+    }
+    
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        // The cache ran dry of candidates: fall back to the best remaining triangle anywhere
+        if (bestScore < 0.0f)
+        {
+            while (emitted[searchStart]) ++searchStart;
+            bestTriangle = static_cast<GLuint>(searchStart);
+            bestScore = triangleScores[searchStart];
+            for (size_t triangle = searchStart + 1; triangle < triangleCount; ++triangle)
+            {
+                if (!emitted[triangle] && triangleScores[triangle] > bestScore)
+                {
+                    bestScore = triangleScores[triangle];
+                    bestTriangle = static_cast<GLuint>(triangle);
+                }
+            }
+        }
+        
+        emitted[bestTriangle] = true;
+        
+        // Emit the triangle, push its vertices to the front of the cache and drop it from their adjacency
+        GLuint newCache[FORSYTH_CACHE_SIZE + 3];
+        size_t newCacheCount = 0;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            GLuint vertex = indices[bestTriangle * 3 + corner];
+            optimized.push_back(vertex);
+            newCache[newCacheCount++] = vertex;
+            
+            GLuint *begin = &adjacentTriangles[triangleOffsets[vertex]];
+            GLuint *end = begin + remainingTriangles[vertex];
+            *std::find(begin, end, bestTriangle) = *(end - 1);
+            --remainingTriangles[vertex];
+        }
+        for (size_t i = 0; i < cacheCount; ++i)
+        {
+            GLuint vertex = cache[i];
+            if (vertex != newCache[0] && vertex != newCache[1] && vertex != newCache[2])
+                newCache[newCacheCount++] = vertex;
+        }
+        
+        // Vertices pushed past the end fall out of the cache
+        for (size_t i = FORSYTH_CACHE_SIZE; i < newCacheCount; ++i)
+            cachePositions[newCache[i]] = -1;
+        cacheCount = std::min<size_t>(newCacheCount, FORSYTH_CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+        
+        // Rescore everything that was or still is cached, then every triangle that uses those vertices
+        for (size_t i = 0; i < newCacheCount; ++i)
+        {
+            GLuint vertex = newCache[i];
+            if (i < cacheCount) cachePositions[vertex] = static_cast<int>(i);
+            
+            float newScore = scoreVertex(cachePositions[vertex], remainingTriangles[vertex]);
+            float delta = newScore - vertexScores[vertex];
+            vertexScores[vertex] = newScore;
+            for (GLuint j = 0; j < remainingTriangles[vertex]; ++j)
+                triangleScores[adjacentTriangles[triangleOffsets[vertex] + j]] += delta;
+        }
+        
+        // The next triangle is almost always one that touches the cache
+        bestScore = -1.0f;
+        for (size_t i = 0; i < cacheCount; ++i)
+        {
+            GLuint vertex = cache[i];
+            for (GLuint j = 0; j < remainingTriangles[vertex]; ++j)
+            {
+                GLuint triangle = adjacentTriangles[triangleOffsets[vertex] + j];
+                if (triangleScores[triangle] > bestScore)
+                {
+                    bestScore = triangleScores[triangle];
+                    bestTriangle = triangle;
+                }
+            }
+        }
+    }
+    
+    indices.swap(optimized);
+}
+
+// Renumbers vertices in the order the index buffer first references them; unreferenced vertices are dropped
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<GLuint> &indices)
+{
+    std::vector<GLuint> remap(vertices.size(), NO_VERTEX);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    
+    for (auto &index: indices)
+    {
+        if (remap[index] == NO_VERTEX)
+        {
+            remap[index] = static_cast<GLuint>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<GLuint> &indices, VertexCacheStats *before, VertexCacheStats *after)
+{
+    if (before) *before += simulateVertexCache(indices, vertices.size());
+    
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    optimizeVertexFetch(vertices, indices);
+    
+    if (after) *after += simulateVertexCache(indices, vertices.size());
+}
+
+/*
+ * A FIFO cache, as opposed to the LRU the optimizer scores against: hits don't refresh a vertex's
+ * position, which is how the post-transform caches of most GPUs actually behave.
+ */
+VertexCacheStats simulateVertexCache(const std::vector<GLuint> &indices, size_t vertexCount, size_t cacheSize)
+{
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+    
+    // A vertex is still cached if no more than cacheSize misses (including its own) happened since it entered
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    for (GLuint index: indices)
+    {
+        if (!used[index])
+        {
+            used[index] = true;
+            ++stats.vertices;
+        }
+        else if (stats.misses - insertedAt[index] <= cacheSize)
+        {
+            continue;
+        }
+        insertedAt[index] = stats.misses++;
+    }
+    return stats;
+}
@@ -0,0 +1,41 @@
+#ifndef __LearnOpenGL__MeshOptimizer__
+#define __LearnOpenGL__MeshOptimizer__
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include "Mesh.h"
+
+// The FIFO size the statistics below are reported for, roughly what current GPUs behave like
+static const size_t VERTEX_CACHE_SIZE = 16;
+
+/*
+ * Results of running an index buffer through a simulated FIFO post-transform vertex cache. ACMR is the
+ * average number of vertices transformed per triangle (3 at worst, around 0.5 at best for large regular
+ * meshes); ATVR is the number transformed per unique vertex, which is 1 for a perfect ordering.
+ */
+struct VertexCacheStats
+{
+    size_t triangles;
+    size_t vertices;
+    size_t misses;
+    
+    VertexCacheStats() : triangles(0), vertices(0), misses(0) {}
+    float getACMR() const { return triangles ? static_cast<float>(misses) / triangles : 0.0f; }
+    float getATVR() const { return vertices ? static_cast<float>(misses) / vertices : 0.0f; }
+    VertexCacheStats &operator+=(const VertexCacheStats &other);
+};
+
+/*
+ * The import-time optimization stage. optimizeMesh runs all three passes below in order: welding
+ * shrinks the vertex count, the triangle reorder improves vertex cache hits, and the vertex reorder
+ * then lays the vertices out in the order the triangles first touch them, so fetches walk memory
+ * roughly linearly. All of them work on triangle lists.
+ */
+void weldVertices(std::vector<Vertex> &vertices, std::vector<GLuint> &indices);
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount);
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<GLuint> &indices);
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<GLuint> &indices, VertexCacheStats *before = nullptr, VertexCacheStats *after = nullptr);
+VertexCacheStats simulateVertexCache(const std::vector<GLuint> &indices, size_t vertexCount, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+#endif
@@ -0,0 +1,306 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+static const GLuint NO_VERTEX = 0xffffffff;
+static const float MIN_NORMAL_COSINE = 0.25f;                       // About 75 degrees
+static const size_t MAX_LODS = 5;                                   // The full mesh plus four simplified levels
+static const size_t MIN_LOD_TRIANGLES = 64;                         // Not worth simplifying any further below this
+static const float MIN_LOD_REDUCTION = 0.9f;                        // A level has to drop at least 10% of its predecessor's indices
+
+// A symmetric 4x4 matrix: the sum of the squared distances to a set of planes, as a function of position
+struct Quadric
+{
+    double a00, a01, a02, a03;
+    double a11, a12, a13;
+    double a22, a23;
+    double a33;
+    
+    Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0) {}
+    
+    Quadric(const glm::vec3 &normal, float d) :
+        a00(normal.x * normal.x), a01(normal.x * normal.y), a02(normal.x * normal.z), a03(normal.x * d),
+        a11(normal.y * normal.y), a12(normal.y * normal.z), a13(normal.y * d),
+        a22(normal.z * normal.z), a23(normal.z * d),
+        a33(static_cast<double>(d) * d) {}
+    
+    Quadric &operator+=(const Quadric &q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        return *this;
+    }
+    
+    double evaluate(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double result = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+                      + a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+                      + a22 * z * z + 2.0 * a23 * z
+                      + a33;
+        return std::max(result, 0.0);                               // Rounding can push it ever so slightly below 0
+    }
+};
+
+struct Collapse
+{
+    GLuint from;
+    GLuint to;
+    double cost;
+    
+    bool operator<(const Collapse &other) const { return cost < other.cost; }
+};
+
+struct PositionHash
+{
+    size_t operator()(const glm::vec3 &p) const
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual
+{
+    bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+    {
+        return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+    }
+};
+
+static uint64_t edgeKey(GLuint a, GLuint b)
+{
+    return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+static glm::vec3 triangleNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+/*
+ * Collapsing from into to must not turn any of from's other triangles inside out (or squash them flat),
+ * which plain QEM would otherwise happily do around sharp features. Rotating a triangle a long way is
+ * refused too: a few moderate rotations over successive collapses add up to a flip just the same.
+ */
+static bool flipsTriangle(const std::vector<GLuint> &indices, const std::vector<GLuint> &adjacency, GLuint adjacencyBegin, GLuint adjacencyEnd,
+                          const std::vector<Vertex> &vertices, GLuint from, GLuint to)
+{
+    for (GLuint i = adjacencyBegin; i < adjacencyEnd; ++i)
+    {
+        const GLuint *triangle = &indices[adjacency[i] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;      // Disappears with the collapse
+        
+        glm::vec3 corners[3];
+        glm::vec3 moved[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            corners[k] = vertices[triangle[k]].position;
+            moved[k] = triangle[k] == from ? vertices[to].position : corners[k];
+        }
+        
+        glm::vec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+        glm::vec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+        if (glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after)) return true;
+    }
+    return false;
+}
+
+// ===============================
+// Public functions
+// ===============================
+
+std::vector<GLuint> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &inputIndices, size_t targetIndexCount, float *error)
+{
+    size_t vertexCount = vertices.size();
+    
+    /*
+     * Work on positions rather than vertices: every vertex is represented by the first vertex with the
+     * same position. Positions shared by several vertices are attribute seams and get locked.
+     */
+    std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> positions;
+    std::vector<GLuint> canonical(vertexCount);
+    std::vector<bool> locked(vertexCount, false);
+    for (GLuint i = 0; i < vertexCount; ++i)
+    {
+        auto inserted = positions.insert(std::make_pair(vertices[i].position, i));
+        canonical[i] = inserted.first->second;
+        if (!inserted.second) locked[canonical[i]] = true;
+    }
+    
+    std::vector<GLuint> indices(inputIndices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        indices[i] = canonical[inputIndices[i]];
+    
+    // The original triangle each remaining triangle started out as
+    std::vector<GLuint> origins(indices.size() / 3);
+    for (size_t i = 0; i < origins.size(); ++i)
+        origins[i] = static_cast<GLuint>(i);
+    
+    // Every triangle contributes its plane to each of its corners; directed edges without a twin are borders
+    std::vector<Quadric> quadrics(vertexCount);
+    std::unordered_map<uint64_t, int> edgeCounts;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const glm::vec3 &a = vertices[indices[i]].position;
+        const glm::vec3 &b = vertices[indices[i + 1]].position;
+        const glm::vec3 &c = vertices[indices[i + 2]].position;
+        glm::vec3 normal = triangleNormal(a, b, c);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            normal /= length;
+            Quadric plane(normal, -glm::dot(normal, a));
+            for (int k = 0; k < 3; ++k)
+                quadrics[indices[i + k]] += plane;
+        }
+        for (int k = 0; k < 3; ++k)
+            ++edgeCounts[edgeKey(indices[i + k], indices[i + (k + 1) % 3])];
+    }
+    for (const auto &edge: edgeCounts)
+    {
+        GLuint a = static_cast<GLuint>(edge.first >> 32);
+        GLuint b = static_cast<GLuint>(edge.first & 0xffffffff);
+        if (edgeCounts.find(edgeKey(b, a)) == edgeCounts.end())
+            locked[a] = locked[b] = true;
+    }
+    
+    std::vector<GLuint> collapsedTo(vertexCount, NO_VERTEX);
+    std::vector<bool> touched(vertexCount);
+    std::vector<GLuint> adjacencyOffsets(vertexCount + 1);
+    std::vector<GLuint> adjacency;
+    std::vector<Collapse> collapses;
+    double maxCost = 0.0;
+    
+    /*
+     * Each pass gathers every edge that may collapse, sorts them by cost and greedily applies the
+     * cheapest ones whose neighbourhoods haven't changed yet this pass. Passes continue until the
+     * target is reached or nothing can collapse any more.
+     */
+    while (indices.size() > targetIndexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (GLuint index: indices)
+            ++adjacencyOffsets[index + 1];
+        for (size_t i = 0; i < vertexCount; ++i)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        adjacency.resize(indices.size());
+        std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+        
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            GLuint a = indices[i];
+            GLuint b = indices[i - i % 3 + (i + 1) % 3];
+            if (a > b) continue;                                    // Each interior edge shows up in both directions
+            
+            Quadric sum = quadrics[a];
+            sum += quadrics[b];
+            double costAB = locked[a] ? INFINITY : sum.evaluate(vertices[b].position);
+            double costBA = locked[b] ? INFINITY : sum.evaluate(vertices[a].position);
+            if (costAB == INFINITY && costBA == INFINITY) continue;
+            
+            Collapse collapse;
+            collapse.from = costAB <= costBA ? a : b;
+            collapse.to = costAB <= costBA ? b : a;
+            collapse.cost = std::min(costAB, costBA);
+            collapses.push_back(collapse);
+        }
+        if (collapses.empty()) break;
+        std::sort(collapses.begin(), collapses.end());
+        
+        // Each collapse removes (about) two triangles
+        size_t trianglesToRemove = triangleCount - targetIndexCount / 3;
+        size_t collapsed = 0;
+        std::fill(touched.begin(), touched.end(), false);
+        for (const auto &collapse: collapses)
+        {
+            if (collapsed * 2 >= trianglesToRemove) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            if (flipsTriangle(indices, adjacency, adjacencyOffsets[collapse.from], adjacencyOffsets[collapse.from + 1], vertices, collapse.from, collapse.to)) continue;
+            
+            collapsedTo[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxCost = std::max(maxCost, collapse.cost);
+            
+            // Everything sharing a triangle with either end now has a stale neighbourhood
+            for (GLuint vertex: { collapse.from, collapse.to })
+                for (GLuint i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; ++i)
+                    for (int k = 0; k < 3; ++k)
+                        touched[indices[adjacency[i] * 3 + k]] = true;
+            ++collapsed;
+        }
+        if (collapsed == 0) break;
+        
+        // Apply this pass's collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            GLuint triangle[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                triangle[k] = indices[i + k];
+                if (collapsedTo[triangle[k]] != NO_VERTEX) triangle[k] = collapsedTo[triangle[k]];
+            }
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) continue;
+            origins[write / 3] = origins[i / 3];
+            for (int k = 0; k < 3; ++k)
+                indices[write++] = triangle[k];
+        }
+        indices.resize(write);
+        origins.resize(write / 3);
+        std::fill(collapsedTo.begin(), collapsedTo.end(), NO_VERTEX);
+    }
+    
+    /*
+     * Map back from positions to vertices. Collapses only ever replace corners in place, so each
+     * remaining triangle still knows which original triangle it came from: corners that kept their
+     * position keep their original vertex (and with it the right normal and texture coordinate on
+     * seams), while moved corners take the vertex that represents their new position.
+     */
+    std::vector<GLuint> result(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        GLuint original = inputIndices[origins[i / 3] * 3 + i % 3];
+        result[i] = canonical[original] == indices[i] ? original : indices[i];
+    }
+    
+    if (error) *error = static_cast<float>(std::sqrt(maxCost));
+    return result;
+}
+
+size_t generateMeshLODs(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices, std::vector<GLuint> &lodIndices, std::vector<MeshLOD> &lods)
+{
+    size_t sourceTriangles = 0;
+    std::vector<GLuint> previous = indices;
+    float error = 0.0f;
+    lodIndices.clear();
+    lods.clear();
+    
+    while (lods.size() + 1 < MAX_LODS && previous.size() / 3 > MIN_LOD_TRIANGLES)
+    {
+        sourceTriangles += previous.size() / 3;
+        float stepError = 0.0f;
+        std::vector<GLuint> simplified = simplifyMesh(vertices, previous, previous.size() / 6 * 3, &stepError);
+        
+        // Not worth another level (and another range of index data) if it barely got any simpler
+        if (simplified.size() > previous.size() * MIN_LOD_REDUCTION) break;
+        
+        error += stepError;
+        MeshLOD lod = { static_cast<GLuint>(indices.size() + lodIndices.size()), static_cast<GLsizei>(simplified.size()), error };
+        lods.push_back(lod);
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+    return sourceTriangles;
+}
@@ -0,0 +1,37 @@
+#ifndef __LearnOpenGL__MeshSimplifier__
+#define __LearnOpenGL__MeshSimplifier__
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include "Mesh.h"
+
+/*
+ * Quadric error metric simplification (Garland and Heckbert) by half-edge collapse: a vertex is only
+ * ever merged into one of its neighbours, never moved, so the result is just a new index buffer into
+ * the same vertices and every level of detail can share the original vertex buffer.
+ *
+ * Vertices on open borders and on attribute seams (one position with several normals or texture
+ * coordinates) are never collapsed, which keeps silhouettes and texture mapping intact at the cost of
+ * sometimes stopping short of the target.
+ *
+ * Returns the simplified triangle list, aiming for at most targetIndexCount indices. If error is
+ * given it receives the square root of the largest collapse's quadric cost. A vertex's quadric sums
+ * the squared distances to the planes of every original triangle merged into it, so this bounds how
+ * far, in the mesh's units, any moved vertex ended up from each of those planes. It is not a bound
+ * on the distance between the two surfaces (a vertex can slide along a plane past the triangle that
+ * defined it), but it grows with the visible deviation, which is all the LOD selection needs when it
+ * compares it against the projected pixel size.
+ */
+std::vector<GLuint> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices, size_t targetIndexCount, float *error = nullptr);
+
+/*
+ * Builds up to four simplified levels of detail, each aiming for half the triangles of the one before,
+ * and stops early once a level has too few triangles or barely gets simpler. lodIndices receives every
+ * level's indices, one after the other; each MeshLOD's firstIndex is relative to the start of indices,
+ * as if lodIndices followed it, and its error is the sum of the errors of every simplification that led
+ * to it. Returns how many source triangles were simplified along the way.
+ */
+size_t generateMeshLODs(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices, std::vector<GLuint> &lodIndices, std::vector<MeshLOD> &lods);
+
+#endif
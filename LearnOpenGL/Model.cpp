@@ -1,32 +1,579 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "VertexCompression.h"
+#include "MeshSimplifier.h"
+#include "GlState.h"
+#include "Profiler.h"
+#include "Transform.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+static const float MIN_LOD_DISTANCE = 0.1f;                         // Keeps the camera from ending up inside a model's bounding sphere
 
 // ===============================
 // Public member functions
 // ===============================
 
+Model::Model(const GLchar* path, bool keepCPUData, VertexFormat format) : VAO(0), VBO(0), EBO(0), vertexFormat(format), indexType(GL_UNSIGNED_INT), indirectBuffer(0)
+{
+    this->loadModel(path);
+    this->buildBVH();
+    this->setupIndirectDraws();
+    this->setupArena(keepCPUData);
+}
+
+Model::~Model()
+{
+    GlState &state = GlState::getInstance();
+    state.deleteVertexArray(VAO);
+    state.deleteBuffer(VBO);
+    state.deleteBuffer(EBO);
+    state.deleteBuffer(indirectBuffer);
+}
+
 void Model::draw(GlslProgram &program)
 {
+    GlState::getInstance().bindVertexArray(VAO);
     for (const auto &mesh: meshes)
-        mesh.draw(program);
+        mesh.drawSubmesh(program);
+}
+
+/*
+ * Like draw(), but skips every mesh whose bounds lie entirely outside the frustum. Rather than moving
+ * every mesh's bounds into world space, the frustum is moved into the model's object space and the
+ * mesh hierarchy is queried directly, so model has to be the same matrix the caller uploads for the
+ * vertex shader.
+ */
+void Model::draw(GlslProgram &program, const Frustum &frustum, const glm::mat4 &model, CullStats &stats)
+{
+    visibleMeshes.clear();
+    meshBVH.queryFrustum(frustum.transformed(model), visibleMeshes, &stats);
+    
+    GlState::getInstance().bindVertexArray(VAO);
+    for (size_t index: visibleMeshes)
+        meshes[index].drawSubmesh(program);
+}
+
+/*
+ * Draws the whole model with one glMultiDrawElementsIndirect call per material: the only work left on
+ * the CPU is binding each material's textures. Without ARB_multi_draw_indirect (e.g. on macOS, which
+ * stops at OpenGL 4.1) we walk the same commands and issue them one by one instead, which still skips
+ * the per-mesh texture binds of draw().
+ */
+void Model::drawIndirect(GlslProgram &program)
+{
+    if (drawCommands.empty()) return;
+    
+    bool useMultiDraw = GLEW_ARB_multi_draw_indirect && indirectBuffer;
+    GlState &state = GlState::getInstance();
+    state.bindVertexArray(VAO);
+    if (useMultiDraw) state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    
+    for (auto &material: materials)
+    {
+        Material::find(material.bindings, program, material.textures, material.shininess).bind();
+        
+        if (useMultiDraw)
+        {
+            const GLvoid *offset = (GLvoid*)(material.firstCommand * sizeof(DrawElementsIndirectCommand));
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, offset, material.commandCount, sizeof(DrawElementsIndirectCommand));
+        }
+        else
+        {
+            for (GLuint i = material.firstCommand; i < material.firstCommand + material.commandCount; ++i)
+            {
+                const DrawElementsIndirectCommand &command = drawCommands[i];
+                GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+                glDrawElementsBaseVertex(GL_TRIANGLES, command.count, indexType, (GLvoid*)(command.firstIndex * indexSize), command.baseVertex);
+            }
+        }
+    }
+}
+
+/*
+ * Hands every mesh to the queue as a draw of its own instead of drawing them in node order, so that
+ * the queue can group them by material with everything else in the frame. Each mesh's depth is that
+ * of its bounding sphere's center.
+ */
+void Model::submit(RenderQueue &queue, GlslProgram &program, const glm::mat4 &model, const glm::mat4 &view) const
+{
+    glm::mat4 modelView = view * model;
+    DrawItem item = DrawItem();
+    item.program = &program;
+    item.transform = model;
+    item.vertexTransform = getVertexTransform();
+    for (const auto &mesh: meshes)
+    {
+        item.mesh = &mesh;
+        item.depth = -(modelView * glm::vec4(mesh.getBoundingSphere().center, 1.0f)).z;
+        queue.submit(item);
+    }
+}
+
+/*
+ * Draws every mesh at the coarsest level of detail whose simplification error would cover no more than
+ * maxPixelError pixels on screen.
+ */
+void Model::drawLOD(GlslProgram &program, const glm::mat4 &model, const Camera &camera, float screenHeight, float maxPixelError)
+{
+    float pixelsPerUnit = getPixelsPerUnit(model, camera, screenHeight);
+    
+    GlState::getInstance().bindVertexArray(VAO);
+    for (const auto &mesh: meshes)
+        mesh.drawSubmesh(program, mesh.selectLOD(pixelsPerUnit, maxPixelError));
+}
+
+/*
+ * How many pixels one object space unit covers on screen. A perspective projection makes something
+ * of size s at distance d cover s / (2 * d * tan(fov / 2)) of the screen's height; we measure d to the
+ * nearest point of the model's bounding sphere, so that large models close by stay conservative.
+ */
+float Model::getPixelsPerUnit(const glm::mat4 &model, const Camera &camera, float screenHeight) const
+{
+    float scale = std::sqrt(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                     std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                              glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+    glm::vec3 center = glm::vec3(model * glm::vec4(bounds.getCenter(), 1.0f));
+    float radius = glm::length(bounds.getExtents()) * scale;
+    float distance = std::max(glm::length(center - camera.getPositionVector()) - radius, MIN_LOD_DISTANCE);
+    return scale * screenHeight / (2.0f * distance * std::tan(glm::radians(camera.getFOV()) * 0.5f));
+}
+
+// The residency re-decodes evicted textures from their files, so it gets their full paths
+void Model::trackTextures(TextureResidency &residency) const
+{
+    for (const auto &material: materials)
+        for (const auto &texture: material.textures)
+            residency.track(texture.img, directory + '/' + texture.path.C_Str());
+}
+
+// Call for every frame the model is drawn in, so its textures count as recently used
+void Model::touchTextures(TextureResidency &residency) const
+{
+    for (const auto &material: materials)
+        for (const auto &texture: material.textures)
+            residency.touch(texture.img);
+}
+
+/*
+ * The model's vertex data may not be in object space: compact positions are stored relative to the
+ * model's bounds. Callers should upload model * getVertexTransform() as the shader's model matrix, but
+ * keep using the plain model matrix for culling, picking and the normal matrix.
+ */
+glm::mat4 Model::getVertexTransform() const
+{
+    return vertexFormat == VERTEX_FORMAT_COMPACT ? getDequantizationMatrix(bounds) : glm::mat4();
+}
+
+/*
+ * Finds the closest mesh whose bounds the world space ray enters. The direction is deliberately left
+ * unnormalized in object space, so that the hit distance still comes out in world units.
+ */
+bool Model::raycast(const Ray &ray, const glm::mat4 &model, RayHit &hit) const
+{
+    glm::mat4 inverseModel = glm::inverse(model);
+    Ray localRay;
+    localRay.origin = glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f));
+    localRay.direction = glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f));
+    return meshBVH.raycast(localRay, hit);
+}
+
+/*
+ * Times importing a model's meshes with Assimp and simplifying their LODs, with its mesh cache deleted
+ * first, against loading both from the cache that the import leaves behind. Only loadModel() is timed:
+ * the GPU uploads that follow are the same either way. A first, untimed load keeps the model's textures
+ * in the TextureCache, so that neither side pays for decoding them.
+ */
+void Model::benchmarkLoad(std::ostream &stream, const std::string &path)
+{
+    static const int RUNS = 3;
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    Model textures;
+    textures.loadModel(path);
+    
+    double coldMs = 1e30;
+    double warmMs = 1e30;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        std::remove(MeshCache::getCachePath(path).c_str());
+        Model cold;
+        auto startTime = Clock::now();
+        cold.loadModel(path);
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - startTime;
+        coldMs = std::min(coldMs, elapsed.count());
+        
+        Model warm;
+        startTime = Clock::now();
+        warm.loadModel(path);
+        elapsed = Clock::now() - startTime;
+        warmMs = std::min(warmMs, elapsed.count());
+    }
+    
+    stream << "Loading " << path << " (best of " << RUNS << "): cold (Assimp and LODs) " << coldMs << " ms, warm (mesh cache) " << warmMs << " ms, "
+           << coldMs / warmMs << "x faster." << std::endl;
+}
+
+/*
+ * Draws copies of the model through each of its draw paths: draw(), which binds each mesh's textures
+ * and issues one call per mesh; drawIndirect(), one multi-draw per material; and submit() to a
+ * RenderQueue, which sorts every copy's meshes by material before drawing them one by one. The copies
+ * all share one transform, so only the cost of issuing the draws differs. Submit is how long the CPU
+ * takes to issue them; total also waits for the GPU. Needs the GL context, and leaves whatever it drew
+ * in the framebuffer.
+ */
+void Model::benchmarkDraws(std::ostream &stream, GlslProgram &program, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, size_t copies)
+{
+    static const int RUNS = 5;
+    static const int NUM_PATHS = 3;
+    static const char *PATH_NAMES[NUM_PATHS] = { "draw()        ", "drawIndirect()", "render queue  " };
+    typedef std::chrono::high_resolution_clock Clock;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+    
+    glm::mat4 viewProjection = projection * view;
+    glm::mat4 vertexModel = model * getVertexTransform();
+    program.begin();
+    program.set(program.getUniform("uModel"), vertexModel);
+    program.set(program.getUniform("uModelViewProjection"), viewProjection * vertexModel);
+    program.set(program.getUniform("uNormalMatrix"), computeNormalMatrix(model));
+    
+    RenderQueue queue;
+    double submitMs[NUM_PATHS] = { 1e30, 1e30, 1e30 };
+    double totalMs[NUM_PATHS] = { 1e30, 1e30, 1e30 };
+    for (int run = 0; run < RUNS; ++run)
+    {
+        for (int path = 0; path < NUM_PATHS; ++path)
+        {
+            glFinish();
+            auto startTime = Clock::now();
+            for (size_t copy = 0; copy < copies; ++copy)
+            {
+                if (path == 0) draw(program);
+                else if (path == 1) drawIndirect(program);
+                else submit(queue, program, model, view);
+            }
+            if (path == 2)
+            {
+                queue.sort();
+                queue.execute(viewProjection);
+                queue.clear();
+            }
+            Milliseconds submitted = Clock::now() - startTime;
+            glFinish();
+            Milliseconds finished = Clock::now() - startTime;
+            submitMs[path] = std::min(submitMs[path], submitted.count());
+            totalMs[path] = std::min(totalMs[path], finished.count());
+        }
+    }
+    
+    bool useMultiDraw = GLEW_ARB_multi_draw_indirect && indirectBuffer;
+    size_t drawCalls[NUM_PATHS] = { copies * meshes.size(), copies * (useMultiDraw ? materials.size() : meshes.size()), copies * meshes.size() };
+    stream << "Drawing " << copies << " copies of a model of " << meshes.size() << " meshes and " << materials.size() << " materials (best of " << RUNS << "):" << std::endl;
+    for (int path = 0; path < NUM_PATHS; ++path)
+        stream << "  " << PATH_NAMES[path] << " " << drawCalls[path] << " draw calls, submit " << submitMs[path] << " ms, total " << totalMs[path] << " ms" << std::endl;
+    stream << "  The render queue bound textures " << queue.getStats().materialChanges << " times, draw() " << copies * meshes.size() << " times." << std::endl;
 }
 
 // ===============================
 // Private member functions
 // ===============================
 
+// An empty model, for benchmarkLoad() to load meshes into without uploading them
+Model::Model() : VAO(0), VBO(0), EBO(0), vertexFormat(VERTEX_FORMAT_FLOAT), indexType(GL_UNSIGNED_INT), indirectBuffer(0)
+{
+    
+}
+
 void Model::loadModel(const std::string &path)
 {
+    ProfileScope zone("Model load");
+    auto startTime = std::chrono::high_resolution_clock::now();
+    this->directory = path.substr(0, path.find_last_of('/'));
+    
+    /*
+     * Parsing a large OBJ with Assimp dominates our startup time, so the processed meshes are
+     * written next to the source asset in a binary form that can simply be mapped back into memory.
+     * The cache is keyed by a hash of the source file and the import flags, so editing either one
+     * transparently invalidates it.
+     */
+    const GLuint importFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+    const std::string cachePath = MeshCache::getCachePath(path);
+    const uint64_t sourceHash = MeshCache::hashSource(path, importFlags);
+    
+    if (loadFromCache(cachePath, sourceHash, importFlags))
+    {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        std::cout << "Loaded model " << path << " from mesh cache in " << elapsed.count() << " ms." << std::endl;
+        return;
+    }
+    
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    const aiScene* scene = importer.ReadFile(path, importFlags);
     
     if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
         std::cout << "Error loading modeling: " << importer.GetErrorString() << std::endl;
         return;
     }
-    this->directory = path.substr(0, path.find_last_of('/'));
+    
+    // Decode every texture the scene references up front, in parallel, instead of one by one as meshes are processed
+    std::vector<std::string> texturePaths;
+    for(GLuint i = 0; i < scene->mNumMeshes; i++)
+    {
+        aiMaterial* material = scene->mMaterials[scene->mMeshes[i]->mMaterialIndex];
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, texturePaths);
+        collectMaterialTextures(material, aiTextureType_SPECULAR, texturePaths);
+    }
+    preloadTextures(texturePaths);
     
     this->processNode(scene->mRootNode, scene);
+    
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    std::cout << "Imported model " << path << " with Assimp in " << elapsed.count() << " ms." << std::endl;
+    std::cout << "Vertex cache (" << VERTEX_CACHE_SIZE << " entry FIFO): ACMR " << importCacheStatsBefore.getACMR() << " -> " << importCacheStatsAfter.getACMR()
+              << ", ATVR " << importCacheStatsBefore.getATVR() << " -> " << importCacheStatsAfter.getATVR()
+              << ", " << importCacheStatsBefore.vertices << " -> " << importCacheStatsAfter.vertices << " vertices." << std::endl;
+    
+    // Simplifying takes longer than the whole import, so the LODs go into the cache along with the meshes
+    this->generateLODs();
+    MeshCache::write(cachePath, sourceHash, importFlags, meshes);
+}
+
+/*
+ * Builds a chain of LODs for every mesh, each one simplified from the one before it to about half its
+ * triangle count. Simplifying the previous level instead of the original is much faster; the price
+ * is that errors add up, so each level's error is the sum of its own and its predecessors' (see
+ * simplifyMesh() for what a single level's error measures).
+ */
+void Model::generateLODs()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    size_t sourceTriangles = 0;
+    size_t lodTriangles = 0;
+    
+    for (auto &mesh: meshes)
+    {
+        std::vector<GLuint> lodIndices;
+        std::vector<MeshLOD> lods;
+        sourceTriangles += generateMeshLODs(mesh.getVertices(), mesh.getIndices(), lodIndices, lods);
+        lodTriangles += lodIndices.size() / 3;
+        mesh.setLODs(lodIndices, lods);
+    }
+    
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    std::cout << "Generated " << lodTriangles << " LOD triangles in " << elapsed.count() * 1000.0 << " ms ("
+              << (elapsed.count() > 0.0 ? sourceTriangles / elapsed.count() / 1e6 : 0.0) << " million source triangles per second)." << std::endl;
+}
+
+void Model::buildBVH()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    
+    std::vector<AABB> meshBounds;
+    for (const auto &mesh: meshes)
+        meshBounds.push_back(mesh.getAABB());
+    meshBVH.build(meshBounds);
+    
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    std::cout << "Built a " << meshBVH.getNodeCount() << " node BVH over " << meshes.size() << " meshes in " << elapsed.count() << " ms." << std::endl;
+}
+
+/*
+ * Groups the meshes by material and records one indirect command per mesh, in material order. This has
+ * to run before setupArena(), which is what assigns the meshes their offsets, so the offsets are
+ * filled in (and the buffer uploaded) by setupArena() once they're known.
+ */
+void Model::setupIndirectDraws()
+{
+    std::vector<GLuint> meshMaterials;
+    for (const auto &mesh: meshes)
+        meshMaterials.push_back(findMaterial(mesh.getTextures(), mesh.getShininess()));
+    
+    drawCommands.clear();
+    drawMeshes.clear();
+    for (GLuint material = 0; material < materials.size(); ++material)
+    {
+        materials[material].firstCommand = static_cast<GLuint>(drawCommands.size());
+        for (size_t i = 0; i < meshes.size(); ++i)
+        {
+            if (meshMaterials[i] != material) continue;
+            
+            DrawElementsIndirectCommand command = { static_cast<GLuint>(meshes[i].getIndexCount()), 1, 0, 0, 0 };
+            drawCommands.push_back(command);
+            drawMeshes.push_back(static_cast<GLuint>(i));
+        }
+        materials[material].commandCount = static_cast<GLsizei>(drawCommands.size() - materials[material].firstCommand);
+    }
+}
+
+GLuint Model::findMaterial(const std::vector<Texture> &textures, float shininess)
+{
+    for (GLuint i = 0; i < materials.size(); ++i)
+    {
+        const std::vector<Texture> &other = materials[i].textures;
+        if (other.size() != textures.size() || materials[i].shininess != shininess) continue;
+        
+        bool same = true;
+        for (size_t j = 0; j < textures.size() && same; ++j)
+            same = other[j].type == textures[j].type && other[j].img == textures[j].img;
+        if (same) return i;
+    }
+    
+    ModelMaterial material;
+    material.textures = textures;
+    material.shininess = shininess;
+    material.firstCommand = 0;
+    material.commandCount = 0;
+    materials.push_back(material);
+    return static_cast<GLuint>(materials.size() - 1);
+}
+
+/*
+ * Packs every mesh into one vertex buffer and one index buffer behind a single VAO. Each mesh keeps
+ * its own, zero-based indices: glDrawElementsBaseVertex adds the mesh's base vertex to them at draw
+ * time, so nothing has to be rewritten on the way in. Unless keepCPUData is set, the meshes' copies
+ * of their vertices and indices are freed once they've been uploaded.
+ */
+void Model::setupArena(bool keepCPUData)
+{
+    if (meshes.empty()) return;
+    
+    /*
+     * Indices are relative to each mesh's base vertex, so 16 bits are enough as long as no single mesh
+     * has more than 65536 vertices, however large the model as a whole is.
+     */
+    indexType = GL_UNSIGNED_SHORT;
+    for (const auto &mesh: meshes)
+        if (mesh.getVertexCount() > 65536) indexType = GL_UNSIGNED_INT;
+    
+    const size_t vertexSize = vertexFormat == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+    const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    GLsizeiptr vertexBytes = 0;
+    GLsizeiptr indexBytes = 0;
+    size_t meshBufferBytes = 0;                                     // What separate buffers per mesh, of Vertex and GLuint, would hold
+    size_t cpuBytes = 0;
+    bounds = meshes[0].getAABB();
+    for (const auto &mesh: meshes)
+    {
+        bounds = mergeAABB(bounds, mesh.getAABB());
+        vertexBytes += mesh.getVertexCount() * vertexSize;
+        indexBytes += (mesh.getIndexCount() + mesh.getLODIndices().size()) * indexSize;
+        meshBufferBytes += mesh.getVertexCount() * sizeof(Vertex) + (mesh.getIndexCount() + mesh.getLODIndices().size()) * sizeof(GLuint);
+        cpuBytes += mesh.getVertices().capacity() * sizeof(Vertex) + (mesh.getIndices().capacity() + mesh.getLODIndices().capacity()) * sizeof(GLuint);
+    }
+    
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    
+    GlState &state = GlState::getInstance();
+    state.bindVertexArray(VAO);
+    state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+    Mesh::setupVertexAttributes(vertexFormat);
+    
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    std::vector<CompactVertex> compactVertices;
+    std::vector<GLuint> meshIndices;
+    std::vector<GLushort> shortIndices;
+    for (auto &mesh: meshes)
+    {
+        const GLvoid *vertexData = mesh.getVertices().data();
+        if (vertexFormat == VERTEX_FORMAT_COMPACT)
+        {
+            compactVertices.resize(mesh.getVertexCount());
+            compressVertices(mesh.getVertices().data(), compactVertices.size(), bounds, compactVertices.data());
+            vertexData = compactVertices.data();
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, baseVertex * vertexSize, mesh.getVertexCount() * vertexSize, vertexData);
+        
+        // The mesh's LODs go right after its full index data, which is what their offsets are relative to
+        meshIndices.assign(mesh.getIndices().begin(), mesh.getIndices().end());
+        meshIndices.insert(meshIndices.end(), mesh.getLODIndices().begin(), mesh.getLODIndices().end());
+        const GLvoid *indexData = meshIndices.data();
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            shortIndices.assign(meshIndices.begin(), meshIndices.end());
+            indexData = shortIndices.data();
+        }
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * indexSize, meshIndices.size() * indexSize, indexData);
+        mesh.setArenaRange(VAO, baseVertex, firstIndex, indexType);
+        baseVertex += mesh.getVertexCount();
+        firstIndex += static_cast<GLuint>(meshIndices.size());
+        
+        if (!keepCPUData) mesh.releaseCPUData();
+    }
+    
+    state.bindVertexArray(0);
+    
+    // Now that the meshes know where they live, finish the indirect commands
+    for (size_t i = 0; i < drawCommands.size(); ++i)
+    {
+        const Mesh &mesh = meshes[drawMeshes[i]];
+        drawCommands[i].firstIndex = mesh.getFirstIndex();
+        drawCommands[i].baseVertex = mesh.getBaseVertex();
+    }
+    if (GLEW_ARB_multi_draw_indirect && !drawCommands.empty())
+    {
+        glGenBuffers(1, &indirectBuffer);
+        state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(DrawElementsIndirectCommand), &drawCommands[0], GL_STATIC_DRAW);
+    }
+    
+    size_t cpuBytesAfter = 0;
+    for (const auto &mesh: meshes)
+        cpuBytesAfter += mesh.getVertices().capacity() * sizeof(Vertex) + (mesh.getIndices().capacity() + mesh.getLODIndices().capacity()) * sizeof(GLuint);
+    
+    /*
+     * Against 3 objects per mesh, the arena needs 3 in all, plus the indirect buffer when there is one.
+     * It can also hold fewer bytes: 16-bit indices and compact vertices both shrink it.
+     */
+    size_t arenaObjects = indirectBuffer ? 4 : 3;
+    size_t arenaBytes = vertexBytes + indexBytes + (indirectBuffer ? drawCommands.size() * sizeof(DrawElementsIndirectCommand) : 0);
+    std::cout << "Packed " << meshes.size() << " meshes into one arena: GPU " << arenaBytes / 1024 << " KB in " << arenaObjects << " objects "
+              << "(was " << meshBufferBytes / 1024 << " KB in " << 3 * meshes.size() << "), CPU " << cpuBytes / 1024 << " KB before upload, "
+              << cpuBytesAfter / 1024 << " KB after." << std::endl;
+    
+    // Every vertex fetched by every draw costs vertexSize bytes of bandwidth, so that shrinks by the same ratio
+    if (vertexFormat == VERTEX_FORMAT_COMPACT)
+        std::cout << "Compact vertices: " << vertexBytes / 1024 << " KB instead of " << baseVertex * sizeof(Vertex) / 1024 << " KB ("
+                  << sizeof(CompactVertex) << " instead of " << sizeof(Vertex) << " bytes per vertex fetched)." << std::endl;
+}
+
+bool Model::loadFromCache(const std::string &cachePath, uint64_t sourceHash, GLuint importFlags)
+{
+    MeshCache cache;
+    if (!cache.open(cachePath, sourceHash, importFlags)) return false;
+    
+    std::vector<std::string> texturePaths;
+    for (uint32_t i = 0; i < cache.getMeshCount(); ++i)
+    {
+        const MeshCacheEntry &entry = cache.getEntry(i);
+        for (uint32_t j = entry.firstTexture; j < entry.firstTexture + entry.textureCount; ++j)
+            if (std::find(texturePaths.begin(), texturePaths.end(), cache.getTexturePath(j)) == texturePaths.end())
+                texturePaths.push_back(cache.getTexturePath(j));
+    }
+    preloadTextures(texturePaths);
+    
+    for (uint32_t i = 0; i < cache.getMeshCount(); ++i)
+    {
+        const MeshCacheEntry &entry = cache.getEntry(i);
+        std::vector<Vertex> vertices(cache.getVertices(i), cache.getVertices(i) + entry.vertexCount);
+        std::vector<GLuint> indices(cache.getIndices(i), cache.getIndices(i) + entry.indexCount);
+        std::vector<Texture> textures;
+        
+        for (uint32_t j = entry.firstTexture; j < entry.firstTexture + entry.textureCount; ++j)
+            textures.push_back(loadTexture(aiString(cache.getTexturePath(j)), cache.getTextureType(j)));
+        
+        meshes.push_back(Mesh(vertices, indices, textures, entry.shininess, false));
+        meshes.back().setLODs(std::vector<GLuint>(cache.getLODIndices(i), cache.getLODIndices(i) + entry.lodIndexCount),
+                              std::vector<MeshLOD>(cache.getLODs(i), cache.getLODs(i) + entry.lodCount));
+    }
+    return true;
 }
 
 void Model::processNode(aiNode* node, const aiScene* scene)
@@ -49,6 +596,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    float shininess = MATERIAL_DEFAULT_SHININESS;
     
     for(GLuint i = 0; i < mesh->mNumVertices; i++)
     {
@@ -88,6 +636,9 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         for(GLuint j = 0; j < face.mNumIndices; j++)
             indices.push_back(face.mIndices[j]);
     }
+    
+    // OBJ files come out of Assimp with every face's vertices duplicated and in file order
+    optimizeMesh(vertices, indices, &importCacheStatsBefore, &importCacheStatsAfter);
   
     // Process material
     if(mesh->mMaterialIndex >= 0)
@@ -97,9 +648,13 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        
+        // Assimp's OBJ importer reports 0 for a material without an Ns line, so 0 means unset too: pow(x, 0) would light every texel fully
+        if (material->Get(AI_MATKEY_SHININESS, shininess) != aiReturn_SUCCESS || shininess <= 0.0f)
+            shininess = MATERIAL_DEFAULT_SHININESS;
     }
     
-    return Mesh(vertices, indices, textures);
+    return Mesh(vertices, indices, textures, shininess, false);
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -109,26 +664,44 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
     {
         aiString str;
         mat->GetTexture(type, i, &str);
-        GLboolean skip = false;
-        for(GLuint j = 0; j < textures_loaded.size(); j++)
-        {
-            if(textures_loaded[j].path == str)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if(!skip)
-        {
-            // If texture hasn't been loaded already, load it
-            Texture texture;
-            texture.img.loadImage(str.C_Str(), 512, 512);
-            texture.type = typeName;
-            texture.path = str;
-            textures.push_back(texture);
-            this->textures_loaded.push_back(texture);  // Add to loaded textures
-        }
+        textures.push_back(loadTexture(str, typeName));
     }
     return textures;
-}
\ No newline at end of file
+}
+
+/*
+ * Usually a cache hit: preloadTextures() has already loaded everything the model references. Materials
+ * name their textures relative to the model file, and that's how texture.path (and the mesh cache)
+ * keeps them.
+ */
+Texture Model::loadTexture(const aiString &path, const std::string &typeName)
+{
+    Texture texture;
+    texture.img = TextureCache::getInstance().load(directory + '/' + path.C_Str());
+    texture.type = typeName;
+    texture.path = path;
+    return texture;
+}
+
+void Model::collectMaterialTextures(aiMaterial* mat, aiTextureType type, std::vector<std::string> &paths)
+{
+    for(GLuint i = 0; i < mat->GetTextureCount(type); i++)
+    {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        if (std::find(paths.begin(), paths.end(), str.C_Str()) == paths.end())
+            paths.push_back(str.C_Str());
+    }
+}
+
+// The cache only loads the textures that no other Model has loaded already
+void Model::preloadTextures(const std::vector<std::string> &paths)
+{
+    std::vector<std::string> filePaths;
+    for (const auto &path: paths)
+        filePaths.push_back(directory + '/' + path);
+    
+    TextureCache &cache = TextureCache::getInstance();
+    textures_loaded = cache.load(filePaths);
+    cache.printStats(std::cout);
+}
@@ -2,26 +2,102 @@
 #define __LearnOpenGL__Model__
 
 #include "Mesh.h"
+#include "BVH.h"
+#include "MeshOptimizer.h"
+#include "Camera.h"
+#include "TextureResidency.h"
+#include "RenderQueue.h"
+#include <cstdint>
 #include <iostream>
 
+// The layout glMultiDrawElementsIndirect expects for each draw in the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// A unique set of textures and shininess shared by one or more of a model's meshes
+struct ModelMaterial
+{
+    std::vector<Texture> textures;
+    float shininess;
+    std::vector<Material> bindings;                                 // textures and shininess resolved for each program the model has been drawn with
+    GLuint firstCommand;                                            // This material's draws are contiguous in the indirect buffer
+    GLsizei commandCount;
+};
+
 class Model
 {
     
 public:
 
-    Model(GLchar* path) { this->loadModel(path); }
+    Model(const GLchar* path, bool keepCPUData = false, VertexFormat format = VERTEX_FORMAT_FLOAT);
+    ~Model();
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
     void draw(GlslProgram &program);
+    void draw(GlslProgram &program, const Frustum &frustum, const glm::mat4 &model, CullStats &stats);
+    void drawIndirect(GlslProgram &program);
+    void drawLOD(GlslProgram &program, const glm::mat4 &model, const Camera &camera, float screenHeight, float maxPixelError = 1.0f);
+    void submit(RenderQueue &queue, GlslProgram &program, const glm::mat4 &model, const glm::mat4 &view) const;
+    float getPixelsPerUnit(const glm::mat4 &model, const Camera &camera, float screenHeight) const;
+    void trackTextures(TextureResidency &residency) const;
+    void touchTextures(TextureResidency &residency) const;
+    bool raycast(const Ray &ray, const glm::mat4 &model, RayHit &hit) const;
+    const BVH &getBVH() const { return meshBVH; }
+    VertexFormat getVertexFormat() const { return vertexFormat; }
+    glm::mat4 getVertexTransform() const;
+    
+    void benchmarkDraws(std::ostream &stream, GlslProgram &program, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, size_t copies = 1000);
+    
+    static void benchmarkLoad(std::ostream &stream, const std::string &path);
     
 private:
 
     std::vector<Mesh> meshes;
+    
+    // Every mesh's vertices and indices are packed into these, so drawing the model only needs one VAO bind
+    GLuint VAO;
+    GLuint VBO;
+    GLuint EBO;
+    VertexFormat vertexFormat;
+    GLenum indexType;                                               // GL_UNSIGNED_SHORT when every mesh has at most 65536 vertices
+    AABB bounds;                                                    // Of all meshes together; compact positions are relative to it
     std::string directory;
-    std::vector<Texture> textures_loaded;
+    std::vector<TextureHandle> textures_loaded;                     // Keeps every texture the model uses resident in the cache
+    
+    // One command per mesh, grouped by material, so that each material pass is a single multi-draw
+    std::vector<ModelMaterial> materials;
+    std::vector<DrawElementsIndirectCommand> drawCommands;
+    std::vector<GLuint> drawMeshes;                                 // The mesh each command draws
+    GLuint indirectBuffer;
+    
+    // Simulated vertex cache behaviour of the imported meshes, before and after optimizeMesh()
+    VertexCacheStats importCacheStatsBefore;
+    VertexCacheStats importCacheStatsAfter;
+    
+    // Built over the meshes' object space bounds; the scratch space for the culling draw is kept around so it doesn't allocate every frame
+    BVH meshBVH;
+    std::vector<size_t> visibleMeshes;
 
+    Model();
     void loadModel(const std::string &path);
+    void buildBVH();
+    void generateLODs();
+    void setupArena(bool keepCPUData);
+    void setupIndirectDraws();
+    GLuint findMaterial(const std::vector<Texture> &textures, float shininess);
+    bool loadFromCache(const std::string &cachePath, uint64_t sourceHash, GLuint importFlags);
     void processNode(aiNode* node, const aiScene* scene);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
+    Texture loadTexture(const aiString &path, const std::string &typeName);
+    void collectMaterialTextures(aiMaterial* mat, aiTextureType type, std::vector<std::string> &paths);
+    void preloadTextures(const std::vector<std::string> &paths);
     
 };
 #endif
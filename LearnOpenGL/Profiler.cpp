@@ -0,0 +1,343 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// How deep the calling thread currently is in its own CPU zones
+static thread_local uint32_t zoneDepth = 0;
+
+// ===============================
+// Public member functions
+// ===============================
+
+Profiler::Profiler() : gpuChecked(false), gpuSupported(false), gpuFrameStarted(false), gpuFrameIndex(0), droppedGpuFrames(0)
+{
+    for (auto &frame: gpuFrames)
+    {
+        frame.clockOffset = 0;
+        frame.pending = false;
+    }
+}
+
+Profiler &Profiler::getInstance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+// Nanoseconds since the first call, on a clock that never jumps
+uint64_t Profiler::now()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+/*
+ * Called by ProfileScope from any thread. Once a thread's buffer is full, its events are dropped (and
+ * counted) until endFrame() makes room again.
+ */
+void Profiler::record(const char *name, uint64_t start, uint64_t end, uint32_t depth)
+{
+    ThreadBuffer &buffer = getThreadBuffer();
+    uint64_t written = buffer.written.load(std::memory_order_relaxed);
+    if (written - buffer.read.load(std::memory_order_acquire) >= THREAD_BUFFER_SIZE)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ProfileEvent &event = buffer.events[written % THREAD_BUFFER_SIZE];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.depth = depth;
+    event.thread = buffer.index;
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+/*
+ * GPU zones are bracketed by GL_TIMESTAMP queries rather than timed with GL_TIME_ELAPSED, which can't
+ * be nested. Only the thread the context is current on may call these, like any other GL function.
+ */
+void Profiler::beginGpuZone(const char *name)
+{
+    if (!gpuChecked)
+    {
+        gpuSupported = GLEW_ARB_timer_query;
+        gpuChecked = true;
+    }
+    if (!gpuSupported) return;
+    if (!gpuFrameStarted) beginGpuFrame();
+
+    GpuFrame &frame = gpuFrames[gpuFrameIndex];
+    GpuZone zone = { name, getQuery(), getQuery(), static_cast<uint32_t>(openGpuZones.size()) };
+    glQueryCounter(zone.startQuery, GL_TIMESTAMP);
+    openGpuZones.push_back(frame.zones.size());
+    frame.zones.push_back(zone);
+}
+
+void Profiler::endGpuZone()
+{
+    if (!gpuSupported || openGpuZones.empty()) return;
+    glQueryCounter(gpuFrames[gpuFrameIndex].zones[openGpuZones.back()].endQuery, GL_TIMESTAMP);
+    openGpuZones.pop_back();
+}
+
+/*
+ * Call once per frame, on the thread that renders. Collects every thread's CPU zones so far, and the
+ * GPU zones of earlier frames that the GPU has finished with.
+ */
+void Profiler::endFrame()
+{
+    if (gpuFrameStarted)
+    {
+        // Zones left open would never get their end timestamp; close them at the end of the frame
+        while (!openGpuZones.empty())
+            endGpuZone();
+        gpuFrames[gpuFrameIndex].pending = true;
+        gpuFrameIndex = (gpuFrameIndex + 1) % GPU_FRAME_LATENCY;
+        gpuFrameStarted = false;
+    }
+    for (size_t i = 0; i < GPU_FRAME_LATENCY; ++i)
+    {
+        GpuFrame &frame = gpuFrames[(gpuFrameIndex + i) % GPU_FRAME_LATENCY];
+        if (frame.pending && !readGpuFrame(frame)) break;          // Frames finish in order, so later ones won't be done either
+    }
+
+    uint32_t renderThread = getThreadBuffer().index;
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threadNames[renderThread] = "Render thread";
+    for (auto &buffer: threads)
+    {
+        uint64_t read = buffer->read.load(std::memory_order_relaxed);
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        for (; read < written; ++read)
+            collect(buffer->events[read % THREAD_BUFFER_SIZE]);
+        buffer->read.store(read, std::memory_order_release);
+    }
+}
+
+bool Profiler::getZoneStats(const std::string &name, ZoneStats &stats, bool gpu) const
+{
+    const std::map<std::string, ZoneHistory> &history = gpu ? gpuHistory : cpuHistory;
+    auto zone = history.find(name);
+    return zone != history.end() && computeStats(zone->second, stats);
+}
+
+void Profiler::printStats(std::ostream &stream) const
+{
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    const std::map<std::string, ZoneHistory> *histories[] = { &cpuHistory, &gpuHistory };
+    const char *titles[] = { "CPU zones", "GPU zones" };
+    for (int i = 0; i < 2; ++i)
+    {
+        if (histories[i]->empty()) continue;
+        stream << titles[i] << " (ms over the last " << ZONE_WINDOW << " samples): average / median / 95th / 99th percentile / worst" << std::endl;
+        for (const auto &zone: *histories[i])
+        {
+            ZoneStats stats;
+            if (!computeStats(zone.second, stats)) continue;
+            stream << "  " << std::left << std::setw(20) << zone.first << std::right << std::fixed << std::setprecision(3)
+                   << std::setw(10) << stats.average << std::setw(10) << stats.median << std::setw(10) << stats.percentile95
+                   << std::setw(10) << stats.percentile99 << std::setw(10) << stats.max << "  (" << stats.samples << " samples)" << std::endl;
+        }
+    }
+    stream.flags(flags);
+    stream.precision(precision);
+
+    size_t droppedEvents = 0;
+    for (const auto &buffer: threads)
+        droppedEvents += buffer->dropped.load(std::memory_order_relaxed);
+    if (droppedEvents || droppedGpuFrames)
+        stream << "  dropped " << droppedEvents << " CPU zones and " << droppedGpuFrames << " frames of GPU zones" << std::endl;
+}
+
+/*
+ * Writes the collected zones in the Trace Event Format as complete ("X") events, one track per thread
+ * plus one for the GPU. Timestamps are in microseconds.
+ */
+bool Profiler::writeChromeTrace(const std::string &path) const
+{
+    std::ofstream stream(path.c_str());
+    if (!stream)
+    {
+        std::cerr << "Failed to write trace " << path << std::endl;
+        return false;
+    }
+
+    const uint32_t gpuTrack = static_cast<uint32_t>(threadNames.size());
+    stream << "{\"traceEvents\":[";
+    for (uint32_t i = 0; i <= gpuTrack; ++i)
+    {
+        const std::string &name = i < gpuTrack ? threadNames[i] : std::string("GPU");
+        stream << (i ? "," : "") << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"" << name << "\"}}";
+    }
+    stream << std::fixed << std::setprecision(3);
+    for (const auto &event: trace)
+    {
+        bool gpu = event.thread == GPU_THREAD;
+        stream << "," << std::endl << "{\"name\":\"";
+        for (const char *c = event.name; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\') stream << '\\';
+            stream << *c;
+        }
+        stream << "\",\"cat\":\"" << (gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (gpu ? gpuTrack : event.thread)
+               << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+    }
+    stream << std::endl << "]}" << std::endl;
+    return static_cast<bool>(stream);
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+// The first event a thread records gives it a buffer, which it keeps (and finds again without locking) from then on
+Profiler::ThreadBuffer &Profiler::getThreadBuffer()
+{
+    static thread_local Profiler *owner = nullptr;
+    static thread_local ThreadBuffer *buffer = nullptr;
+    if (owner == this) return *buffer;
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+    buffer = threads.back().get();
+    buffer->written = 0;
+    buffer->read = 0;
+    buffer->dropped = 0;
+    buffer->index = static_cast<uint32_t>(threads.size() - 1);
+    std::stringstream name;
+    name << "Thread " << buffer->index;
+    threadNames.push_back(name.str());
+    owner = this;
+    return *buffer;
+}
+
+void Profiler::collect(const ProfileEvent &event)
+{
+    if (trace.size() < MAX_TRACE_EVENTS) trace.push_back(event);
+
+    ZoneHistory &zone = (event.thread == GPU_THREAD ? gpuHistory : cpuHistory)[event.name];
+    double durationMs = (event.end - event.start) / 1e6;
+    if (zone.samples.size() < ZONE_WINDOW)
+        zone.samples.push_back(durationMs);
+    else
+        zone.samples[zone.next] = durationMs;
+    zone.next = (zone.next + 1) % ZONE_WINDOW;
+}
+
+/*
+ * Takes over the oldest frame slot. If that frame's queries still aren't done after GPU_FRAME_LATENCY
+ * frames, we'd rather lose them than wait. GL_TIMESTAMP read with glGetInteger64v is the GPU's time
+ * right now, without waiting for anything; pairing it with our own clock gives us the offset between
+ * the two for this frame.
+ */
+void Profiler::beginGpuFrame()
+{
+    GpuFrame &frame = gpuFrames[gpuFrameIndex];
+    if (frame.pending && !readGpuFrame(frame))
+    {
+        releaseQueries(frame);
+        frame.pending = false;
+        ++droppedGpuFrames;
+    }
+    frame.zones.clear();
+
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    frame.clockOffset = static_cast<int64_t>(now()) - gpuTime;
+    gpuFrameStarted = true;
+}
+
+// Collects the frame's zones if the GPU has finished all of them; never waits
+bool Profiler::readGpuFrame(GpuFrame &frame)
+{
+    for (const auto &zone: frame.zones)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(zone.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+    }
+
+    for (const auto &zone: frame.zones)
+    {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(zone.startQuery, GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+        ProfileEvent event = { zone.name, static_cast<uint64_t>(start + frame.clockOffset), static_cast<uint64_t>(end + frame.clockOffset), zone.depth, GPU_THREAD };
+        collect(event);
+    }
+    releaseQueries(frame);
+    frame.pending = false;
+    return true;
+}
+
+void Profiler::releaseQueries(GpuFrame &frame)
+{
+    for (const auto &zone: frame.zones)
+    {
+        freeQueries.push_back(zone.startQuery);
+        freeQueries.push_back(zone.endQuery);
+    }
+    frame.zones.clear();
+}
+
+GLuint Profiler::getQuery()
+{
+    if (freeQueries.empty())
+    {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        return query;
+    }
+    GLuint query = freeQueries.back();
+    freeQueries.pop_back();
+    return query;
+}
+
+// Same nearest rank percentiles as FrameHistogram
+bool Profiler::computeStats(const ZoneHistory &zone, ZoneStats &stats)
+{
+    if (zone.samples.empty()) return false;
+
+    std::vector<double> sorted(zone.samples);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double sample: sorted)
+        sum += sample;
+    stats.samples = sorted.size();
+    stats.average = sum / sorted.size();
+    stats.median = sorted[std::min(sorted.size() - 1, sorted.size() / 2)];
+    stats.percentile95 = sorted[std::min(sorted.size() - 1, static_cast<size_t>(0.95 * sorted.size()))];
+    stats.percentile99 = sorted[std::min(sorted.size() - 1, static_cast<size_t>(0.99 * sorted.size()))];
+    stats.max = sorted.back();
+    return true;
+}
+
+// ===============================
+// ProfileScope
+// ===============================
+
+ProfileScope::ProfileScope(const char *name) : name(name), start(Profiler::now()), ended(false)
+{
+    ++zoneDepth;
+}
+
+ProfileScope::~ProfileScope()
+{
+    end();
+}
+
+void ProfileScope::end()
+{
+    if (ended) return;
+    ended = true;
+    --zoneDepth;
+    Profiler::getInstance().record(name, start, Profiler::now(), zoneDepth);
+}
@@ -0,0 +1,162 @@
+#ifndef __LearnOpenGL__Profiler__
+#define __LearnOpenGL__Profiler__
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// One timed zone, in nanoseconds on the profiler's clock (see Profiler::now())
+struct ProfileEvent
+{
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t depth;                                                 // How many zones of the same thread (or of the GPU) it's nested in
+    uint32_t thread;                                                // Profiler thread index; GPU zones use GPU_THREAD
+};
+
+// Rolling statistics over a zone's most recent samples, in milliseconds
+struct ZoneStats
+{
+    size_t samples;
+    double average;
+    double median;
+    double percentile95;
+    double percentile99;
+    double max;
+};
+
+/*
+ * Times nested zones of code on any thread, and nested zones of GPU work on the thread that owns the
+ * context. Zone names must be string literals (or otherwise outlive the profiler): only the pointer is
+ * stored, which keeps recording a zone down to two clock reads and a write into the thread's buffer.
+ *
+ * Every thread records into its own fixed-size ring buffer, which the main thread drains in endFrame()
+ * without either side taking a lock. GPU zones are timestamp queries whose results are picked up a few
+ * frames later, once the GPU is done with them, so reading them back never stalls; a frame whose
+ * queries still aren't done by the time its slot comes around again is dropped instead.
+ *
+ * The collected zones are kept (up to MAX_TRACE_EVENTS) for writeChromeTrace(), whose output loads in
+ * chrome://tracing, and summarized per zone name over their last ZONE_WINDOW samples by getZoneStats().
+ * GPU zones are told apart from CPU zones of the same name.
+ */
+class Profiler
+{
+
+public:
+
+    static const uint32_t GPU_THREAD = 0xFFFFFFFF;
+
+    Profiler();
+    static Profiler &getInstance();
+    static uint64_t now();
+
+    void record(const char *name, uint64_t start, uint64_t end, uint32_t depth);
+    void beginGpuZone(const char *name);
+    void endGpuZone();
+    void endFrame();
+
+    bool getZoneStats(const std::string &name, ZoneStats &stats, bool gpu = false) const;
+    void printStats(std::ostream &stream) const;
+    bool writeChromeTrace(const std::string &path) const;
+
+private:
+
+    static const size_t THREAD_BUFFER_SIZE = 4096;                  // Events a thread can record between two endFrame()s
+    static const size_t GPU_FRAME_LATENCY = 4;                      // Frames of GPU queries in flight
+    static const size_t MAX_TRACE_EVENTS = 1 << 20;
+    static const size_t ZONE_WINDOW = 256;                          // Samples the rolling statistics cover
+
+    // A single producer, single consumer ring: only its thread writes events, only endFrame() reads them
+    struct ThreadBuffer
+    {
+        ProfileEvent events[THREAD_BUFFER_SIZE];
+        std::atomic<uint64_t> written;
+        std::atomic<uint64_t> read;
+        std::atomic<size_t> dropped;
+        uint32_t index;
+    };
+
+    struct GpuZone
+    {
+        const char *name;
+        GLuint startQuery;
+        GLuint endQuery;
+        uint32_t depth;
+    };
+
+    // The GPU zones of one frame, and how to move their timestamps onto the profiler's clock
+    struct GpuFrame
+    {
+        std::vector<GpuZone> zones;
+        int64_t clockOffset;
+        bool pending;
+    };
+
+    struct ZoneHistory
+    {
+        std::vector<double> samples;                                // A ring of the last ZONE_WINDOW durations, in ms
+        size_t next;
+    };
+
+    ThreadBuffer &getThreadBuffer();
+    void collect(const ProfileEvent &event);
+    void beginGpuFrame();
+    bool readGpuFrame(GpuFrame &frame);
+    void releaseQueries(GpuFrame &frame);
+    GLuint getQuery();
+    static bool computeStats(const ZoneHistory &zone, ZoneStats &stats);
+
+    std::mutex threadsMutex;                                        // Only taken when a thread records its first event
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    std::vector<std::string> threadNames;
+
+    bool gpuChecked;                                                // Whether we've looked for timer queries yet, which needs a context
+    bool gpuSupported;
+    bool gpuFrameStarted;
+    GpuFrame gpuFrames[GPU_FRAME_LATENCY];
+    size_t gpuFrameIndex;
+    std::vector<size_t> openGpuZones;                               // Indices into the current frame's zones
+    std::vector<GLuint> freeQueries;
+    size_t droppedGpuFrames;
+
+    std::vector<ProfileEvent> trace;
+    std::map<std::string, ZoneHistory> cpuHistory;
+    std::map<std::string, ZoneHistory> gpuHistory;
+
+};
+
+/*
+ * Times the enclosing scope as a CPU zone of the calling thread, e.g.
+ *
+ *     {
+ *         ProfileScope zone("Cube pass");
+ *         ...
+ *     }
+ *
+ * or up to an earlier end(). Zones of a thread have to end in the reverse order they started in.
+ */
+class ProfileScope
+{
+
+public:
+
+    explicit ProfileScope(const char *name);
+    ~ProfileScope();
+    void end();
+
+private:
+
+    const char *name;
+    uint64_t start;
+    bool ended;
+
+};
+
+#endif
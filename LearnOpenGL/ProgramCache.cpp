@@ -0,0 +1,147 @@
+#include "ProgramCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+#include "Hash.h"
+
+static const char PROGRAM_CACHE_MAGIC[4] = { 'L', 'G', 'P', 'B' };
+
+// Hashing the length first keeps ("ab", "c") and ("a", "bc") from colliding
+static uint64_t hashString(const char *str, uint64_t hash)
+{
+    uint64_t length = str ? std::strlen(str) : 0;
+    hash = fnv1a(&length, sizeof(length), hash);
+    return fnv1a(str, length, hash);
+}
+
+// ===============================
+// Public member functions
+// ===============================
+
+ProgramCache::ProgramCache(const std::string &directory) : directory(directory)
+{
+
+}
+
+ProgramCache &ProgramCache::getInstance()
+{
+    static ProgramCache cache("shadercache");
+    return cache;
+}
+
+// Program binaries are core in 4.1; on older contexts the extension has to be there, and even then a driver may offer no formats
+bool ProgramCache::isSupported() const
+{
+    if (!GLEW_ARB_get_program_binary) return false;
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+uint64_t ProgramCache::computeKey(const std::string &vertShaderSrc, const std::string &fragShaderSrc) const
+{
+    uint32_t version = VERSION;                                     // Bumping VERSION invalidates every cached binary
+    uint64_t key = fnv1a(&version, sizeof(version));
+    key = hashString(reinterpret_cast<const char*>(glGetString(GL_VENDOR)), key);
+    key = hashString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)), key);
+    key = hashString(reinterpret_cast<const char*>(glGetString(GL_VERSION)), key);
+    key = hashString(vertShaderSrc.c_str(), key);
+    return hashString(fragShaderSrc.c_str(), key);
+}
+
+bool ProgramCache::load(GLuint programID, uint64_t key) const
+{
+    std::ifstream stream(getPath(key), std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) return false;
+    std::streamoff fileSize = stream.tellg();
+    stream.seekg(0);
+
+    // The binary has to fill the rest of the file exactly, so a corrupt length can't make us allocate (or read) garbage
+    ProgramCacheHeader header;
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.key != key ||
+        header.binaryLength == 0 ||
+        static_cast<std::streamoff>(header.binaryLength) != fileSize - static_cast<std::streamoff>(sizeof(header)))
+        return false;
+
+    std::vector<char> binary(header.binaryLength);
+    if (!stream.read(binary.data(), binary.size())) return false;
+
+    glProgramBinary(programID, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint success = 0;
+    glGetProgramiv(programID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // An unknown format raises GL_INVALID_ENUM; don't leave it behind for someone else's glGetError
+        while (glGetError() != GL_NO_ERROR) {}
+        std::cout << "Driver rejected cached program binary " << getPath(key) << ", compiling from source." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set, or the driver is
+ * free to hand back nothing at all.
+ */
+bool ProgramCache::store(GLuint programID, uint64_t key) const
+{
+    GLint binaryLength = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) return false;
+
+    std::vector<char> binary(binaryLength);
+    GLenum binaryFormat = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(programID, binaryLength, &written, &binaryFormat, binary.data());
+    if (written <= 0) return false;
+
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        std::cerr << "Failed to create program cache directory " << directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    ProgramCacheHeader header;
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    header.version = VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.binaryLength = static_cast<uint32_t>(written);
+
+    // Same as the mesh cache: write next to it and rename, so readers never see half a file
+    std::string cachePath = getPath(key);
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        std::cerr << "Failed to open program cache for writing: " << cachePath << std::endl;
+        return false;
+    }
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(binary.data(), written);
+    stream.close();
+
+    if (!stream || std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::cerr << "Failed to write program cache: " << cachePath << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string ProgramCache::getPath(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
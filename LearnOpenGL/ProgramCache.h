@@ -0,0 +1,46 @@
+#ifndef __LearnOpenGL__ProgramCache__
+#define __LearnOpenGL__ProgramCache__
+
+#include <cstdint>
+#include <string>
+#include <GL/glew.h>
+
+// Every cached program is a ProgramCacheHeader followed by binaryLength bytes of driver specific binary
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+/*
+ * Keeps linked programs on disk (one file per program, named after its key) so that later launches
+ * can hand the driver a ready made binary through glProgramBinary instead of compiling and linking
+ * the sources again. A binary is only meaningful to the driver that produced it, which is why the
+ * key covers the GL vendor, renderer and version strings as well as the sources. Drivers may still
+ * reject a binary, e.g. after an update that kept the version string: load() then fails and the
+ * caller is expected to build the program from source and store() it again.
+ */
+class ProgramCache
+{
+
+public:
+
+    explicit ProgramCache(const std::string &directory);
+    static ProgramCache &getInstance();
+    bool isSupported() const;
+    uint64_t computeKey(const std::string &vertShaderSrc, const std::string &fragShaderSrc) const;
+    bool load(GLuint programID, uint64_t key) const;
+    bool store(GLuint programID, uint64_t key) const;
+    std::string getPath(uint64_t key) const;
+
+private:
+
+    std::string directory;
+    static const uint32_t VERSION = 1;
+
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include "GlState.h"
+#include "Hash.h"
+#include "Profiler.h"
+#include "Transform.h"
+
+static const int PROGRAM_BITS = 10;
+static const int MATERIAL_BITS = 14;
+static const int VERTEX_ARRAY_BITS = 12;
+static const int DEPTH_BITS = 24;
+static const int UNUSED_BITS = 3;                                   // At the bottom of both layouts
+static const uint64_t TRANSLUCENT_BIT = 1ULL << 63;
+
+static uint64_t maskBits(uint32_t value, int bits)
+{
+    return value & ((1u << bits) - 1);
+}
+
+/*
+ * Positive IEEE floats compare the same way as their bit patterns, so the top 24 of the 31 bits that
+ * can be set give us a depth that needs no near and far plane, and keeps most of its precision close
+ * to the camera. Anything behind the camera sorts as closest.
+ */
+static uint32_t quantizeDepth(float depth)
+{
+    if (!(depth > 0.0f)) return 0;
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> (31 - DEPTH_BITS);
+}
+
+// ===============================
+// Public member functions
+// ===============================
+
+RenderQueue::RenderQueue() : stats()
+{
+
+}
+
+void RenderQueue::submit(const DrawItem &item)
+{
+    uint32_t program = getProgramID(item.program);
+    uint32_t material = getMaterialID(item.mesh->getTextures(), item.mesh->getShininess());
+    uint32_t vertexArray = getVertexArrayID(item.mesh->getVAO());
+    keys.push_back(encodeKey(program, material, vertexArray, item.depth, item.translucent));
+    items.push_back(item);
+}
+
+/*
+ * Sorts keys in place, carrying order along, so keys[i] is always the key of items[order[i]]. Items
+ * submitted since the last sort are appended to order in submission order, so sorting again (e.g.
+ * after more submissions) still works.
+ */
+void RenderQueue::sort()
+{
+    for (uint32_t i = static_cast<uint32_t>(order.size()); i < items.size(); ++i)
+        order.push_back(i);
+    radixSort(keys, order, scratchKeys, scratchOrder);
+}
+
+/*
+ * Draws everything in the order sort() left it in, followed by whatever was submitted since, in
+ * submission order. Textures are only bound again when the material actually changes; GlState
+ * already drops VAO binds that wouldn't change anything, so we only count those. Consecutive draws
+ * with the same profiler zone are timed together, as one GPU zone.
+ */
+void RenderQueue::execute(const glm::mat4 &viewProjection)
+{
+    for (uint32_t i = static_cast<uint32_t>(order.size()); i < items.size(); ++i)
+        order.push_back(i);
+
+    GlState &state = GlState::getInstance();
+    Profiler &profiler = Profiler::getInstance();
+    stats = RenderQueueStats();
+    GlslProgram *currentProgram = nullptr;
+    ProgramUniforms *uniforms = nullptr;
+    const Mesh *materialMesh = nullptr;                             // The last mesh whose textures we bound
+    GLuint currentVertexArray = 0;
+    const char *currentZone = nullptr;
+    for (uint32_t index: order)
+    {
+        const DrawItem &item = items[index];
+        if (item.zone != currentZone)
+        {
+            if (currentZone) profiler.endGpuZone();
+            if (item.zone) profiler.beginGpuZone(item.zone);
+            currentZone = item.zone;
+        }
+        if (item.program != currentProgram)
+        {
+            item.program->begin();
+            currentProgram = item.program;
+            uniforms = &programUniforms[programIDs[currentProgram]];
+            materialMesh = nullptr;                                 // Sampler uniforms belong to the program
+            ++stats.programChanges;
+        }
+        if (!materialMesh || !sameMaterial(*materialMesh, *item.mesh))
+        {
+            item.mesh->bindTextures(*currentProgram);
+            materialMesh = item.mesh;
+            ++stats.materialChanges;
+        }
+        if (stats.draws == 0 || item.mesh->getVAO() != currentVertexArray)
+        {
+            currentVertexArray = item.mesh->getVAO();
+            ++stats.vertexArrayChanges;
+        }
+        state.bindVertexArray(currentVertexArray);
+
+        if (item.instances)
+        {
+            item.mesh->drawInstancedElements(*item.instances);
+        }
+        else
+        {
+            if (!uniforms->resolved)
+            {
+                uniforms->model = currentProgram->getUniform("uModel");
+                uniforms->modelViewProjection = currentProgram->getUniform("uModelViewProjection");
+                uniforms->normalMatrix = currentProgram->getUniform("uNormalMatrix");
+                uniforms->resolved = true;
+            }
+            glm::mat4 model = item.transform * item.vertexTransform;
+            currentProgram->set(uniforms->model, model);
+            currentProgram->set(uniforms->modelViewProjection, viewProjection * model);
+            currentProgram->set(uniforms->normalMatrix, computeNormalMatrix(item.transform));
+            item.mesh->drawElements(item.lod);
+        }
+        ++stats.draws;
+    }
+    if (currentZone) profiler.endGpuZone();
+}
+
+// The IDs handed out so far stay valid, so the same state keeps sorting the same way from frame to frame
+void RenderQueue::clear()
+{
+    items.clear();
+    keys.clear();
+    order.clear();
+}
+
+uint64_t RenderQueue::encodeKey(uint32_t program, uint32_t material, uint32_t vertexArray, float depth, bool translucent)
+{
+    uint64_t state = maskBits(program, PROGRAM_BITS) << (MATERIAL_BITS + VERTEX_ARRAY_BITS) |
+                     maskBits(material, MATERIAL_BITS) << VERTEX_ARRAY_BITS |
+                     maskBits(vertexArray, VERTEX_ARRAY_BITS);
+    uint64_t depthBits = quantizeDepth(depth);
+    if (!translucent)
+        return state << (DEPTH_BITS + UNUSED_BITS) | depthBits << UNUSED_BITS;
+
+    uint64_t invertedDepth = ((1u << DEPTH_BITS) - 1) - depthBits;
+    return TRANSLUCENT_BIT | invertedDepth << (PROGRAM_BITS + MATERIAL_BITS + VERTEX_ARRAY_BITS + UNUSED_BITS) | state << UNUSED_BITS;
+}
+
+/*
+ * Least significant digit radix sort, a byte per pass, that carries order along with the keys. One read
+ * of the keys builds all eight histograms up front, which also tells us which bytes are the same in
+ * every key: those passes wouldn't move anything and are skipped (e.g. the unused bits, or the
+ * program bits in a scene with a single program). Stable, so equal keys keep their submission order.
+ */
+void RenderQueue::radixSort(std::vector<uint64_t> &keys, std::vector<uint32_t> &order, std::vector<uint64_t> &scratchKeys, std::vector<uint32_t> &scratchOrder)
+{
+    size_t count = keys.size();
+    if (count < 2) return;
+    scratchKeys.resize(count);
+    scratchOrder.resize(count);
+
+    size_t histograms[8][256] = {};
+    for (uint64_t key: keys)
+    {
+        for (int byte = 0; byte < 8; ++byte)
+            ++histograms[byte][(key >> (byte * 8)) & 0xFF];
+    }
+
+    for (int byte = 0; byte < 8; ++byte)
+    {
+        size_t *histogram = histograms[byte];
+        if (histogram[(keys[0] >> (byte * 8)) & 0xFF] == count) continue;
+
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t destination = histogram[(keys[i] >> (byte * 8)) & 0xFF]++;
+            scratchKeys[destination] = keys[i];
+            scratchOrder[destination] = order[i];
+        }
+        keys.swap(scratchKeys);
+        order.swap(scratchOrder);
+    }
+}
+
+// Walks keys in the given order and counts how often the program, material or VAO bits change
+RenderQueueStats RenderQueue::countStateChanges(const std::vector<uint64_t> &keys, const std::vector<uint32_t> &order)
+{
+    RenderQueueStats changes = RenderQueueStats();
+    uint64_t previous[3] = {};
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        uint64_t key = keys[order[i]];
+        uint64_t state = key & TRANSLUCENT_BIT ? key >> UNUSED_BITS : key >> (DEPTH_BITS + UNUSED_BITS);
+        uint64_t fields[3] =
+        {
+            (state >> (MATERIAL_BITS + VERTEX_ARRAY_BITS)) & ((1u << PROGRAM_BITS) - 1),
+            (state >> VERTEX_ARRAY_BITS) & ((1u << (PROGRAM_BITS + MATERIAL_BITS)) - 1),   // A material is only the same under the same program
+            state & ((1u << VERTEX_ARRAY_BITS) - 1)
+        };
+        if (i == 0 || fields[0] != previous[0]) ++changes.programChanges;
+        if (i == 0 || fields[1] != previous[1]) ++changes.materialChanges;
+        if (i == 0 || fields[2] != previous[2]) ++changes.vertexArrayChanges;
+        std::memcpy(previous, fields, sizeof(fields));
+        ++changes.draws;
+    }
+    return changes;
+}
+
+/*
+ * Sorts the keys of a synthetic scene, which needs no GL context: objects are submitted one after
+ * another, each with its own VAO and a handful of parts whose materials (and with them, programs) are
+ * scattered across the scene, the way a scene graph or Assimp's node order hands them to us. A tenth
+ * of the parts are translucent.
+ */
+void RenderQueue::benchmark(std::ostream &stream, size_t itemCount)
+{
+    static const uint32_t PROGRAM_COUNT = 16;
+    static const uint32_t MATERIAL_COUNT = 512;
+    static const uint32_t MODEL_COUNT = 256;
+    static const int RUNS = 5;
+
+    /*
+     * A scene made like ours: models of 1 to 16 meshes, each mesh with its own VAO and textures (its
+     * material, which other meshes may share), drawn at random places in random order. A tenth of the
+     * materials are translucent.
+     */
+    std::mt19937 random(42);
+    std::uniform_int_distribution<uint32_t> pickMaterial(0, MATERIAL_COUNT - 1);
+    std::uniform_int_distribution<uint32_t> pickMeshCount(1, 16);
+    std::uniform_int_distribution<uint32_t> pickModel(0, MODEL_COUNT - 1);
+    std::uniform_real_distribution<float> pickDepth(0.1f, 500.0f);
+    std::vector<std::vector<uint32_t>> modelMaterials(MODEL_COUNT);  // Per model, the material of each mesh
+    std::vector<uint32_t> firstVertexArray(MODEL_COUNT);
+    uint32_t vertexArrayCount = 0;
+    for (uint32_t model = 0; model < MODEL_COUNT; ++model)
+    {
+        firstVertexArray[model] = vertexArrayCount;
+        for (uint32_t mesh = pickMeshCount(random); mesh > 0; --mesh)
+            modelMaterials[model].push_back(pickMaterial(random));
+        vertexArrayCount += static_cast<uint32_t>(modelMaterials[model].size());
+    }
+
+    std::vector<uint64_t> sceneKeys;
+    sceneKeys.reserve(itemCount);
+    while (sceneKeys.size() < itemCount)
+    {
+        uint32_t model = pickModel(random);
+        float depth = pickDepth(random);
+        for (size_t mesh = 0; mesh < modelMaterials[model].size() && sceneKeys.size() < itemCount; ++mesh)
+        {
+            uint32_t material = modelMaterials[model][mesh];
+            bool translucent = material % 10 == 0;
+            sceneKeys.push_back(encodeKey(material % PROGRAM_COUNT, material, firstVertexArray[model] + static_cast<uint32_t>(mesh), depth, translucent));
+        }
+    }
+
+    std::vector<uint32_t> identity(itemCount);
+    for (uint32_t i = 0; i < identity.size(); ++i)
+        identity[i] = i;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchOrder;
+    double radixMs = 1e30;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        keys = sceneKeys;
+        order = identity;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        radixSort(keys, order, scratchKeys, scratchOrder);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        radixMs = std::min(radixMs, elapsed.count());
+    }
+
+    // For comparison: std::sort on the same keys (unstable, but the keys are all we look at here)
+    double stdSortMs = 1e30;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        std::vector<uint64_t> sorted = sceneKeys;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::sort(sorted.begin(), sorted.end());
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        stdSortMs = std::min(stdSortMs, elapsed.count());
+    }
+
+    RenderQueueStats before = countStateChanges(sceneKeys, identity);
+    RenderQueueStats after = countStateChanges(sceneKeys, order);
+    stream << "Render queue: " << itemCount << " draws, " << PROGRAM_COUNT << " programs, " << MATERIAL_COUNT << " materials, " << vertexArrayCount << " VAOs" << std::endl;
+    stream << "  radix sort " << radixMs << " ms, std::sort " << stdSortMs << " ms (best of " << RUNS << ")" << std::endl;
+    stream << "  program changes  " << before.programChanges << " -> " << after.programChanges << std::endl;
+    stream << "  material changes " << before.materialChanges << " -> " << after.materialChanges << std::endl;
+    stream << "  VAO changes      " << before.vertexArrayChanges << " -> " << after.vertexArrayChanges << std::endl;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+uint32_t RenderQueue::getProgramID(GlslProgram *program)
+{
+    auto it = programIDs.find(program);
+    if (it != programIDs.end()) return it->second;
+
+    uint32_t id = static_cast<uint32_t>(programIDs.size());
+    programIDs[program] = id;
+    ProgramUniforms uniforms = ProgramUniforms();
+    programUniforms.push_back(uniforms);
+    return id;
+}
+
+// Identical texture sets and shininess share an ID. execute() compares the materials themselves, so a hash collision only costs sort quality
+uint32_t RenderQueue::getMaterialID(const std::vector<Texture> &textures, float shininess)
+{
+    uint64_t hash = fnv1a(&shininess, sizeof(shininess));
+    for (const auto &tex: textures)
+    {
+        const void *image = tex.img.get();
+        hash = fnv1a(&image, sizeof(image), hash);
+        hash = fnv1a(tex.type.data(), tex.type.size(), hash);
+    }
+
+    auto it = materialIDs.find(hash);
+    if (it != materialIDs.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(materialIDs.size());
+    materialIDs[hash] = id;
+    return id;
+}
+
+uint32_t RenderQueue::getVertexArrayID(GLuint vertexArray)
+{
+    auto it = vertexArrayIDs.find(vertexArray);
+    if (it != vertexArrayIDs.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(vertexArrayIDs.size());
+    vertexArrayIDs[vertexArray] = id;
+    return id;
+}
+
+// Same test as Model::findMaterial
+bool RenderQueue::sameMaterial(const Mesh &a, const Mesh &b)
+{
+    if (&a == &b) return true;
+    const std::vector<Texture> &aTextures = a.getTextures();
+    const std::vector<Texture> &bTextures = b.getTextures();
+    if (aTextures.size() != bTextures.size() || a.getShininess() != b.getShininess()) return false;
+    for (size_t i = 0; i < aTextures.size(); ++i)
+    {
+        if (aTextures[i].type != bTextures[i].type || aTextures[i].img != bTextures[i].img) return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef __LearnOpenGL__RenderQueue__
+#define __LearnOpenGL__RenderQueue__
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GlslProgram.h"
+#include "Mesh.h"
+
+/*
+ * One draw submitted to a RenderQueue. The mesh's textures are its material. Without instances the
+ * mesh is drawn once with transform, which the program receives as uModel, uModelViewProjection and
+ * uNormalMatrix (see shaders/lighting.vert); with instances it is drawn instanced instead (see
+ * Mesh::drawInstanced) and both transforms are ignored.
+ */
+struct DrawItem
+{
+    GlslProgram *program;
+    const Mesh *mesh;
+    size_t lod;
+    glm::mat4 transform;
+    glm::mat4 vertexTransform;                                      // Applied to positions only, before transform (see Model::getVertexTransform())
+    const std::vector<glm::mat4> *instances;
+    float depth;                                                    // View space distance, used to order draws that share all their state
+    bool translucent;
+    const char *zone;                                               // GPU profiler zone to time the draw in (see Profiler), or null
+};
+
+// How often consecutive draws had to switch state
+struct RenderQueueStats
+{
+    size_t draws;
+    size_t programChanges;
+    size_t materialChanges;
+    size_t vertexArrayChanges;
+};
+
+/*
+ * Collects a frame's draws and issues them in an order that keeps state changes down. Every item gets
+ * a 64-bit sort key, laid out (from the most significant bit down) as:
+ *
+ *     opaque:      0 | program (10) | material (14) | vertex array (12) | depth (24) | unused (3)
+ *     translucent: 1 | inverted depth (24) | program (10) | material (14) | vertex array (12) | unused (3)
+ *
+ * so opaque draws are grouped by program, then material, then VAO, and go front to back within a group
+ * (which lets early depth testing reject hidden fragments); translucent draws come after all of them,
+ * back to front, as blending requires. Programs, materials and VAOs are numbered in the order the queue
+ * first sees them, and keep their numbers from one frame to the next.
+ *
+ * Per-frame uniforms (view projection, lights, textures that aren't part of a mesh's material) aren't
+ * the queue's business: set them on each program before execute(), uniform values stay with the program.
+ */
+class RenderQueue
+{
+
+public:
+
+    RenderQueue();
+    void submit(const DrawItem &item);
+    void sort();
+    void execute(const glm::mat4 &viewProjection);
+    void clear();
+    size_t size() const { return items.size(); }
+    const RenderQueueStats &getStats() const { return stats; }
+
+    static uint64_t encodeKey(uint32_t program, uint32_t material, uint32_t vertexArray, float depth, bool translucent);
+    static void radixSort(std::vector<uint64_t> &keys, std::vector<uint32_t> &order, std::vector<uint64_t> &scratchKeys, std::vector<uint32_t> &scratchOrder);
+    static RenderQueueStats countStateChanges(const std::vector<uint64_t> &keys, const std::vector<uint32_t> &order);
+    static void benchmark(std::ostream &stream, size_t itemCount = 1 << 20);
+
+private:
+
+    // Uniform handles for single draws, resolved the first time a program draws one
+    struct ProgramUniforms
+    {
+        bool resolved;
+        UniformHandle model;
+        UniformHandle modelViewProjection;
+        UniformHandle normalMatrix;
+    };
+
+    uint32_t getProgramID(GlslProgram *program);
+    uint32_t getMaterialID(const std::vector<Texture> &textures, float shininess);
+    uint32_t getVertexArrayID(GLuint vertexArray);
+    static bool sameMaterial(const Mesh &a, const Mesh &b);
+
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys;                                     // keys[i] belongs to items[order[i]]
+    std::vector<uint32_t> order;                                    // Indices into items, in draw order once sorted
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchOrder;
+    std::unordered_map<GlslProgram*, uint32_t> programIDs;
+    std::unordered_map<uint64_t, uint32_t> materialIDs;             // Keyed by a hash of the textures and shininess
+    std::unordered_map<GLuint, uint32_t> vertexArrayIDs;
+    std::vector<ProgramUniforms> programUniforms;                   // Indexed by program ID
+    RenderQueueStats stats;
+
+};
+
+#endif
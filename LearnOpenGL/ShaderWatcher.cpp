@@ -0,0 +1,179 @@
+#include "ShaderWatcher.h"
+
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// ===============================
+// Public member functions
+// ===============================
+
+ShaderWatcher::ShaderWatcher(int pollIntervalMs, bool forcePolling) : pollInterval(pollIntervalMs), inotifyFD(-1), stopping(false)
+{
+#ifdef __linux__
+    if (!forcePolling) inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFD == -1 && !forcePolling)
+        std::cerr << "inotify is unavailable, polling shader files for changes instead." << std::endl;
+#else
+    (void)forcePolling;
+#endif
+    watcher = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    stopping = true;
+    watcher.join();
+    if (inotifyFD != -1) close(inotifyFD);
+}
+
+// Programs set up from source have nothing to watch, and are ignored
+void ShaderWatcher::watch(GlslProgram &program)
+{
+    if (program.getVertShaderPath().empty() || program.getFragShaderPath().empty()) return;
+    programs.push_back(&program);
+    addFile(program.getVertShaderPath());
+    addFile(program.getFragShaderPath());
+}
+
+void ShaderWatcher::addFile(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (watchedFiles.count(path)) return;
+
+    struct stat info;
+    FileStamp stamp = { 0, 0 };
+    if (stat(path.c_str(), &info) == 0)
+    {
+        stamp.modified = info.st_mtime;
+        stamp.size = info.st_size;
+    }
+    watchedFiles[path] = stamp;
+
+#ifdef __linux__
+    if (inotifyFD != -1)
+    {
+        // Adding a directory we already watch hands back its existing descriptor
+        std::string directory = getDirectory(path);
+        int wd = inotify_add_watch(inotifyFD, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd == -1)
+            std::cerr << "Failed to watch " << directory << " for shader changes." << std::endl;
+        else
+            watchedDirectories[wd] = directory;
+    }
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::takeChangedFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> files(changedFiles.begin(), changedFiles.end());
+    changedFiles.clear();
+    return files;
+}
+
+/*
+ * Reloads every watched program that uses a file changed since the last call, and returns how many
+ * were reloaded successfully. Call it between frames, while none of the programs is in use.
+ */
+size_t ShaderWatcher::update()
+{
+    std::vector<std::string> files = takeChangedFiles();
+    if (files.empty()) return 0;
+
+    size_t reloaded = 0;
+    for (GlslProgram *program: programs)
+    {
+        bool changed = false;
+        for (const auto &file: files)
+            changed = changed || file == program->getVertShaderPath() || file == program->getFragShaderPath();
+        if (!changed) continue;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (program->reload())
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+            std::cout << "Reloaded " << program->getVertShaderPath() << " and " << program->getFragShaderPath() << " in " << elapsed.count() << " ms." << std::endl;
+            ++reloaded;
+        }
+    }
+    return reloaded;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+void ShaderWatcher::watchLoop()
+{
+    while (!stopping)
+    {
+        if (inotifyFD == -1)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollInterval));
+            pollFiles();
+            continue;
+        }
+
+#ifdef __linux__
+        // Wake up every so often even without events, to notice that we're being destroyed
+        pollfd descriptor = { inotifyFD, POLLIN, 0 };
+        if (poll(&descriptor, 1, pollInterval) <= 0) continue;
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (char *next = buffer; next < buffer + length; next += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(next)->len)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event*>(next);
+                auto directory = watchedDirectories.find(event->wd);
+                if (event->len == 0 || directory == watchedDirectories.end()) continue;
+
+                // Other files in the same directory (editor backups and the like) are none of our business
+                for (const auto &file: watchedFiles)
+                {
+                    if (getFileName(file.first) == event->name && getDirectory(file.first) == directory->second)
+                        changedFiles.insert(file.first);
+                }
+            }
+        }
+#endif
+    }
+}
+
+// Without inotify, a file counts as changed once its modification time or size differs from what we saw last
+void ShaderWatcher::pollFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &file: watchedFiles)
+    {
+        struct stat info;
+        if (stat(file.first.c_str(), &info) != 0) continue;        // Mid-save, most likely; try again next time
+        if (info.st_mtime != file.second.modified || info.st_size != file.second.size)
+        {
+            file.second.modified = info.st_mtime;
+            file.second.size = info.st_size;
+            changedFiles.insert(file.first);
+        }
+    }
+}
+
+std::string ShaderWatcher::getDirectory(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string ShaderWatcher::getFileName(const std::string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
@@ -0,0 +1,67 @@
+#ifndef __LearnOpenGL__ShaderWatcher__
+#define __LearnOpenGL__ShaderWatcher__
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "GlslProgram.h"
+
+/*
+ * Watches shader files on a background thread and reloads the programs built from them, so shaders
+ * can be edited while the application keeps running. On Linux the thread blocks on inotify; we watch
+ * the directories rather than the files themselves, because most editors save by writing a new file
+ * and renaming it over the old one. Elsewhere (or when asked to with forcePolling) the thread compares
+ * modification times a few times a second instead.
+ *
+ * The watcher thread only records which files changed: update(), called between frames on the thread
+ * that owns the GL context, does the actual recompiling (see GlslProgram::reload()).
+ */
+class ShaderWatcher
+{
+
+public:
+
+    explicit ShaderWatcher(int pollIntervalMs = 250, bool forcePolling = false);
+    ~ShaderWatcher();
+    ShaderWatcher(const ShaderWatcher &) = delete;
+    ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+    void watch(GlslProgram &program);
+    void addFile(const std::string &path);
+    std::vector<std::string> takeChangedFiles();
+    size_t update();
+    bool isPolling() const { return inotifyFD == -1; }
+
+private:
+
+    struct FileStamp
+    {
+        time_t modified;
+        off_t size;
+    };
+
+    void watchLoop();
+    void pollFiles();
+    static std::string getDirectory(const std::string &path);
+    static std::string getFileName(const std::string &path);
+
+    int pollInterval;
+    int inotifyFD;                                                  // -1 when polling
+    std::vector<GlslProgram*> programs;
+
+    // Shared with the watcher thread
+    std::mutex mutex;
+    std::unordered_map<int, std::string> watchedDirectories;        // inotify watch descriptor -> directory
+    std::unordered_map<std::string, FileStamp> watchedFiles;
+    std::set<std::string> changedFiles;
+    std::atomic<bool> stopping;
+    std::thread watcher;
+
+};
+
+#endif
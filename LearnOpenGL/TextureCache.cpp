@@ -0,0 +1,163 @@
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include <algorithm>
+
+// ===============================
+// Public member functions
+// ===============================
+
+/*
+ * Decoding is spread over TextureLoader's worker threads. We count what's resident on both sides:
+ * the texture and its mipmaps on the GPU, and the pixels Image keeps (if it was told to).
+ */
+void GLTextureBackend::load(const std::vector<std::string> &paths, std::vector<Image> &images, std::vector<size_t> &sizes)
+{
+    TextureLoader loader;
+    images = loader.loadImages(paths);
+    loader.printTimings(std::cout);
+
+    sizes.resize(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        size_t pixelBytes = images[i].getPixelData() ? static_cast<size_t>(images[i].getWidth()) * images[i].getHeight() * 3 : 0;
+        sizes[i] = images[i].getTextureRef() ? images[i].getGPUBytes() + pixelBytes : 0;
+    }
+}
+
+void GLTextureBackend::release(Image &image)
+{
+    image.release();
+}
+
+TextureCache::TextureCache(TextureBackend &textureBackend) : backend(textureBackend), stats()
+{
+
+}
+
+TextureCache &TextureCache::getInstance()
+{
+    static GLTextureBackend glBackend;
+    static TextureCache cache(glBackend);
+    return cache;
+}
+
+TextureHandle TextureCache::load(const std::string &path)
+{
+    return load(std::vector<std::string>(1, path))[0];
+}
+
+/*
+ * Loads every texture that isn't resident yet in one batch, so that they all get decoded in parallel.
+ */
+std::vector<TextureHandle> TextureCache::load(const std::vector<std::string> &paths)
+{
+    std::vector<TextureHandle> handles(paths.size());
+    std::vector<std::string> missingKeys;
+    std::vector<std::string> missingPaths;
+    std::vector<size_t> missingIndices(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        std::string key = normalizePath(paths[i]);
+        auto entry = entries.find(key);
+        if (entry != entries.end() && (handles[i] = entry->second.texture.lock()))
+        {
+            ++stats.hits;
+            continue;
+        }
+
+        // The same file can be listed more than once; only the first one is a miss
+        missingIndices[i] = std::find(missingKeys.begin(), missingKeys.end(), key) - missingKeys.begin();
+        if (missingIndices[i] == missingKeys.size())
+        {
+            missingKeys.push_back(key);
+            missingPaths.push_back(paths[i]);
+            ++stats.misses;
+        }
+        else
+            ++stats.hits;
+    }
+    if (missingKeys.empty()) return handles;
+
+    std::vector<Image> images;
+    std::vector<size_t> sizes;
+    backend.load(missingPaths, images, sizes);
+
+    std::vector<TextureHandle> loaded(missingKeys.size());
+    for (size_t i = 0; i < missingKeys.size(); ++i)
+    {
+        // Failed textures are cached too (as texture 0), so that every reference doesn't retry them
+        if (sizes[i] == 0)
+        {
+            ++stats.failures;
+            std::cerr << "Failed to load texture: " << missingPaths[i] << std::endl;
+        }
+        loaded[i] = insert(missingKeys[i], images[i], sizes[i]);
+    }
+
+    for (size_t i = 0; i < paths.size(); ++i)
+        if (!handles[i]) handles[i] = loaded[missingIndices[i]];
+    return handles;
+}
+
+void TextureCache::printStats(std::ostream &stream) const
+{
+    stream << "Texture cache: " << stats.hits << " hits, " << stats.misses << " misses (" << stats.failures << " failed), "
+           << stats.residentTextures << " textures resident in " << stats.residentBytes / 1024 << " KB." << std::endl;
+}
+
+/*
+ * Turns equivalent spellings of a path ("a//b", "a/./b", "a/c/../b") into the same key. This is
+ * purely lexical, so it doesn't need the file to exist, but it also won't see through symlinks.
+ */
+std::string TextureCache::normalizePath(const std::string &path)
+{
+    bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find_first_of("/\\", start);
+        if (end == std::string::npos) end = path.size();
+        std::string part = path.substr(start, end - start);
+        start = end + 1;
+
+        if (part.empty() || part == ".") continue;
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else if (part != ".." || !absolute)
+            parts.push_back(part);
+    }
+
+    std::string normalized = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i)
+        normalized += (i ? "/" : "") + parts[i];
+    return normalized.empty() ? "." : normalized;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+TextureHandle TextureCache::insert(const std::string &key, const Image &image, size_t bytes)
+{
+    TextureHandle handle(new Image(image), [this, key](Image *texture) { release(key, texture); });
+    Entry entry = { handle, bytes };
+    entries[key] = entry;
+    ++stats.residentTextures;
+    stats.residentBytes += bytes;
+    return handle;
+}
+
+void TextureCache::release(const std::string &key, Image *image)
+{
+    auto entry = entries.find(key);
+    if (entry != entries.end())
+    {
+        stats.residentBytes -= entry->second.bytes;
+        --stats.residentTextures;
+        entries.erase(entry);
+    }
+
+    backend.release(*image);
+    delete image;
+}
@@ -0,0 +1,87 @@
+#ifndef __LearnOpenGL__TextureCache__
+#define __LearnOpenGL__TextureCache__
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Image.h"
+
+// Shared ownership of a cached texture; the texture is released once the last handle to it goes away
+typedef std::shared_ptr<const Image> TextureHandle;
+
+/*
+ * Where the cache gets its textures from. The default one decodes and uploads through Image and
+ * TextureLoader; substituting another one lets the cache be exercised without a GL context.
+ */
+class TextureBackend
+{
+
+public:
+
+    virtual ~TextureBackend() {}
+
+    // Fills in images[i] and the number of bytes it occupies (0 if it couldn't be loaded) for every path
+    virtual void load(const std::vector<std::string> &paths, std::vector<Image> &images, std::vector<size_t> &sizes) = 0;
+    virtual void release(Image &image) = 0;
+
+};
+
+class GLTextureBackend : public TextureBackend
+{
+
+public:
+
+    void load(const std::vector<std::string> &paths, std::vector<Image> &images, std::vector<size_t> &sizes) override;
+    void release(Image &image) override;
+
+};
+
+struct TextureCacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t failures;                                                // Misses that couldn't be loaded; cached all the same
+    size_t residentTextures;
+    size_t residentBytes;
+};
+
+/*
+ * Hands out one shared texture per file, however many meshes and Models reference it. Entries are
+ * keyed by the normalized path and only hold weak references, so a texture (GL object and pixels
+ * alike) is freed as soon as nothing uses it anymore. Since releasing a texture makes GL calls, the
+ * handles should only be dropped on the thread that owns the context, and the cache has to outlive
+ * every handle it gave out.
+ */
+class TextureCache
+{
+
+public:
+
+    explicit TextureCache(TextureBackend &textureBackend);
+    static TextureCache &getInstance();
+    TextureHandle load(const std::string &path);
+    std::vector<TextureHandle> load(const std::vector<std::string> &paths);
+    const TextureCacheStats &getStats() const { return stats; }
+    void printStats(std::ostream &stream) const;
+    static std::string normalizePath(const std::string &path);
+
+private:
+
+    struct Entry
+    {
+        std::weak_ptr<const Image> texture;
+        size_t bytes;
+    };
+
+    TextureHandle insert(const std::string &key, const Image &image, size_t bytes);
+    void release(const std::string &key, Image *image);
+
+    TextureBackend &backend;
+    std::unordered_map<std::string, Entry> entries;
+    TextureCacheStats stats;
+
+};
+
+#endif
@@ -0,0 +1,564 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+static const int REFINE_ITERATIONS = 2;                            // Least squares endpoint refinements per BC1 block
+static const uint32_t MAX_KTX_SIZE = 16384;                         // Texels across; larger headers are taken to be corrupt
+static const BlockFormat BLOCK_FORMATS[] = { BLOCK_FORMAT_BC1, BLOCK_FORMAT_BC3, BLOCK_FORMAT_BC5 };
+
+// The header fields that follow the identifier, in file order
+struct KTXHeader
+{
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// -------------------------------
+// BC1 colour blocks
+// -------------------------------
+
+static uint16_t packColor565(const float color[3])
+{
+    int r = std::min(31, std::max(0, static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f)));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(uint16_t color, int out[3])
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// The colours a BC1 block can pick from, in index order
+static int buildColorPalette(uint16_t color0, uint16_t color1, bool forceFourColors, int palette[4][3])
+{
+    unpackColor565(color0, palette[0]);
+    unpackColor565(color1, palette[1]);
+    bool fourColors = forceFourColors || color0 > color1;
+    for (int c = 0; c < 3; ++c)
+    {
+        if (fourColors)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    return fourColors ? 4 : 3;
+}
+
+// Picks the closest palette entry for every texel; returns the block's total squared error
+static int selectColorIndices(const uint8_t rgba[64], const int palette[4][3], int paletteSize, uint32_t &indices)
+{
+    int totalError = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int bestError = std::numeric_limits<int>::max();
+        uint32_t best = 0;
+        for (int p = 0; p < paletteSize; ++p)
+        {
+            int dr = rgba[i * 4] - palette[p][0];
+            int dg = rgba[i * 4 + 1] - palette[p][1];
+            int db = rgba[i * 4 + 2] - palette[p][2];
+            int error = dr * dr + dg * dg + db * db;
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= best << (2 * i);
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+/*
+ * Fits a line through the block's colours along their principal axis, uses the extremes of the
+ * projections onto it as endpoints, then refines those by least squares against the indices they
+ * produce. We always encode in four colour mode (color0 > color1); BC3's colour half requires it.
+ */
+static void encodeColorBlock(const uint8_t rgba[64], uint8_t *block)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };   // xx, xy, xz, yy, yz, zz
+    for (int i = 0; i < 16; ++i)
+    {
+        float d[3] = { rgba[i * 4] - mean[0], rgba[i * 4 + 1] - mean[1], rgba[i * 4 + 2] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // A few rounds of power iteration are plenty to find the dominant eigenvector of a 3x3 matrix
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (length < 1e-6f) break;                                  // A flat block: any axis will do
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+    float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    float minT = std::numeric_limits<float>::max();
+    float maxT = -std::numeric_limits<float>::max();
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = ((rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2]) / axisLength2;
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float endpoints[2][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        endpoints[0][c] = mean[c] + axis[c] * maxT;
+        endpoints[1][c] = mean[c] + axis[c] * minT;
+    }
+
+    uint16_t bestColors[2] = { 0, 0 };
+    uint32_t bestIndices = 0;
+    int bestError = std::numeric_limits<int>::max();
+    for (int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+    {
+        uint16_t colors[2] = { packColor565(endpoints[0]), packColor565(endpoints[1]) };
+        if (colors[0] < colors[1]) std::swap(colors[0], colors[1]);
+
+        // Equal endpoints put BC1 in three colour mode, where only index 0 still means color0
+        int palette[4][3];
+        int paletteSize = buildColorPalette(colors[0], colors[1], true, palette);
+        uint32_t indices = 0;
+        int error = selectColorIndices(rgba, palette, colors[0] == colors[1] ? 1 : paletteSize, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestColors[0] = colors[0];
+            bestColors[1] = colors[1];
+            bestIndices = indices;
+        }
+        if (bestError == 0 || colors[0] == colors[1]) break;
+
+        // Solve for the endpoints that best reproduce the block given each texel's blend weight
+        static const float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = { 0.0f, 0.0f, 0.0f };
+        float bx[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+        {
+            float a = WEIGHTS[(indices >> (2 * i)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; ++c)
+            {
+                ax[c] += a * rgba[i * 4 + c];
+                bx[c] += b * rgba[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) break;
+        for (int c = 0; c < 3; ++c)
+        {
+            endpoints[0][c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            endpoints[1][c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+    }
+
+    block[0] = bestColors[0] & 0xff;
+    block[1] = bestColors[0] >> 8;
+    block[2] = bestColors[1] & 0xff;
+    block[3] = bestColors[1] >> 8;
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (bestIndices >> (8 * i)) & 0xff;
+}
+
+static void decodeColorBlock(const uint8_t *block, bool forceFourColors, uint8_t rgba[64])
+{
+    uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+
+    int palette[4][3];
+    int paletteSize = buildColorPalette(color0, color1, forceFourColors, palette);
+    for (int i = 0; i < 16; ++i)
+    {
+        int index = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; ++c)
+            rgba[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+        rgba[i * 4 + 3] = (paletteSize == 3 && index == 3) ? 0 : 255;
+    }
+}
+
+// -------------------------------
+// BC4 single channel blocks (BC3's alpha, BC5's two channels)
+// -------------------------------
+
+static void buildChannelPalette(int value0, int value1, int palette[8])
+{
+    palette[0] = value0;
+    palette[1] = value1;
+    if (value0 > value1)
+    {
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+    }
+    else
+    {
+        for (int i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * value0 + i * value1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Reads the given channel of each texel; uses the eight value mode between the channel's extremes
+static void encodeChannelBlock(const uint8_t rgba[64], int channel, uint8_t *block)
+{
+    int minValue = 255;
+    int maxValue = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        minValue = std::min<int>(minValue, rgba[i * 4 + channel]);
+        maxValue = std::max<int>(maxValue, rgba[i * 4 + channel]);
+    }
+
+    int palette[8];
+    buildChannelPalette(maxValue, minValue, palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int value = rgba[i * 4 + channel];
+        int best = 0;
+        for (int p = 1; p < 8; ++p)
+            if (std::abs(palette[p] - value) < std::abs(palette[best] - value)) best = p;
+        indices |= static_cast<uint64_t>(best) << (3 * i);
+    }
+
+    block[0] = static_cast<uint8_t>(maxValue);
+    block[1] = static_cast<uint8_t>(minValue);
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+static void decodeChannelBlock(const uint8_t *block, int channel, uint8_t rgba[64])
+{
+    int palette[8];
+    buildChannelPalette(block[0], block[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        rgba[i * 4 + channel] = static_cast<uint8_t>(palette[(indices >> (3 * i)) & 7]);
+}
+
+// ===============================
+// Public functions
+// ===============================
+
+size_t getBlockSize(BlockFormat format)
+{
+    return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t getLevelSize(BlockFormat format, int width, int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+GLenum getInternalFormat(BlockFormat format)
+{
+    switch (format)
+    {
+        case BLOCK_FORMAT_BC1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BLOCK_FORMAT_BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        default:
+            return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+GLenum getBaseFormat(BlockFormat format)
+{
+    return format == BLOCK_FORMAT_BC1 ? GL_RGB : (format == BLOCK_FORMAT_BC3 ? GL_RGBA : GL_RG);
+}
+
+void encodeBlock(const uint8_t rgba[64], BlockFormat format, uint8_t *block)
+{
+    switch (format)
+    {
+        case BLOCK_FORMAT_BC1:
+            encodeColorBlock(rgba, block);
+            break;
+        case BLOCK_FORMAT_BC3:
+            encodeChannelBlock(rgba, 3, block);
+            encodeColorBlock(rgba, block + 8);
+            break;
+        case BLOCK_FORMAT_BC5:
+            encodeChannelBlock(rgba, 0, block);
+            encodeChannelBlock(rgba, 1, block + 8);
+            break;
+    }
+}
+
+// Channels a format doesn't store come back as 0 (colour) or 255 (alpha)
+void decodeBlock(const uint8_t *block, BlockFormat format, uint8_t rgba[64])
+{
+    switch (format)
+    {
+        case BLOCK_FORMAT_BC1:
+            decodeColorBlock(block, false, rgba);
+            break;
+        case BLOCK_FORMAT_BC3:
+            decodeColorBlock(block + 8, true, rgba);
+            decodeChannelBlock(block, 3, rgba);
+            break;
+        case BLOCK_FORMAT_BC5:
+            for (int i = 0; i < 16; ++i)
+            {
+                rgba[i * 4 + 2] = 0;
+                rgba[i * 4 + 3] = 255;
+            }
+            decodeChannelBlock(block, 0, rgba);
+            decodeChannelBlock(block + 8, 1, rgba);
+            break;
+    }
+}
+
+// Blocks are stored row by row; edge blocks of images that aren't a multiple of 4 repeat their last texels
+std::vector<uint8_t> compressImage(const uint8_t *rgba, int width, int height, BlockFormat format)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockSize = getBlockSize(format);
+    std::vector<uint8_t> blocks(blocksX * blocksY * blockSize);
+
+    uint8_t texels[64];
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                int x = std::min(bx * 4 + i % 4, width - 1);
+                int y = std::min(by * 4 + i / 4, height - 1);
+                std::memcpy(&texels[i * 4], &rgba[(static_cast<size_t>(y) * width + x) * 4], 4);
+            }
+            encodeBlock(texels, format, &blocks[(by * blocksX + bx) * blockSize]);
+        }
+    }
+    return blocks;
+}
+
+std::vector<uint8_t> decompressImage(const uint8_t *blocks, int width, int height, BlockFormat format)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockSize = getBlockSize(format);
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+
+    uint8_t texels[64];
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            decodeBlock(&blocks[(by * blocksX + bx) * blockSize], format, texels);
+            for (int i = 0; i < 16; ++i)
+            {
+                int x = bx * 4 + i % 4;
+                int y = by * 4 + i / 4;
+                if (x < width && y < height)
+                    std::memcpy(&rgba[(static_cast<size_t>(y) * width + x) * 4], &texels[i * 4], 4);
+            }
+        }
+    }
+    return rgba;
+}
+
+// Halves each dimension (down to 1) with a box filter, like glGenerateMipmap typically does
+std::vector<uint8_t> downsampleImage(const uint8_t *rgba, int width, int height)
+{
+    int newWidth = std::max(1, width / 2);
+    int newHeight = std::max(1, height / 2);
+    std::vector<uint8_t> result(static_cast<size_t>(newWidth) * newHeight * 4);
+
+    for (int y = 0; y < newHeight; ++y)
+    {
+        for (int x = 0; x < newWidth; ++x)
+        {
+            int x0 = std::min(x * 2, width - 1);
+            int x1 = std::min(x * 2 + 1, width - 1);
+            int y0 = std::min(y * 2, height - 1);
+            int y1 = std::min(y * 2 + 1, height - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                        + rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                result[(static_cast<size_t>(y) * newWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// Each level is downsampled from the uncompressed level above it, so errors don't compound
+CompressedTexture compressTexture(const uint8_t *rgba, int width, int height, BlockFormat format, bool generateMips)
+{
+    CompressedTexture texture;
+    texture.internalFormat = getInternalFormat(format);
+    texture.baseFormat = getBaseFormat(format);
+    texture.width = width;
+    texture.height = height;
+
+    std::vector<uint8_t> level(rgba, rgba + static_cast<size_t>(width) * height * 4);
+    while (true)
+    {
+        texture.levels.push_back(compressImage(&level[0], width, height, format));
+        if (!generateMips || (width == 1 && height == 1)) break;
+        level = downsampleImage(&level[0], width, height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return texture;
+}
+
+double computePSNR(const uint8_t *a, const uint8_t *b, int width, int height, int channels)
+{
+    double squaredError = 0.0;
+    size_t texels = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < texels; ++i)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            double difference = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+            squaredError += difference * difference;
+        }
+    }
+    double meanSquaredError = squaredError / (texels * channels);
+    if (meanSquaredError == 0.0) return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+bool writeKTX(const std::string &path, const CompressedTexture &texture)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    if (!stream) return false;
+
+    KTXHeader header = {};
+    header.endianness = KTX_ENDIANNESS;
+    header.glTypeSize = 1;                                          // glType and glFormat stay 0 for compressed data
+    header.glInternalFormat = texture.internalFormat;
+    header.glBaseInternalFormat = texture.baseFormat;
+    header.pixelWidth = texture.width;
+    header.pixelHeight = texture.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(texture.levels.size());
+
+    stream.write(reinterpret_cast<const char*>(KTX_IDENTIFIER), sizeof(KTX_IDENTIFIER));
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto &level: texture.levels)
+    {
+        // Blocks are 8 or 16 bytes, so the spec's padding to 4 byte boundaries never applies
+        uint32_t imageSize = static_cast<uint32_t>(level.size());
+        stream.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+        stream.write(reinterpret_cast<const char*>(level.data()), level.size());
+    }
+    return static_cast<bool>(stream);
+}
+
+/*
+ * Only reads what writeKTX writes: single 2D textures in one of our block formats, in our own byte
+ * order. The header is checked before anything is allocated, and every level's size against its
+ * dimensions and what's left of the file, so a corrupt file fails here instead of in the driver.
+ */
+bool readKTX(const std::string &path, CompressedTexture &texture)
+{
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    uint64_t fileSize = stream ? static_cast<uint64_t>(stream.tellg()) : 0;
+    stream.seekg(0);
+    uint8_t identifier[12];
+    KTXHeader header;
+    if (!stream.read(reinterpret_cast<char*>(identifier), sizeof(identifier)) || std::memcmp(identifier, KTX_IDENTIFIER, sizeof(identifier)) != 0 ||
+        !stream.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.endianness != KTX_ENDIANNESS)
+        return false;
+    if (header.glType != 0 || header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1) return false;
+
+    const BlockFormat *format = std::find_if(std::begin(BLOCK_FORMATS), std::end(BLOCK_FORMATS),
+                                             [&header](BlockFormat f) { return getInternalFormat(f) == header.glInternalFormat; });
+    if (format == std::end(BLOCK_FORMATS) || header.glBaseInternalFormat != getBaseFormat(*format)) return false;
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > MAX_KTX_SIZE || header.pixelHeight > MAX_KTX_SIZE) return false;
+
+    // A full chain runs down to 1x1, one level per halving of the larger side
+    uint32_t maxLevels = 1;
+    while ((std::max(header.pixelWidth, header.pixelHeight) >> maxLevels) > 0) ++maxLevels;
+    if (header.numberOfMipmapLevels > maxLevels) return false;
+
+    uint64_t offset = sizeof(identifier) + sizeof(header) + uint64_t(header.bytesOfKeyValueData);
+    if (offset > fileSize) return false;
+    stream.seekg(header.bytesOfKeyValueData, std::ios::cur);
+
+    texture.internalFormat = header.glInternalFormat;
+    texture.baseFormat = header.glBaseInternalFormat;
+    texture.width = header.pixelWidth;
+    texture.height = header.pixelHeight;
+    texture.levels.assign(std::max<uint32_t>(1, header.numberOfMipmapLevels), std::vector<uint8_t>());
+
+    int width = texture.width;
+    int height = texture.height;
+    for (auto &level: texture.levels)
+    {
+        uint32_t imageSize = 0;
+        if (!stream.read(reinterpret_cast<char*>(&imageSize), sizeof(imageSize))) return false;
+        offset += sizeof(imageSize);
+        if (imageSize != getLevelSize(*format, width, height) || imageSize > fileSize - offset) return false;
+
+        level.resize(imageSize);
+        if (!stream.read(reinterpret_cast<char*>(level.data()), imageSize)) return false;
+        offset += imageSize;
+        stream.seekg((4 - imageSize % 4) % 4, std::ios::cur);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
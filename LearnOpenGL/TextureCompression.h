@@ -0,0 +1,62 @@
+#ifndef __LearnOpenGL__TextureCompression__
+#define __LearnOpenGL__TextureCompression__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// S3TC is an extension rather than core OpenGL, so not every set of headers defines these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/*
+ * The block compressed formats we can encode. All of them work on 4x4 texel blocks:
+ * BC1 (DXT1) stores RGB in 8 bytes per block, 6:1 against our uncompressed RGB uploads;
+ * BC3 (DXT5) adds a separately encoded alpha channel for 16 bytes per block;
+ * BC5 (RGTC2) stores two independent channels in 16 bytes, meant for tangent space normal maps
+ * whose third component is reconstructed in the shader.
+ */
+enum BlockFormat
+{
+    BLOCK_FORMAT_BC1,
+    BLOCK_FORMAT_BC3,
+    BLOCK_FORMAT_BC5
+};
+
+// Everything glCompressedTexImage2D needs for each level of a compressed texture's mip chain
+struct CompressedTexture
+{
+    GLenum internalFormat;
+    GLenum baseFormat;
+    int width;
+    int height;
+    std::vector<std::vector<uint8_t>> levels;                       // Level 0 is the full resolution image
+};
+
+size_t getBlockSize(BlockFormat format);
+size_t getLevelSize(BlockFormat format, int width, int height);     // Bytes of blocks covering a width x height level
+GLenum getInternalFormat(BlockFormat format);
+GLenum getBaseFormat(BlockFormat format);
+
+// All of these take and produce tightly packed 8-bit RGBA
+void encodeBlock(const uint8_t rgba[64], BlockFormat format, uint8_t *block);
+void decodeBlock(const uint8_t *block, BlockFormat format, uint8_t rgba[64]);
+std::vector<uint8_t> compressImage(const uint8_t *rgba, int width, int height, BlockFormat format);
+std::vector<uint8_t> decompressImage(const uint8_t *blocks, int width, int height, BlockFormat format);
+std::vector<uint8_t> downsampleImage(const uint8_t *rgba, int width, int height);
+CompressedTexture compressTexture(const uint8_t *rgba, int width, int height, BlockFormat format, bool generateMips = true);
+
+// Peak signal to noise ratio over the first `channels` channels of two RGBA images, in dB
+double computePSNR(const uint8_t *a, const uint8_t *b, int width, int height, int channels);
+
+// KTX 1.1 files (https://www.khronos.org/opengles/sdk/tools/KTX/file_format_spec/)
+bool writeKTX(const std::string &path, const CompressedTexture &texture);
+bool readKTX(const std::string &path, CompressedTexture &texture);
+
+#endif
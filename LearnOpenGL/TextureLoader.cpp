@@ -0,0 +1,77 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+// ===============================
+// Public member functions
+// ===============================
+
+TextureLoader::TextureLoader(unsigned int maxThreads) : numThreads(maxThreads), wallTimeMs(0.0)
+{
+    // hardware_concurrency() is allowed to return 0 when it can't tell
+    if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<Image> TextureLoader::loadImages(const std::vector<std::string> &imagePaths)
+{
+    auto startTime = Clock::now();
+    std::vector<Image> images(imagePaths.size());
+    timings.assign(imagePaths.size(), TextureLoadTiming());
+
+    /*
+     * Each worker grabs the next undecoded image off a shared counter, so a handful of large maps
+     * don't end up serialized on the same thread. Workers only ever write to their own slots in
+     * the images and timings vectors, which is why no further locking is needed.
+     */
+    std::atomic<size_t> nextImage(0);
+    auto decodeWorker = [&]()
+    {
+        for (size_t i = nextImage++; i < imagePaths.size(); i = nextImage++)
+        {
+            auto decodeStart = Clock::now();
+            if (!images[i].decode(imagePaths[i]))
+                std::cerr << "Failed to decode image: " << imagePaths[i] << std::endl;
+            timings[i].path = imagePaths[i];
+            timings[i].decodeMs = Milliseconds(Clock::now() - decodeStart).count();
+        }
+    };
+
+    size_t workerCount = std::min<size_t>(numThreads, imagePaths.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < workerCount; ++i)
+        workers.push_back(std::thread(decodeWorker));
+    decodeWorker();                                                 // The calling thread pulls its weight too
+    for (auto &worker: workers)
+        worker.join();
+
+    // GL calls have to stay on the thread that owns the context
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        auto uploadStart = Clock::now();
+        if (images[i].isDecoded()) images[i].upload();
+        timings[i].uploadMs = Milliseconds(Clock::now() - uploadStart).count();
+    }
+
+    wallTimeMs = Milliseconds(Clock::now() - startTime).count();
+    return images;
+}
+
+void TextureLoader::printTimings(std::ostream &stream) const
+{
+    double totalDecodeMs = 0.0;
+    double totalUploadMs = 0.0;
+    for (const auto &timing: timings)
+    {
+        stream << "    " << timing.path << ": decode " << timing.decodeMs << " ms, upload " << timing.uploadMs << " ms" << std::endl;
+        totalDecodeMs += timing.decodeMs;
+        totalUploadMs += timing.uploadMs;
+    }
+    stream << "Loaded " << timings.size() << " textures on " << numThreads << " threads in " << wallTimeMs << " ms "
+           << "(decode " << totalDecodeMs << " ms summed over threads, upload " << totalUploadMs << " ms)." << std::endl;
+}
@@ -0,0 +1,40 @@
+#ifndef __LearnOpenGL__TextureLoader__
+#define __LearnOpenGL__TextureLoader__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Image.h"
+
+struct TextureLoadTiming
+{
+    std::string path;
+    double decodeMs;
+    double uploadMs;
+};
+
+/*
+ * Loads a batch of images in two phases: the (expensive) PNG/JPG decoding is spread across a pool
+ * of worker threads, and only once every image has been decoded do we upload them one by one on the
+ * calling thread, which must be the one that owns the GL context.
+ */
+class TextureLoader
+{
+
+public:
+
+    TextureLoader(unsigned int maxThreads = 0);
+    std::vector<Image> loadImages(const std::vector<std::string> &imagePaths);
+    const std::vector<TextureLoadTiming> &getTimings() const { return timings; }
+    double getWallTimeMs() const { return wallTimeMs; }
+    void printTimings(std::ostream &stream) const;
+
+private:
+
+    unsigned int numThreads;
+    std::vector<TextureLoadTiming> timings;
+    double wallTimeMs;
+
+};
+
+#endif
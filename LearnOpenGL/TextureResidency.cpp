@@ -0,0 +1,184 @@
+#include "TextureResidency.h"
+#include <algorithm>
+#include <vector>
+#include "GlState.h"
+
+static const int MIN_RESIDENT_SIZE = 64;                            // Never evict a texture below this many texels across
+
+// ===============================
+// Public member functions
+// ===============================
+
+TextureResidency::TextureResidency(size_t budgetBytes) : budget(budgetBytes), frame(0), stats()
+{
+
+}
+
+// Compressed textures aren't tracked: they're already small, and evicting through readback would inflate them
+void TextureResidency::track(const TextureHandle &texture, const std::string &path)
+{
+    if (texture->isCompressed()) return;
+
+    auto existing = records.find(texture.get());
+    if (existing != records.end() && !existing->second.texture.expired()) return;
+
+    Record record;
+    record.texture = texture;
+    record.path = path;
+    record.width = texture->getWidth();
+    record.height = texture->getHeight();
+    record.droppedLevels = 0;
+    record.lastUsed = frame;
+    record.restreamFailed = false;
+    records[texture.get()] = std::move(record);
+}
+
+void TextureResidency::touch(const TextureHandle &texture)
+{
+    auto found = records.find(texture.get());
+    if (found == records.end()) return;
+
+    Record &record = found->second;
+    record.lastUsed = frame;
+    if (record.droppedLevels > 0 && !record.restream.valid() && !record.restreamFailed)
+    {
+        // Only the decoding happens on the worker; the upload has to wait for update()
+        std::string path = record.path;
+        record.restream = std::async(std::launch::async, [path]()
+        {
+            Image image;
+            image.decode(path);
+            return image;
+        });
+    }
+}
+
+/*
+ * Uploads whatever finished decoding since the last call, then evicts mip levels from the least
+ * recently used textures until everything fits again. Textures touched since the last update are
+ * never evicted, so a frame that needs more than the budget goes over it rather than thrashing.
+ */
+void TextureResidency::update()
+{
+    for (auto it = records.begin(); it != records.end(); )
+    {
+        if (it->second.texture.expired())
+            it = records.erase(it);                                 // Waits for a pending decode to finish
+        else
+            ++it;
+    }
+
+    size_t residentBytes = 0;
+    std::vector<Record*> candidates;
+    for (auto &entry: records)
+    {
+        Record &record = entry.second;
+        if (record.restream.valid() && record.restream.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            finishRestream(record);
+
+        residentBytes += getResidentBytes(record);
+        if (record.lastUsed < frame && !record.restream.valid()) candidates.push_back(&record);
+    }
+
+    // Least recently used first; each may give up several levels before we move on to the next
+    std::sort(candidates.begin(), candidates.end(), [](const Record *a, const Record *b) { return a->lastUsed < b->lastUsed; });
+    for (size_t i = 0; i < candidates.size() && residentBytes > budget; )
+    {
+        Record &record = *candidates[i];
+        if (std::max(record.width, record.height) >> record.droppedLevels <= MIN_RESIDENT_SIZE)
+        {
+            ++i;
+            continue;
+        }
+        size_t before = getResidentBytes(record);
+        evictLevel(record);
+        residentBytes -= before - getResidentBytes(record);
+    }
+
+    stats.residentBytes = residentBytes;
+    stats.evictedBytes = 0;
+    for (const auto &entry: records)
+        stats.evictedBytes += getMipChainBytes(entry.second.width, entry.second.height) - getResidentBytes(entry.second);
+    ++frame;
+}
+
+void TextureResidency::printStats(std::ostream &stream) const
+{
+    stream << "Texture residency: " << stats.residentBytes / 1024 << " KB resident of a " << budget / 1024 << " KB budget, "
+           << stats.evictedBytes / 1024 << " KB evicted (" << stats.evictions << " levels dropped, " << stats.restreams << " textures restreamed)." << std::endl;
+}
+
+// Bytes an RGB texture of the given size takes up along with all of its mipmaps, as we upload it
+size_t TextureResidency::getMipChainBytes(int width, int height)
+{
+    size_t bytes = 0;
+    while (width > 0 && height > 0)
+    {
+        bytes += static_cast<size_t>(width) * height * 3;
+        if (width == 1 && height == 1) break;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return bytes;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+size_t TextureResidency::getResidentBytes(const Record &record) const
+{
+    return getMipChainBytes(std::max(1, record.width >> record.droppedLevels), std::max(1, record.height >> record.droppedLevels));
+}
+
+/*
+ * Drops the texture's most detailed level. OpenGL has no way to free a single mip level in place, so
+ * we read the next level back and respecify the texture from it, which keeps its name (and so every
+ * Image and handle pointing at it) intact.
+ */
+void TextureResidency::evictLevel(Record &record)
+{
+    TextureHandle texture = record.texture.lock();
+    int width = std::max(1, record.width >> (record.droppedLevels + 1));
+    int height = std::max(1, record.height >> (record.droppedLevels + 1));
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+
+    // Tightly packed RGB rows aren't necessarily a multiple of the default 4 byte alignment
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, texture->getTextureRef());
+    glGetTexImage(GL_TEXTURE_2D, 1, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    ++record.droppedLevels;
+    ++stats.evictions;
+}
+
+void TextureResidency::finishRestream(Record &record)
+{
+    Image image = record.restream.get();
+    TextureHandle texture = record.texture.lock();
+    if (!image.getPixelData())
+    {
+        std::cerr << "Failed to restream texture: " << record.path << std::endl;
+        record.restreamFailed = true;
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, texture->getTextureRef());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.getWidth(), image.getHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, image.getPixelData());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    GlState::getInstance().bindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    image.clearPixelData();
+
+    record.width = image.getWidth();
+    record.height = image.getHeight();
+    record.droppedLevels = 0;
+    ++stats.restreams;
+}
@@ -0,0 +1,68 @@
+#ifndef __LearnOpenGL__TextureResidency__
+#define __LearnOpenGL__TextureResidency__
+
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "TextureCache.h"
+
+struct TextureResidencyStats
+{
+    size_t residentBytes;                                           // GPU memory the tracked textures occupy right now
+    size_t evictedBytes;                                            // How much more they'd take at full resolution
+    size_t evictions;                                               // Mip levels dropped so far
+    size_t restreams;                                               // Textures brought back to full resolution so far
+};
+
+/*
+ * Keeps the textures it tracks within a GPU memory budget. When they don't fit, the least recently
+ * used ones lose their most detailed mip level, one level at a time; as soon as such a texture is
+ * used again, its file is decoded anew on a worker thread and uploaded at full resolution. A texture
+ * whose file can't be decoded any more stays at whatever resolution it was left at.
+ *
+ * Call touch() for every texture a frame draws with and update() once per frame, on the thread that
+ * owns the GL context. Textures are only tracked for as long as someone else holds on to them.
+ */
+class TextureResidency
+{
+
+public:
+
+    explicit TextureResidency(size_t budgetBytes);
+    void track(const TextureHandle &texture, const std::string &path);
+    void touch(const TextureHandle &texture);
+    void update();
+    void setBudget(size_t budgetBytes) { budget = budgetBytes; }
+    size_t getBudget() const { return budget; }
+    const TextureResidencyStats &getStats() const { return stats; }
+    void printStats(std::ostream &stream) const;
+    static size_t getMipChainBytes(int width, int height);
+
+private:
+
+    struct Record
+    {
+        std::weak_ptr<const Image> texture;
+        std::string path;
+        int width;                                                  // Full resolution
+        int height;
+        int droppedLevels;
+        size_t lastUsed;                                            // Frame number
+        std::future<Image> restream;                                // Valid while a full resolution copy is being decoded
+        bool restreamFailed;                                        // The file couldn't be decoded again, so don't keep trying
+    };
+
+    size_t getResidentBytes(const Record &record) const;
+    void evictLevel(Record &record);
+    void finishRestream(Record &record);
+
+    size_t budget;
+    size_t frame;
+    std::unordered_map<const Image*, Record> records;
+    TextureResidencyStats stats;
+
+};
+
+#endif
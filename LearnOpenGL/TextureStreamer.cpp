@@ -0,0 +1,250 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <iostream>
+#include "GlState.h"
+
+static const size_t RING_ALIGNMENT = 16;
+
+// ===============================
+// Public member functions
+// ===============================
+
+TextureStreamer::TextureStreamer(size_t ringBytes, size_t frameBudgetBytes, unsigned int maxThreads) :
+            ringSize(ringBytes), frameBudget(frameBudgetBytes), ringBuffer(0), mappedRing(nullptr), pendingCount(0), stopping(false)
+{
+    /*
+     * A persistent, coherent mapping stays valid while OpenGL reads from the buffer, so the workers
+     * can write into it directly; the fences are what keep them from overwriting data in use.
+     */
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &ringBuffer);
+        GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, flags);
+        mappedRing = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
+        GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    
+    // Leave a core for the GL thread
+    if (maxThreads == 0) maxThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (unsigned int i = 0; i < maxThreads; ++i)
+        workers.push_back(std::thread(&TextureStreamer::workerLoop, this));
+}
+
+// Requests that haven't finished yet are abandoned; their futures report a broken promise
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto &worker: workers)
+        worker.join();
+    
+    for (const auto &request: inFlight)
+        glDeleteSync(request->fence);
+    if (ringBuffer)
+    {
+        GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GlState::getInstance().deleteBuffer(ringBuffer);
+    }
+}
+
+std::shared_future<TextureHandle> TextureStreamer::request(const std::string &path)
+{
+    std::shared_ptr<Request> request(new Request());
+    request->path = path;
+    request->state = REQUEST_DECODING;
+    request->offset = 0;
+    request->size = 0;
+    request->fence = 0;
+    std::shared_future<TextureHandle> future = request->promise.get_future().share();
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pendingCount;
+    }
+    enqueue([this, request]()
+    {
+        if (!request->image.decode(request->path))
+            std::cerr << "Failed to decode image: " << request->path << std::endl;
+        request->size = request->image.getDataSize();
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        request->state = REQUEST_DECODED;
+        decoded.push_back(request);
+    });
+    return future;
+}
+
+/*
+ * Runs on the GL thread once per frame. Each step only ever waits on the workers' mutex, never on the
+ * GPU: fences are polled, and whatever doesn't fit into this frame's budget or the ring waits.
+ */
+void TextureStreamer::update()
+{
+    // Retire the uploads the GPU is done with, then free the ring from its oldest end
+    for (auto it = inFlight.begin(); it != inFlight.end(); )
+    {
+        GLenum status = glClientWaitSync((*it)->fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync((*it)->fence);
+            finish(*it);
+            it = inFlight.erase(it);
+        }
+        else
+            ++it;
+    }
+    std::deque<std::shared_ptr<Request>> readyToUpload;
+    std::deque<std::shared_ptr<Request>> readyToCopy;
+    {
+        // The workers update request states under the lock too
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!regions.empty() && regions.front().request->state == REQUEST_RESIDENT)
+            regions.pop_front();
+        readyToUpload.swap(copied);
+        readyToCopy.swap(decoded);
+    }
+    
+    // Upload what the workers have copied into the ring; always at least one, so large images can't starve
+    size_t uploadedBytes = 0;
+    if (!readyToUpload.empty()) GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+    while (!readyToUpload.empty() && (uploadedBytes == 0 || uploadedBytes + readyToUpload.front()->size <= frameBudget))
+    {
+        std::shared_ptr<Request> request = readyToUpload.front();
+        readyToUpload.pop_front();
+        request->image.uploadFromBuffer(request->offset);
+        request->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request->state = REQUEST_UPLOADED;
+        }
+        inFlight.push_back(request);
+        uploadedBytes += request->size;
+    }
+    GlState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    
+    // Give newly decoded images space in the ring, in the order they were decoded
+    while (!readyToCopy.empty())
+    {
+        std::shared_ptr<Request> request = readyToCopy.front();
+        if (!request->image.isDecoded())
+        {
+            finish(request);
+        }
+        else if (!mappedRing || request->size > ringSize)
+        {
+            // No ring to go through (or it could never fit), so this is a plain synchronous upload
+            if (uploadedBytes > 0 && uploadedBytes + request->size > frameBudget) break;
+            request->image.upload();
+            uploadedBytes += request->size;
+            finish(request);
+        }
+        else
+        {
+            if (!allocate(request->size, request->offset)) break;
+            RingRegion region = { request->offset, (request->size + RING_ALIGNMENT - 1) & ~(RING_ALIGNMENT - 1), request };
+            regions.push_back(region);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                request->state = REQUEST_COPYING;
+            }
+            enqueue([this, request]()
+            {
+                request->image.copyData(mappedRing + request->offset);
+                
+                std::lock_guard<std::mutex> lock(mutex);
+                request->state = REQUEST_COPIED;
+                copied.push_back(request);
+            });
+        }
+        readyToCopy.pop_front();
+    }
+    
+    // Whatever we didn't get to goes back to the front of the queues, ahead of anything newer
+    std::lock_guard<std::mutex> lock(mutex);
+    copied.insert(copied.begin(), readyToUpload.begin(), readyToUpload.end());
+    decoded.insert(decoded.begin(), readyToCopy.begin(), readyToCopy.end());
+}
+
+bool TextureStreamer::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pendingCount > 0;
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+void TextureStreamer::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void TextureStreamer::enqueue(const std::function<void()> &job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+    jobAvailable.notify_one();
+}
+
+/*
+ * Regions are handed out in order around the ring and freed from its oldest end, so the free space
+ * is always the gap between the newest region's end and the oldest one's start.
+ */
+bool TextureStreamer::allocate(size_t size, GLintptr &offset)
+{
+    size = (size + RING_ALIGNMENT - 1) & ~(RING_ALIGNMENT - 1);
+    if (regions.empty())
+    {
+        offset = 0;
+        return size <= ringSize;
+    }
+    
+    size_t tail = regions.front().offset;
+    size_t head = regions.back().offset + regions.back().size;
+    if (head > tail)
+    {
+        if (head + size <= ringSize) offset = head;
+        else if (size <= tail) offset = 0;                          // Wrap around, skipping the end of the ring
+        else return false;
+    }
+    else if (head + size <= tail)
+        offset = head;
+    else
+        return false;
+    return true;
+}
+
+// Streamed textures aren't shared through the TextureCache, so their handles release them directly
+void TextureStreamer::finish(const std::shared_ptr<Request> &request)
+{
+    request->promise.set_value(TextureHandle(new Image(request->image), [](Image *image)
+    {
+        image->release();
+        delete image;
+    }));
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    request->state = REQUEST_RESIDENT;
+    --pendingCount;
+}
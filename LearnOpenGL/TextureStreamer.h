@@ -0,0 +1,91 @@
+#ifndef __LearnOpenGL__TextureStreamer__
+#define __LearnOpenGL__TextureStreamer__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TextureCache.h"
+
+/*
+ * Loads textures in the background while the application keeps rendering. Worker threads decode
+ * each file and copy it into a persistently mapped pixel buffer (a ring shared by all requests);
+ * update(), called once per frame on the GL thread, then issues the uploads from that buffer, at
+ * most frameBudgetBytes worth per frame, and fences them so the ring space can be reused once the
+ * GPU has read it. A request's future becomes ready once its texture is resident.
+ *
+ * Without ARB_buffer_storage there is no persistent mapping, and decoded images are uploaded from
+ * client memory instead (still within the per frame budget).
+ */
+class TextureStreamer
+{
+
+public:
+
+    TextureStreamer(size_t ringBytes = 64 << 20, size_t frameBudgetBytes = 8 << 20, unsigned int maxThreads = 0);
+    ~TextureStreamer();
+    std::shared_future<TextureHandle> request(const std::string &path);
+    void update();
+    bool isBusy() const;
+
+private:
+
+    enum RequestState
+    {
+        REQUEST_DECODING,
+        REQUEST_DECODED,                                            // Waiting for space in the ring
+        REQUEST_COPYING,
+        REQUEST_COPIED,                                             // Waiting for its turn to upload
+        REQUEST_UPLOADED,                                           // Waiting for the GPU to finish reading the ring
+        REQUEST_RESIDENT
+    };
+
+    struct Request
+    {
+        std::string path;
+        Image image;
+        RequestState state;
+        GLintptr offset;
+        size_t size;
+        GLsync fence;
+        std::promise<TextureHandle> promise;
+    };
+
+    // A piece of the ring, in allocation order; released once its request's upload has completed
+    struct RingRegion
+    {
+        GLintptr offset;
+        size_t size;
+        std::shared_ptr<Request> request;
+    };
+
+    void workerLoop();
+    void enqueue(const std::function<void()> &job);
+    bool allocate(size_t size, GLintptr &offset);
+    void finish(const std::shared_ptr<Request> &request);
+
+    size_t ringSize;
+    size_t frameBudget;
+    GLuint ringBuffer;
+    unsigned char *mappedRing;                                      // Null without persistent mapping
+    std::deque<RingRegion> regions;
+    std::vector<std::shared_ptr<Request>> inFlight;                 // Uploaded, waiting on their fences
+
+    // Shared with the workers
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<std::function<void()>> jobs;
+    std::deque<std::shared_ptr<Request>> decoded;
+    std::deque<std::shared_ptr<Request>> copied;
+    size_t pendingCount;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+};
+
+#endif
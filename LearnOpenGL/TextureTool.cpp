@@ -0,0 +1,89 @@
+/*
+ * TextureTool: converts PNG/JPG textures into block compressed KTX files with a complete mip chain,
+ * which Image uploads as they are instead of decoding and generating mipmaps at load time.
+ *
+ *     TextureTool [-f bc1|bc3|bc5] [--no-mips] input.png output.ktx
+ *
+ * Without -f, images with an alpha channel become BC3 and everything else BC1. Use BC5 for normal
+ * maps. Needs no GL context: it reports the PSNR of the encoded top level against the source.
+ */
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <SOIL/SOIL.h>
+#include "TextureCompression.h"
+
+static int printUsage()
+{
+    std::cerr << "usage: TextureTool [-f bc1|bc3|bc5] [--no-mips] <input image> <output.ktx>" << std::endl;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string formatName;
+    bool generateMips = true;
+    std::string inputPath;
+    std::string outputPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            formatName = argv[++i];
+        else if (std::strcmp(argv[i], "--no-mips") == 0)
+            generateMips = false;
+        else if (inputPath.empty())
+            inputPath = argv[i];
+        else if (outputPath.empty())
+            outputPath = argv[i];
+        else
+            return printUsage();
+    }
+    if (inputPath.empty() || outputPath.empty()) return printUsage();
+
+    // Always decode to RGBA so that every format sees the same layout
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char *pixels = SOIL_load_image(inputPath.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (!pixels)
+    {
+        std::cerr << "Failed to load " << inputPath << ": " << SOIL_last_result() << std::endl;
+        return 1;
+    }
+
+    BlockFormat format = channels == 4 ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1;
+    if (formatName == "bc1") format = BLOCK_FORMAT_BC1;
+    else if (formatName == "bc3") format = BLOCK_FORMAT_BC3;
+    else if (formatName == "bc5") format = BLOCK_FORMAT_BC5;
+    else if (!formatName.empty())
+    {
+        SOIL_free_image_data(pixels);
+        return printUsage();
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    CompressedTexture texture = compressTexture(pixels, width, height, format, generateMips);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+    // Compare only the channels the format actually stores
+    std::vector<uint8_t> decoded = decompressImage(texture.levels[0].data(), width, height, format);
+    int comparedChannels = format == BLOCK_FORMAT_BC1 ? 3 : (format == BLOCK_FORMAT_BC3 ? 4 : 2);
+    double psnr = computePSNR(pixels, decoded.data(), width, height, comparedChannels);
+    SOIL_free_image_data(pixels);
+
+    if (!writeKTX(outputPath, texture))
+    {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return 1;
+    }
+
+    size_t compressedBytes = 0;
+    for (const auto &level: texture.levels)
+        compressedBytes += level.size();
+    static const char *FORMAT_NAMES[] = { "BC1", "BC3", "BC5" };
+    std::cout << inputPath << " -> " << outputPath << ": " << width << "x" << height << " " << FORMAT_NAMES[format] << ", "
+              << texture.levels.size() << " levels, " << compressedBytes / 1024 << " KB (" << static_cast<size_t>(width) * height * 3 * 4 / 3 / 1024
+              << " KB as RGB with mipmaps), PSNR " << psnr << " dB, encoded in " << elapsed.count() << " ms." << std::endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "Transform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const float ORTHOGONALITY_EPSILON = 1e-5f;
+
+/*
+ * The inverse transpose of M is its cofactor matrix divided by its determinant, and for a 3x3 matrix
+ * with columns (a, b, c) the cofactor matrix is simply (b x c, c x a, a x b). That saves us from ever
+ * building a full inverse. Better still, when the columns are mutually orthogonal and equally long
+ * (rotations plus a uniform scale s, which covers almost every object we draw) the inverse transpose
+ * is just M / s^2, so we can skip the cross products as well.
+ */
+glm::mat3 computeNormalMatrix(const glm::mat4 &model)
+{
+    glm::vec3 a(model[0]);
+    glm::vec3 b(model[1]);
+    glm::vec3 c(model[2]);
+    
+    float aa = glm::dot(a, a);
+    float bb = glm::dot(b, b);
+    float cc = glm::dot(c, c);
+    float tolerance = ORTHOGONALITY_EPSILON * aa;
+    
+    if (std::fabs(glm::dot(a, b)) <= tolerance &&
+        std::fabs(glm::dot(a, c)) <= tolerance &&
+        std::fabs(glm::dot(b, c)) <= tolerance &&
+        std::fabs(aa - bb) <= tolerance &&
+        std::fabs(aa - cc) <= tolerance &&
+        aa > 0.0f)
+    {
+        float invScaleSquared = 1.0f / aa;
+        return glm::mat3(a * invScaleSquared, b * invScaleSquared, c * invScaleSquared);
+    }
+    
+    glm::vec3 bc = glm::cross(b, c);
+    float invDeterminant = 1.0f / glm::dot(a, bc);
+    return glm::mat3(bc * invDeterminant, glm::cross(c, a) * invDeterminant, glm::cross(a, b) * invDeterminant);
+}
+
+/*
+ * Times computeNormalMatrix() against the general inverse transpose on count random transforms, half
+ * of them rotations with a uniform scale (the fast path) and half with a non-uniform scale, and checks
+ * that both give the same matrices.
+ */
+void benchmarkNormalMatrices(std::ostream &stream, size_t count)
+{
+    static const int RUNS = 5;
+    typedef std::chrono::high_resolution_clock Clock;
+    
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> pickUnit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> pickScale(0.5f, 2.0f);
+    std::vector<glm::mat4> models(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 axis(pickUnit(random), pickUnit(random), pickUnit(random) + 2.0f);
+        float scale = pickScale(random);
+        glm::vec3 scales = i % 2 ? glm::vec3(pickScale(random), pickScale(random), pickScale(random)) : glm::vec3(scale);
+        models[i] = glm::translate(glm::mat4(), glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random)) * 10.0f);
+        models[i] = glm::rotate(models[i], pickUnit(random) * 3.14159f, axis);
+        models[i] = glm::scale(models[i], scales);
+    }
+    
+    std::vector<glm::mat3> inverseTransposes(count);
+    std::vector<glm::mat3> normalMatrices(count);
+    double inverseMs = 1e30;
+    double normalMs = 1e30;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        auto startTime = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+            inverseTransposes[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - startTime;
+        inverseMs = std::min(inverseMs, elapsed.count());
+        
+        startTime = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+            normalMatrices[i] = computeNormalMatrix(models[i]);
+        elapsed = Clock::now() - startTime;
+        normalMs = std::min(normalMs, elapsed.count());
+    }
+    
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+        for (int column = 0; column < 3; ++column)
+            for (int row = 0; row < 3; ++row)
+                maxDifference = std::max(maxDifference, std::fabs(inverseTransposes[i][column][row] - normalMatrices[i][column][row]));
+    
+    stream << "Normal matrices for " << count << " transforms (best of " << RUNS << "): inverse transpose " << inverseMs << " ms, computeNormalMatrix "
+           << normalMs << " ms, largest difference " << maxDifference << std::endl;
+}
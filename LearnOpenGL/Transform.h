@@ -0,0 +1,16 @@
+#ifndef __LearnOpenGL__Transform__
+#define __LearnOpenGL__Transform__
+
+#include <cstddef>
+#include <iostream>
+#include <glm/glm.hpp>
+
+/*
+ * Normals have to be transformed by the inverse transpose of the model matrix's upper 3x3, which is
+ * far too expensive to recompute for every vertex in the shader. These compute it once per object
+ * on the CPU instead, to be passed along as the uNormalMatrix uniform or as a per-instance attribute.
+ */
+glm::mat3 computeNormalMatrix(const glm::mat4 &model);
+void benchmarkNormalMatrices(std::ostream &stream, size_t count = 100000);
+
+#endif
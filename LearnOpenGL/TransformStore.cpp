@@ -0,0 +1,284 @@
+#include "TransformStore.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_STORE_USE_SSE 1
+#endif
+
+// The values that padding lanes (and freshly added objects) start out with: an identity transform
+static const float IDENTITY_COMPONENTS[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+
+// ===============================
+// Public member functions
+// ===============================
+
+TransformStore::TransformStore() : count(0), capacity(0)
+{
+    for (int c = 0; c < NUM_COMPONENTS; ++c)
+        components[c] = nullptr;
+}
+
+TransformStore::~TransformStore()
+{
+    for (int c = 0; c < NUM_COMPONENTS; ++c)
+        std::free(components[c]);
+}
+
+size_t TransformStore::add(const glm::vec3 &position, const glm::vec4 &rotation, const glm::vec3 &scale)
+{
+    if (count == capacity) reserve(capacity ? capacity * 2 : 64);
+    size_t index = count++;
+    setPosition(index, position);
+    setRotation(index, rotation);
+    setScale(index, scale);
+    return index;
+}
+
+void TransformStore::clear()
+{
+    count = 0;
+    for (int c = 0; c < NUM_COMPONENTS; ++c)
+        for (size_t i = 0; i < capacity; ++i)
+            components[c][i] = IDENTITY_COMPONENTS[c];
+}
+
+void TransformStore::setPosition(size_t index, const glm::vec3 &position)
+{
+    components[POSITION_X][index] = position.x;
+    components[POSITION_Y][index] = position.y;
+    components[POSITION_Z][index] = position.z;
+}
+
+void TransformStore::setRotation(size_t index, const glm::vec4 &rotation)
+{
+    // The matrix construction below assumes a unit quaternion
+    glm::vec4 q = glm::normalize(rotation);
+    components[ROTATION_X][index] = q.x;
+    components[ROTATION_Y][index] = q.y;
+    components[ROTATION_Z][index] = q.z;
+    components[ROTATION_W][index] = q.w;
+}
+
+void TransformStore::setRotation(size_t index, float angle, const glm::vec3 &axis)
+{
+    setRotation(index, axisAngleToQuaternion(angle, axis));
+}
+
+void TransformStore::setScale(size_t index, const glm::vec3 &scale)
+{
+    components[SCALE_X][index] = scale.x;
+    components[SCALE_Y][index] = scale.y;
+    components[SCALE_Z][index] = scale.z;
+}
+
+glm::vec3 TransformStore::getPosition(size_t index) const
+{
+    return glm::vec3(components[POSITION_X][index], components[POSITION_Y][index], components[POSITION_Z][index]);
+}
+
+glm::vec4 TransformStore::getRotation(size_t index) const
+{
+    return glm::vec4(components[ROTATION_X][index], components[ROTATION_Y][index], components[ROTATION_Z][index], components[ROTATION_W][index]);
+}
+
+glm::vec3 TransformStore::getScale(size_t index) const
+{
+    return glm::vec3(components[SCALE_X][index], components[SCALE_Y][index], components[SCALE_Z][index]);
+}
+
+/*
+ * Rebuild the model matrices only, e.g. for instanced drawing where the view-projection matrix is
+ * applied in the vertex shader.
+ */
+void TransformStore::update()
+{
+    modelMatrices.resize(count);
+    modelViewProjections.clear();
+#ifdef TRANSFORM_STORE_USE_SSE
+    updateSSE(nullptr);
+#else
+    updateScalar(nullptr);
+#endif
+}
+
+/*
+ * Rebuild the model matrices and, in the same pass, multiply each one by the view-projection matrix,
+ * which callers should compute once per frame rather than once per object.
+ */
+void TransformStore::update(const glm::mat4 &viewProjection)
+{
+    modelMatrices.resize(count);
+    modelViewProjections.resize(count);
+#ifdef TRANSFORM_STORE_USE_SSE
+    updateSSE(&viewProjection);
+#else
+    updateScalar(&viewProjection);
+#endif
+}
+
+glm::vec4 TransformStore::axisAngleToQuaternion(float angle, const glm::vec3 &axis)
+{
+    glm::vec3 n = glm::normalize(axis);
+    float s = std::sin(angle * 0.5f);
+    return glm::vec4(n.x * s, n.y * s, n.z * s, std::cos(angle * 0.5f));
+}
+
+// ===============================
+// Private member functions
+// ===============================
+
+void TransformStore::reserve(size_t newCapacity)
+{
+    // Always keep whole SIMD lanes allocated, so the kernels never need a scalar tail loop for loads
+    newCapacity = (newCapacity + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+    if (newCapacity <= capacity) return;
+
+    for (int c = 0; c < NUM_COMPONENTS; ++c)
+    {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, ALIGNMENT, newCapacity * sizeof(float)) != 0)
+            throw std::bad_alloc();
+
+        float *array = static_cast<float*>(memory);
+        if (components[c]) std::memcpy(array, components[c], capacity * sizeof(float));
+        for (size_t i = capacity; i < newCapacity; ++i)
+            array[i] = IDENTITY_COMPONENTS[c];
+
+        std::free(components[c]);
+        components[c] = array;
+    }
+    capacity = newCapacity;
+}
+
+void TransformStore::updateScalar(const glm::mat4 *viewProjection)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float x = components[ROTATION_X][i];
+        float y = components[ROTATION_Y][i];
+        float z = components[ROTATION_Z][i];
+        float w = components[ROTATION_W][i];
+        float sx = components[SCALE_X][i];
+        float sy = components[SCALE_Y][i];
+        float sz = components[SCALE_Z][i];
+
+        glm::mat4 &m = modelMatrices[i];
+        m[0] = glm::vec4((1.0f - 2.0f * (y * y + z * z)) * sx, 2.0f * (x * y + w * z) * sx, 2.0f * (x * z - w * y) * sx, 0.0f);
+        m[1] = glm::vec4(2.0f * (x * y - w * z) * sy, (1.0f - 2.0f * (x * x + z * z)) * sy, 2.0f * (y * z + w * x) * sy, 0.0f);
+        m[2] = glm::vec4(2.0f * (x * z + w * y) * sz, 2.0f * (y * z - w * x) * sz, (1.0f - 2.0f * (x * x + y * y)) * sz, 0.0f);
+        m[3] = glm::vec4(components[POSITION_X][i], components[POSITION_Y][i], components[POSITION_Z][i], 1.0f);
+
+        if (viewProjection) modelViewProjections[i] = (*viewProjection) * m;
+    }
+}
+
+#ifdef TRANSFORM_STORE_USE_SSE
+
+/*
+ * Writes out four matrices held in SoA form (m[column][row] holds that element for four objects)
+ * as four column-major glm::mat4s. Each column is one 4x4 transpose away from AoS order.
+ */
+static void storeMatrices(__m128 m[4][4], glm::mat4 *out, size_t numValid)
+{
+    float block[4][16];
+    float *dst[4];
+    for (size_t lane = 0; lane < 4; ++lane)
+        dst[lane] = numValid == 4 ? &out[lane][0][0] : block[lane];
+
+    for (int column = 0; column < 4; ++column)
+    {
+        __m128 a = m[column][0];
+        __m128 b = m[column][1];
+        __m128 c = m[column][2];
+        __m128 d = m[column][3];
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(dst[0] + column * 4, a);
+        _mm_storeu_ps(dst[1] + column * 4, b);
+        _mm_storeu_ps(dst[2] + column * 4, c);
+        _mm_storeu_ps(dst[3] + column * 4, d);
+    }
+
+    // The last block can be partially filled; only copy out the objects that actually exist
+    if (numValid != 4)
+        for (size_t lane = 0; lane < numValid; ++lane)
+            std::memcpy(&out[lane][0][0], block[lane], sizeof(block[lane]));
+}
+
+void TransformStore::updateSSE(const glm::mat4 *viewProjection)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    // Broadcast every element of the view-projection matrix once, outside the loop
+    __m128 vp[4][4];
+    if (viewProjection)
+        for (int column = 0; column < 4; ++column)
+            for (int row = 0; row < 4; ++row)
+                vp[column][row] = _mm_set1_ps((*viewProjection)[column][row]);
+
+    for (size_t i = 0; i < count; i += LANE_WIDTH)
+    {
+        __m128 x = _mm_load_ps(components[ROTATION_X] + i);
+        __m128 y = _mm_load_ps(components[ROTATION_Y] + i);
+        __m128 z = _mm_load_ps(components[ROTATION_Z] + i);
+        __m128 w = _mm_load_ps(components[ROTATION_W] + i);
+        __m128 sx = _mm_load_ps(components[SCALE_X] + i);
+        __m128 sy = _mm_load_ps(components[SCALE_Y] + i);
+        __m128 sz = _mm_load_ps(components[SCALE_Z] + i);
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        __m128 m[4][4];
+        m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        m[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        m[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        m[0][3] = zero;
+        m[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        m[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        m[1][3] = zero;
+        m[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        m[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        m[2][3] = zero;
+        m[3][0] = _mm_load_ps(components[POSITION_X] + i);
+        m[3][1] = _mm_load_ps(components[POSITION_Y] + i);
+        m[3][2] = _mm_load_ps(components[POSITION_Z] + i);
+        m[3][3] = one;
+
+        size_t numValid = count - i < LANE_WIDTH ? count - i : LANE_WIDTH;
+        storeMatrices(m, &modelMatrices[i], numValid);
+
+        if (!viewProjection) continue;
+
+        // MVP = VP * M, one column at a time. The bottom row of M is (0, 0, 0, 1), so drop those terms.
+        __m128 mvp[4][4];
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp[0][row], m[column][0]), _mm_mul_ps(vp[1][row], m[column][1])),
+                                        _mm_mul_ps(vp[2][row], m[column][2]));
+                mvp[column][row] = column == 3 ? _mm_add_ps(sum, vp[3][row]) : sum;
+            }
+        }
+        storeMatrices(mvp, &modelViewProjections[i], numValid);
+    }
+}
+
+#else
+
+void TransformStore::updateSSE(const glm::mat4 *viewProjection)
+{
+    updateScalar(viewProjection);
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __LearnOpenGL__TransformStore__
+#define __LearnOpenGL__TransformStore__
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+ * Holds the transforms of many scene objects in structure-of-arrays form: every component (position
+ * x, position y, ..., scale z) lives in its own 16-byte aligned array. That lets update() build the
+ * model matrices, and optionally the model-view-projection matrices, for four objects at a time with
+ * SSE, instead of going through glm::translate / glm::rotate / glm::scale once per object.
+ *
+ * Rotations are stored as unit quaternions (x, y, z, w). Each model matrix is translate * rotate *
+ * scale, which is the same order main.cpp used to compose them in by hand.
+ */
+class TransformStore
+{
+
+public:
+
+    TransformStore();
+    ~TransformStore();
+    TransformStore(const TransformStore &) = delete;
+    TransformStore &operator=(const TransformStore &) = delete;
+
+    size_t add(const glm::vec3 &position, const glm::vec4 &rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), const glm::vec3 &scale = glm::vec3(1.0f));
+    void clear();
+    size_t size() const { return count; }
+
+    void setPosition(size_t index, const glm::vec3 &position);
+    void setRotation(size_t index, const glm::vec4 &rotation);
+    void setRotation(size_t index, float angle, const glm::vec3 &axis);
+    void setScale(size_t index, const glm::vec3 &scale);
+    glm::vec3 getPosition(size_t index) const;
+    glm::vec4 getRotation(size_t index) const;
+    glm::vec3 getScale(size_t index) const;
+
+    void update();
+    void update(const glm::mat4 &viewProjection);
+    const std::vector<glm::mat4> &getModelMatrices() const { return modelMatrices; }
+    const std::vector<glm::mat4> &getModelViewProjections() const { return modelViewProjections; }
+
+    static glm::vec4 axisAngleToQuaternion(float angle, const glm::vec3 &axis);
+
+private:
+
+    enum Component
+    {
+        POSITION_X, POSITION_Y, POSITION_Z,
+        ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+        SCALE_X, SCALE_Y, SCALE_Z,
+        NUM_COMPONENTS
+    };
+
+    static const size_t LANE_WIDTH = 4;
+    static const size_t ALIGNMENT = 16;
+
+    float *components[NUM_COMPONENTS];
+    size_t count;
+    size_t capacity;
+    std::vector<glm::mat4> modelMatrices;
+    std::vector<glm::mat4> modelViewProjections;
+
+    void reserve(size_t newCapacity);
+    void updateScalar(const glm::mat4 *viewProjection);
+    void updateSSE(const glm::mat4 *viewProjection);
+
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "VertexCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float UNORM16_MAX = 65535.0f;
+static const float SNORM10_MAX = 511.0f;
+
+/*
+ * Rounds to the nearest half. Values too small for a normal half become denormals (or zero), values
+ * too large become infinity, and NaNs stay NaNs.
+ */
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    
+    if (exponent == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;                                       // Make the implicit leading 1 explicit
+        int shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    
+    // A carry out of the mantissa while rounding correctly bumps the exponent (up to infinity)
+    uint32_t half = sign | (halfExponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) ++half;
+    return static_cast<uint16_t>(half);
+}
+
+float halfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    
+    if (exponent == 0)
+    {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    
+    uint32_t bits = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) : sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// x, y and z go into the low 30 bits as signed 10-bit normalized values; w is left at 0
+uint32_t packNormal(const glm::vec3 &normal)
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        int value = static_cast<int>(std::floor(glm::clamp(normal[i], -1.0f, 1.0f) * SNORM10_MAX + 0.5f));
+        packed |= (static_cast<uint32_t>(value) & 0x3ff) << (10 * i);
+    }
+    return packed;
+}
+
+glm::vec3 unpackNormal(uint32_t packed)
+{
+    glm::vec3 normal;
+    for (int i = 0; i < 3; ++i)
+    {
+        int value = static_cast<int>((packed >> (10 * i)) & 0x3ff);
+        if (value & 0x200) value -= 0x400;                          // Sign extend
+        normal[i] = std::max(value / SNORM10_MAX, -1.0f);           // The GL rule for signed normalized values
+    }
+    return normal;
+}
+
+CompactVertex compressVertex(const Vertex &vertex, const AABB &bounds)
+{
+    CompactVertex compact;
+    glm::vec3 extent = bounds.max - bounds.min;
+    for (int i = 0; i < 3; ++i)
+    {
+        float t = extent[i] > 0.0f ? (vertex.position[i] - bounds.min[i]) / extent[i] : 0.0f;
+        compact.position[i] = static_cast<uint16_t>(std::floor(glm::clamp(t, 0.0f, 1.0f) * UNORM16_MAX + 0.5f));
+    }
+    compact.position[3] = 0;
+    compact.normal = packNormal(vertex.normal);
+    compact.texCoord[0] = floatToHalf(vertex.texCoord.x);
+    compact.texCoord[1] = floatToHalf(vertex.texCoord.y);
+    return compact;
+}
+
+Vertex decompressVertex(const CompactVertex &vertex, const AABB &bounds)
+{
+    Vertex result;
+    glm::vec3 extent = bounds.max - bounds.min;
+    for (int i = 0; i < 3; ++i)
+        result.position[i] = bounds.min[i] + vertex.position[i] / UNORM16_MAX * extent[i];
+    result.normal = unpackNormal(vertex.normal);
+    result.texCoord = glm::vec2(halfToFloat(vertex.texCoord[0]), halfToFloat(vertex.texCoord[1]));
+    return result;
+}
+
+void compressVertices(const Vertex *vertices, size_t count, const AABB &bounds, CompactVertex *out)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = compressVertex(vertices[i], bounds);
+}
+
+/*
+ * The GPU hands compact positions to the vertex shader as values in [0, 1]. Scaling them by the box's
+ * size and moving them to its corner is just another affine transform, so rather than teaching every
+ * shader about it, fold it into the model matrix: model * getDequantizationMatrix(bounds).
+ */
+glm::mat4 getDequantizationMatrix(const AABB &bounds)
+{
+    glm::mat4 dequantize;
+    dequantize[0][0] = bounds.max.x - bounds.min.x;
+    dequantize[1][1] = bounds.max.y - bounds.min.y;
+    dequantize[2][2] = bounds.max.z - bounds.min.z;
+    dequantize[3] = glm::vec4(bounds.min, 1.0f);
+    return dequantize;
+}
@@ -0,0 +1,27 @@
+#ifndef __LearnOpenGL__VertexCompression__
+#define __LearnOpenGL__VertexCompression__
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+/*
+ * Conversions between the full precision Vertex and the 16 byte CompactVertex. Positions are stored
+ * as 16-bit unsigned normalized values within a bounding box (see getDequantizationMatrix for how to
+ * undo that on the GPU), normals as GL_INT_2_10_10_10_REV and texture coordinates as half floats.
+ *
+ * Worst case errors: half a quantization step per position axis, i.e. extent / 131070; about 0.1
+ * degrees for normals; and a relative error of 2^-11 for texture coordinates.
+ */
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t half);
+uint32_t packNormal(const glm::vec3 &normal);
+glm::vec3 unpackNormal(uint32_t packed);
+
+CompactVertex compressVertex(const Vertex &vertex, const AABB &bounds);
+Vertex decompressVertex(const CompactVertex &vertex, const AABB &bounds);
+void compressVertices(const Vertex *vertices, size_t count, const AABB &bounds, CompactVertex *out);
+glm::mat4 getDequantizationMatrix(const AABB &bounds);
+
+#endif
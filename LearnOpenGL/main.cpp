@@ -1,5 +1,11 @@
 #include <math.h>
 #include <iostream>
+#include <sstream>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 /* 
  * Here, we choose to use the static version of the GLEW library.
@@ -23,18 +29,72 @@
 
 // Custom headers
 #include "GlslProgram.h"
+#include "GlState.h"
 #include "Image.h"
 #include "Camera.h"
+#include "LightBlock.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "Transform.h"
+#include "TransformStore.h"
+#include "Frustum.h"
+#include "BVH.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "FrameHistogram.h"
+#include "ShaderWatcher.h"
+#include "RenderQueue.h"
+#include "HeadlessContext.h"
+#include "Profiler.h"
 
 GLFWwindow *window;
 const GLuint WINDOW_WIDTH = 800;
 const GLuint WINDOW_HEIGHT = 600;
+const size_t BVH_BENCHMARK_SIZES[] = { 10000, 100000, 1000000 };   // Objects per BVH benchmark scene; the largest takes a minute or two
+GLuint viewportWidth = WINDOW_WIDTH;                                // The window's size, or the headless framebuffer's
+GLuint viewportHeight = WINDOW_HEIGHT;
 bool keys[1024];
 GLfloat deltaTime = 0.0f;                                           // Time between current frame and last frame
 GLfloat lastFrame = 0.0f;                                           // Time of last frame
 GLfloat lastX = WINDOW_WIDTH / 2;
 GLfloat lastY = WINDOW_HEIGHT / 2;
 bool firstMouse = true;
+bool pickRequested = false;
+bool streamRequested = false;                                       // T streams the nanosuit's textures in the background
+bool syncLoadRequested = false;                                     // Y loads them the old way, for comparison
+bool queueBenchmarkRequested = false;                               // B times the render queue's sort on a synthetic scene
+bool traceRequested = false;                                        // P prints the profiler's zone statistics and writes a trace
+bool loadBenchmarkRequested = false;                                // L times loading the nanosuit with and without its mesh cache
+bool instancingBenchmarkRequested = false;                          // I times drawing many cubes one by one against drawing them instanced
+bool normalMatrixBenchmarkRequested = false;                        // N times computing normal matrices on the CPU
+bool bvhBenchmarkRequested = false;                                 // V times building and querying a BVH against testing every object
+bool drawBenchmarkRequested = false;                                // C times the nanosuit's draw paths against each other
+
+const std::string NANOSUIT_MODEL = "assets/nanosuit/nanosuit.obj";
+const std::vector<std::string> NANOSUIT_TEXTURES = {
+    "assets/nanosuit/arm_dif.png", "assets/nanosuit/arm_showroom_ddn.png", "assets/nanosuit/arm_showroom_spec.png",
+    "assets/nanosuit/body_dif.png", "assets/nanosuit/body_showroom_ddn.png", "assets/nanosuit/body_showroom_spec.png",
+    "assets/nanosuit/glass_ddn.png", "assets/nanosuit/glass_dif.png",
+    "assets/nanosuit/hand_dif.png", "assets/nanosuit/hand_showroom_ddn.png", "assets/nanosuit/hand_showroom_spec.png",
+    "assets/nanosuit/helmet_diff.png", "assets/nanosuit/helmet_showroom_ddn.png", "assets/nanosuit/helmet_showroom_spec.png",
+    "assets/nanosuit/leg_dif.png", "assets/nanosuit/leg_showroom_ddn.png", "assets/nanosuit/leg_showroom_spec.png"
+};
+const size_t LOAD_MEASURE_FRAMES = 180;                             // How long to keep recording frame times after a load starts
+const int HEADLESS_DEFAULT_FRAMES = 300;
+const GLfloat HEADLESS_FRAME_TIME = 1.0f / 60.0f;                   // Headless frames advance the scene by a fixed step, so every run renders the same frames
+const std::string TRACE_PATH = "profile.json";                      // Where P writes the trace (load it in chrome://tracing)
+const size_t TEXTURE_BUDGET_BYTES = 64 * 1024 * 1024;               // GPU memory the scene's textures are kept within
+
+// The ways the nanosuit can be drawn; M switches between them
+enum ModelDrawPath
+{
+    MODEL_DRAW_QUEUE,                                               // Model::submit(), sorted with everything else
+    MODEL_DRAW_INDIRECT,                                            // Model::drawIndirect(), one multi-draw per material
+    MODEL_DRAW_LOD,                                                 // Model::drawLOD(), at the level of detail the distance calls for
+    NUM_MODEL_DRAW_PATHS
+};
+const char *MODEL_DRAW_PATH_NAMES[NUM_MODEL_DRAW_PATHS] = { "the render queue", "multi-draw indirect", "levels of detail" };
+ModelDrawPath modelDrawPath = MODEL_DRAW_QUEUE;
 
 Camera cam;
 
@@ -55,6 +115,13 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     cam.processMouse(xoffset, yoffset);
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    // The actual pick happens in the render loop, where the scene's BVH is up to date for this frame
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
+}
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
     /*
@@ -69,6 +136,29 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
          * closing the application.
          */
         glfwSetWindowShouldClose(window, GL_TRUE);
+    if (key == GLFW_KEY_T && action == GLFW_PRESS)
+        streamRequested = true;
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS)
+        syncLoadRequested = true;
+    if (key == GLFW_KEY_B && action == GLFW_PRESS)
+        queueBenchmarkRequested = true;
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        traceRequested = true;
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+        loadBenchmarkRequested = true;
+    if (key == GLFW_KEY_I && action == GLFW_PRESS)
+        instancingBenchmarkRequested = true;
+    if (key == GLFW_KEY_N && action == GLFW_PRESS)
+        normalMatrixBenchmarkRequested = true;
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+        bvhBenchmarkRequested = true;
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        drawBenchmarkRequested = true;
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        modelDrawPath = static_cast<ModelDrawPath>((modelDrawPath + 1) % NUM_MODEL_DRAW_PATHS);
+        std::cout << "Drawing the nanosuit through " << MODEL_DRAW_PATH_NAMES[modelDrawPath] << "." << std::endl;
+    }
     if (key >= 0 && key < 1024)
     {
         if (action == GLFW_PRESS) keys[key] = true;
@@ -95,39 +185,103 @@ void calculateCameraMovement()
 
 int main(int argc, const char * argv[])
 {
-    glfwInit();                                                     // Instantiate GLFW
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);                  // Tell GLFW that we want to use version 3.3 of OpenGL
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // Use the core profile
-    //glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);                       // Don't let the user resize the window
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    
-    window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", nullptr, nullptr);
-    if (window == nullptr)
+    /*
+     * With --headless we render without a window (and without a display or a GPU: Mesa's llvmpipe will
+     * do) into a --size WIDTHxHEIGHT framebuffer, for a fixed number of --frames, without any input.
+     * --dump DIRECTORY also writes every frame there as a BMP. The frame times are printed at the end,
+     * which makes this the way to run the benchmarks unattended. In either mode, --trace PATH writes
+     * the profiler's trace of the whole run on exit, and --compact loads the nanosuit with compact
+     * vertices (VERTEX_FORMAT_COMPACT) instead of floats.
+     */
+    bool headless = false;
+    bool compactVertices = false;
+    int frameCount = HEADLESS_DEFAULT_FRAMES;
+    std::string dumpDirectory;
+    std::string tracePath;
+    for (int i = 1; i < argc; ++i)
     {
-        std::cout << "Failed to create GLFW window." << std::endl;
-        glfwTerminate();
-        return -1;
+        bool validArgument = true;
+        if (std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(argv[i], "--compact") == 0)
+            compactVertices = true;
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            // Both dimensions, nothing after them, and neither of them 0 or negative
+            int width = 0, height = 0;
+            char trailing;
+            validArgument = std::sscanf(argv[++i], "%dx%d%c", &width, &height, &trailing) == 2 && width > 0 && height > 0;
+            viewportWidth = width;
+            viewportHeight = height;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long frames = std::strtol(argv[++i], &end, 10);
+            validArgument = end != argv[i] && *end == '\0' && frames > 0 && frames <= INT_MAX;
+            frameCount = static_cast<int>(frames);
+        }
+        else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            dumpDirectory = argv[++i];
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else
+            validArgument = false;
+        
+        if (!validArgument)
+        {
+            std::cout << "Usage: " << argv[0] << " [--headless] [--compact] [--size WIDTHxHEIGHT] [--frames N] [--dump DIRECTORY] [--trace PATH]" << std::endl;
+            return -1;
+        }
     }
-    glfwMakeContextCurrent(window);
+    lastX = viewportWidth / 2;
+    lastY = viewportHeight / 2;
     
-    glfwSetKeyCallback(window, key_callback);                       // Register our callbacks
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    
-    //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    
-    glewExperimental = GL_TRUE;                                     // We want to use more modern techniques for managing OpenGL
-    if (glewInit() != GLEW_OK)                                      // Initialize GLEW, which manages function pointers for OpenGL
-
+    std::unique_ptr<HeadlessContext> headlessContext;
+    if (headless)
     {
-        std::cout << "Failed to initialize GLEW." << std::endl;
-        return -1;
+        headlessContext.reset(new HeadlessContext(viewportWidth, viewportHeight));
+        if (!headlessContext->isValid()) return -1;
+    }
+    else
+    {
+        glfwInit();                                                 // Instantiate GLFW
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);              // Tell GLFW that we want to use version 3.3 of OpenGL
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // Use the core profile
+        //glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);                       // Don't let the user resize the window
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_SAMPLES, 4);
+        
+        window = glfwCreateWindow(viewportWidth, viewportHeight, "LearnOpenGL", nullptr, nullptr);
+        if (window == nullptr)
+        {
+            std::cout << "Failed to create GLFW window." << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        
+        glfwSetKeyCallback(window, key_callback);                   // Register our callbacks
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        
+        //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        
+        glewExperimental = GL_TRUE;                                 // We want to use more modern techniques for managing OpenGL
+        if (glewInit() != GLEW_OK)                                  // Initialize GLEW, which manages function pointers for OpenGL
+
+        {
+            std::cout << "Failed to initialize GLEW." << std::endl;
+            return -1;
+        }
     }
     
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);                  // Tell OpenGL the size of the rendering window
-    glEnable(GL_DEPTH_TEST);
+    GlState &glState = GlState::getInstance();
+    Profiler &profiler = Profiler::getInstance();
+    glState.viewport(0, 0, viewportWidth, viewportHeight);          // Tell OpenGL the size of the rendering window
+    glState.enable(GL_DEPTH_TEST);
     
     // Set up vertex data (and buffer(s)) and attribute pointers
     GLfloat vertices[] = {
@@ -195,75 +349,170 @@ int main(int argc, const char * argv[])
         glm::vec3( 0.0f,  0.0f, -3.0f)
     };
     
-    GLuint VAO, cubeVBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &cubeVBO);
+    /*
+     * Wrap the cube's vertices in a Mesh, which owns the VAO, VBO and EBO and knows how to describe the
+     * Vertex layout to OpenGL. Both the lit containers and the lamps are drawn from this one mesh: the
+     * lamp shader simply ignores the normal and texture coordinate attributes, and the diffuse and
+     * specular maps that make up the mesh's material.
+     */
+    std::vector<Vertex> cubeVertices;
+    std::vector<GLuint> cubeIndices;
+    for (GLuint i = 0; i < sizeof(vertices) / (8 * sizeof(GLfloat)); ++i)
+    {
+        Vertex vertex;
+        vertex.position = glm::vec3(vertices[i * 8 + 0], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+        vertex.normal = glm::vec3(vertices[i * 8 + 3], vertices[i * 8 + 4], vertices[i * 8 + 5]);
+        vertex.texCoord = glm::vec2(vertices[i * 8 + 6], vertices[i * 8 + 7]);
+        cubeVertices.push_back(vertex);
+        cubeIndices.push_back(i);
+    }
+    std::vector<Texture> cubeTextures(2);
+    cubeTextures[0].type = "texture_diffuse";
+    cubeTextures[0].path = aiString("assets/diffuse_map.png");
+    cubeTextures[1].type = "texture_specular";
+    cubeTextures[1].path = aiString("assets/specular_map.png");
+    for (auto &texture: cubeTextures)
+        texture.img = TextureCache::getInstance().load(texture.path.C_Str());
+    Mesh cube(cubeVertices, cubeIndices, cubeTextures, MATERIAL_DEFAULT_SHININESS);
+    
+    GlslProgram cubeProgram;
+    cubeProgram.setupProgramFromFile("shaders/lighting_instanced.vert", "shaders/multilight.frag");
+    
+    GlslProgram lightProgram;
+    lightProgram.setupProgramFromFile("shaders/source_instanced.vert", "shaders/source.frag");
+    
+    // The same lighting as cubeProgram, but with the transforms in uniforms: for the nanosuit, and for the cubes when they're drawn one by one
+    GlslProgram modelProgram;
+    modelProgram.setupProgramFromFile("shaders/lighting.vert", "shaders/multilight.frag");
+    
+    // Resolve the uniforms we set inside the draw loops once, up front
+    UniformHandle cubeViewProjectionUniform = cubeProgram.getUniform("uViewProjection");
+    UniformHandle cubeViewPosUniform = cubeProgram.getUniform("uViewPos");
+    UniformHandle lightViewProjectionUniform = lightProgram.getUniform("uViewProjection");
+    UniformHandle modelViewPosUniform = modelProgram.getUniform("uViewPos");
     
     /*
-     * A vertex array object (VAO) can be bound just like a vertex buffer object and any subsequent
-     * vertex attribute calls from that point on will be stored inside the VAO. This has the advantage
-     * that when configuring vertex attribute pointers you only have to make those calls once and
-     * whenever we want to draw the object, we can just bind the corresponding VAO. This makes switching
-     * between different vertex data and attribute configurations as easy as binding a different VAO.
-     * All the state we just set is stored inside the VAO.
-     * In particular, a VAO stores:
-     * 1) Calls to glEnableVertexAttribArray or glDisableVertexAttribArray
-     * 2) Vertex attribute configurations via glVertexAttribPointer
-     * 3) Vertex buffer objects associated with vertex attributes by calls to glVertexAttribPointer
+     * Per-object transforms live in structure-of-arrays stores, which rebuild all of their model
+     * matrices in one batched pass each frame. Each pass is then drawn with a single instanced call.
      */
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);                         // Any future buffer calls we make will be used to configure VBO
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    TransformStore cubeTransforms;
+    for (GLuint i = 0; i < sizeof(cubePositions) / sizeof(cubePositions[0]); ++i)
+    {
+        size_t index = cubeTransforms.add(cubePositions[i]);
+        cubeTransforms.setRotation(index, 20.0f * i, glm::vec3(1.0f, 0.3f, 0.5f));
+    }
     
     /*
-     * The parameters of glVertexAttribPointer are as follows:
-     * 1) The vertex attribute that we want to configure (corresponds to the layout qualifier in the shader)
-     * 2) The size of the vertex attribute
-     * 3) The type of the data
-     * 4) Do we want the data normalized?
-     * 5) The stride (we could just use 0 since our values are tightly packed)
-     * 6) The offset
-     * The data is pulled from the buffer that is currently bound to the GL_ARRAY_BUFFER targer (i.e. VBO)
+     * The lights are shared by every program that declares a LightBlock uniform block, and live in a
+     * single uniform buffer. Only the spotlight (which follows the camera) changes from frame to frame,
+     * so after the initial upload each frame only re-sends those few bytes.
      */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
+    LightBlock lights;
     
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+    DirLightData dirLight = {};
+    dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    dirLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.setDirLight(dirLight);
     
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(2);
+    for (const auto &position: pointLightPositions)
+    {
+        PointLightData pointLight = {};
+        pointLight.position = position;
+        pointLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        pointLight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        pointLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        pointLight.constant = 1.0f;
+        pointLight.linear = 0.09f;
+        pointLight.quadratic = 0.032f;
+        lights.addPointLight(pointLight);
+    }
     
-    glBindBuffer(GL_ARRAY_BUFFER, 0);                               // Unbind the VBO (good practice); note that we must leave the EBO bound
-    glBindVertexArray(0);
+    SpotLightData spotLight = {};
+    spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    spotLight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+    spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    spotLight.constant = 1.0f;
+    spotLight.linear = 0.09f;
+    spotLight.quadratic = 0.032f;
+    spotLight.cutoff = glm::cos(glm::radians(12.5f));
+    spotLight.outerCutoff = glm::cos(glm::radians(15.0f));
     
+    lights.setup();
+    lights.bindProgram(cubeProgram);
+    lights.bindProgram(modelProgram);
     
-    GLuint lightVAO;
-    glGenVertexArrays(1, &lightVAO);
-    glBindVertexArray(lightVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);                         // We only need to bind to the VBO, the container's VBO's data already contains the correct data.
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);   // Set the vertex attributes (only position data for our lamp)
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    TransformStore lightTransforms;
+    for (GLint i = 0; i < lights.getNumPointLights(); ++i)
+        lightTransforms.add(lights.getPointLight(i).position, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec3(0.2f));
     
+    /*
+     * Instances whose bounding sphere falls outside the view frustum are dropped before drawing. The
+     * running totals are shown in the window title once a second.
+     */
+    Frustum frustum;
+    CullStats cullStats;
+    std::vector<glm::mat4> visibleModels;
+    std::vector<glm::mat4> visibleLights;
     
-    GlslProgram cubeProgram;
-    cubeProgram.setupProgramFromFile("shaders/lighting.vert", "shaders/multilight.frag");
+    /*
+     * Both passes are submitted to a queue rather than drawn on the spot; it decides the order they're
+     * drawn in. Each program gets its per-frame uniforms before the queue runs.
+     */
+    RenderQueue renderQueue;
     
-    GlslProgram lightProgram;
-    lightProgram.setupProgramFromFile("shaders/source.vert", "shaders/source.frag");
+    // A single model, standing among the cubes, drawn through whichever path modelDrawPath says
+    Model nanosuit(NANOSUIT_MODEL.c_str(), false, compactVertices ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FLOAT);
+    glm::mat4 nanosuitTransform = glm::scale(glm::translate(glm::mat4(), glm::vec3(-1.2f, -1.0f, 0.0f)), glm::vec3(0.1f));
+    UniformHandle modelModelUniform = modelProgram.getUniform("uModel");
+    UniformHandle modelModelViewProjectionUniform = modelProgram.getUniform("uModelViewProjection");
+    UniformHandle modelNormalMatrixUniform = modelProgram.getUniform("uNormalMatrix");
+    
+    /*
+     * Keeps the nanosuit's and the cubes' textures within the budget by dropping mip levels from
+     * whichever ones haven't been drawn with for the longest. Every frame touches the textures it
+     * draws with before updating it.
+     */
+    TextureResidency textureResidency(TEXTURE_BUDGET_BYTES);
+    nanosuit.trackTextures(textureResidency);
+    for (const auto &texture: cubeTextures)
+        textureResidency.track(texture.img, texture.path.C_Str());
     
-    Image tex0;
-    tex0.loadImage("assets/diffuse_map.png", 500, 500);
+    /*
+     * The cubes are also kept in a BVH, which both the frustum culling and mouse picking walk instead
+     * of testing every cube. It's refit to the cubes' current world space bounds every frame, so they
+     * would be free to move.
+     */
+    BVH cubeBVH;
+    std::vector<AABB> cubeBounds;
+    std::vector<size_t> visibleCubes;
+    GLfloat lastStatsTime = 0.0f;
+    
+    /*
+     * Loading textures while rendering: the streamer keeps each frame's share of the work bounded,
+     * while loading synchronously stalls a single frame for the whole batch. Either way, we record
+     * the frame times from the moment the load starts and print them as a histogram.
+     */
+    std::unique_ptr<TextureStreamer> streamer(new TextureStreamer());
+    std::vector<std::shared_future<TextureHandle>> streamedTextures;
+    std::vector<Image> syncTextures;
+    FrameHistogram loadFrameTimes;
+    FrameHistogram headlessFrameTimes;
+    std::string loadDescription;
     
-    Image tex1;
-    tex1.loadImage("assets/specular_map.png", 500, 500);
+    /*
+     * Saving one of the shaders these programs were built from recompiles them before the next frame.
+     * If the edited shader doesn't compile, the log is printed and the previous version keeps running.
+     */
+    ShaderWatcher shaderWatcher;
+    shaderWatcher.watch(cubeProgram);
+    shaderWatcher.watch(lightProgram);
+    shaderWatcher.watch(modelProgram);
     
     /*
      * Everything that follows is our "game" or "rendering" loop. This will keep executing
-     * until GLFW has been instructed to close. The glfwPollEvents function checks if any
+     * until GLFW has been instructed to close (or, headless, for the requested number of frames). The glfwPollEvents function checks if any
      * events are triggered and calls the corresponding functions. The glfwSwapBuffers function
      * does exactly what it says. This technique is known as "double buffering." The front buffer 
      * contains the final output image that is shown at the screen, while all the rendering 
@@ -271,9 +520,11 @@ int main(int argc, const char * argv[])
      * the back buffer to the front buffer so the image is instantly displayed to the user, removing 
      * any would-be drawing artifacts.
      */
-    while(!glfwWindowShouldClose(window))
+    for (int frame = 0; headless ? frame < frameCount : !glfwWindowShouldClose(window); ++frame)
     {
-        glfwPollEvents();
+        auto frameStartTime = std::chrono::high_resolution_clock::now();
+        ProfileScope frameZone("Frame");
+        if (!headless) glfwPollEvents();
         
         /* 
          * Currently we used a constant value for movement speed when walking around. 
@@ -285,153 +536,258 @@ int main(int argc, const char * argv[])
          * shipping your application you want to make sure it runs the same on all kinds 
          * of hardware.
          */
-        GLfloat currentFrame = glfwGetTime();
+        GLfloat currentFrame = headless ? frame * HEADLESS_FRAME_TIME : glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         calculateCameraMovement();
         
+        if (!loadDescription.empty())
+        {
+            loadFrameTimes.record(deltaTime * 1000.0);
+            if (loadFrameTimes.getFrameCount() >= LOAD_MEASURE_FRAMES && !streamer->isBusy())
+            {
+                loadFrameTimes.print(std::cout, loadDescription);
+                loadDescription.clear();
+            }
+        }
+        if (streamRequested && loadDescription.empty())
+        {
+            streamedTextures.clear();
+            for (const auto &path: NANOSUIT_TEXTURES)
+                streamedTextures.push_back(streamer->request(path));
+            loadFrameTimes.reset();
+            loadDescription = "Frame times while streaming the nanosuit's textures";
+        }
+        if (syncLoadRequested && loadDescription.empty())
+        {
+            for (auto &texture: syncTextures)
+                texture.release();
+            TextureLoader loader;
+            syncTextures = loader.loadImages(NANOSUIT_TEXTURES);
+            loadFrameTimes.reset();
+            loadDescription = "Frame times while loading the nanosuit's textures synchronously";
+        }
+        streamRequested = syncLoadRequested = false;
+        streamer->update();
+        shaderWatcher.update();
+        
         // ===============================
         // Rendering starts here
         // ===============================
         
+        // Benchmarks that draw go first, so that the frame is cleared of what they drew
+        if (instancingBenchmarkRequested)
+        {
+            glm::mat4 benchmarkProjection = glm::perspective(glm::radians(cam.getFOV()), viewportWidth / (float)viewportHeight, 0.1f, 100.0f);
+            cube.benchmarkInstancing(std::cout, modelProgram, cubeProgram, benchmarkProjection * cam.getViewMatrix());
+            instancingBenchmarkRequested = false;
+        }
+        if (drawBenchmarkRequested)
+        {
+            glm::mat4 benchmarkProjection = glm::perspective(glm::radians(cam.getFOV()), viewportWidth / (float)viewportHeight, 0.1f, 100.0f);
+            nanosuit.benchmarkDraws(std::cout, modelProgram, nanosuitTransform, cam.getViewMatrix(), benchmarkProjection);
+            drawBenchmarkRequested = false;
+        }
+        
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);                       // A state-setting function that sets the clear color
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);         // A state-using function that clears the active buffer
         
         
         //=================================================================== Cube program begins
+        ProfileScope cubePass("Cube pass");
         cubeProgram.begin();
         
-        glBindVertexArray(VAO);
-        
         /*
          * The parameters of glm::perspective are as follows
          * 1) The FOV (in radians)
          * 2) The aspect ratio
          * 3 / 4) The near and far clipping planes
          */
-        glm::mat4 model;
-        glm::mat4 uModelViewProjection;
-        glm::mat4 projection = glm::perspective(glm::radians(cam.getFOV()), WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
-        cubeProgram.setUniform3f("uViewPos", cam.getPositionVector().x, cam.getPositionVector().y, cam.getPositionVector().z);
+        glm::mat4 projection = glm::perspective(glm::radians(cam.getFOV()), viewportWidth / (float)viewportHeight, 0.1f, 100.0f);
+        glm::mat4 viewProjection = projection * cam.getViewMatrix();
+        frustum.update(viewProjection);
+        cullStats.reset();
         
-        /*
-         * The default texture unit for a texture is 0, which is the default active texture unit so we
-         * did not need to assign a location to this texture before binding it. If, however, we want to bind
-         * multiple textures simultaneously, we will need to manually assign texture units.
-         * To use the second texture (and the first texture) we have to change the rendering procedure
-         * a bit by binding both textures to the corresponding texture unit and specifying which uniform
-         * sampler corresponds to which texture unit.
-         */
-        cubeProgram.setUniformSampler2D("material.diffuse", tex0, 0);
-        cubeProgram.setUniformSampler2D("material.specular", tex1, 1);
-        cubeProgram.setUniform1f("material.shininess", 32.0f);
-        
-        // Directional light
-        cubeProgram.setUniform3f("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        cubeProgram.setUniform3f("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        cubeProgram.setUniform3f("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        cubeProgram.setUniform3f("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        
-        // Point light 1
-        cubeProgram.setUniform3f("pointLights[0].position", pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-        cubeProgram.setUniform3f("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        cubeProgram.setUniform3f("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        cubeProgram.setUniform3f("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform1f("pointLights[0].constant", 1.0f);
-        cubeProgram.setUniform1f("pointLights[0].linear", 0.09);
-        cubeProgram.setUniform1f("pointLights[0].quadratic", 0.032);
-        
-        // Point light 2
-        cubeProgram.setUniform3f("pointLights[1].position", pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-        cubeProgram.setUniform3f("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        cubeProgram.setUniform3f("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        cubeProgram.setUniform3f("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform1f("pointLights[1].constant", 1.0f);
-        cubeProgram.setUniform1f("pointLights[1].linear", 0.09);
-        cubeProgram.setUniform1f("pointLights[1].quadratic", 0.032);
-        
-        // Point light 3
-        cubeProgram.setUniform3f("pointLights[2].position", pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-        cubeProgram.setUniform3f("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-        cubeProgram.setUniform3f("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-        cubeProgram.setUniform3f("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform1f("pointLights[2].constant", 1.0f);
-        cubeProgram.setUniform1f("pointLights[2].linear", 0.09);
-        cubeProgram.setUniform1f("pointLights[2].quadratic", 0.032);
-        
-        // Point light 4
-        cubeProgram.setUniform3f("pointLights[3].position", pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z);
-        cubeProgram.setUniform3f("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-        cubeProgram.setUniform3f("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-        cubeProgram.setUniform3f("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform1f("pointLights[3].constant", 1.0f);
-        cubeProgram.setUniform1f("pointLights[3].linear", 0.09);
-        cubeProgram.setUniform1f("pointLights[3].quadratic", 0.032);
-        
-        // Spotlight
-        cubeProgram.setUniform3f("spotLight.position", cam.getPositionVector().x, cam.getPositionVector().y, cam.getPositionVector().z);
-        cubeProgram.setUniform3f("spotLight.direction", cam.getFrontVector().x, cam.getFrontVector().y, cam.getFrontVector().z);
-        cubeProgram.setUniform3f("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        cubeProgram.setUniform3f("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform3f("spotLight.specular", 1.0f, 1.0f, 1.0f);
-        cubeProgram.setUniform1f("spotLight.constant", 1.0f);
-        cubeProgram.setUniform1f("spotLight.linear", 0.09);
-        cubeProgram.setUniform1f("spotLight.quadratic", 0.032);
-        cubeProgram.setUniform1f("spotLight.cutoff", glm::cos(glm::radians(12.5f)));
-        cubeProgram.setUniform1f("spotLight.outerCutoff", glm::cos(glm::radians(15.0f)));
-        
-        for(GLuint i = 0; i < 10; ++i)
+        ProfileScope uniformUpload("Uniform upload");
+        cubeProgram.set(cubeViewProjectionUniform, viewProjection);
+        cubeProgram.set(cubeViewPosUniform, cam.getPositionVector());
+        
+        // Only the spotlight moves, so it is the only part of the light block that gets re-uploaded
+        spotLight.position = cam.getPositionVector();
+        spotLight.direction = cam.getFrontVector();
+        lights.setSpotLight(spotLight);
+        lights.upload();
+        uniformUpload.end();
+        
+        cubeTransforms.update();
+        const std::vector<glm::mat4> &cubeModels = cubeTransforms.getModelMatrices();
+        cubeBounds.resize(cubeModels.size());
+        for (size_t i = 0; i < cubeModels.size(); ++i)
+            cubeBounds[i] = transformAABB(cube.getAABB(), cubeModels[i]);
+        cubeBVH.refit(cubeBounds);
+        
+        if (pickRequested)
         {
-            GLfloat angle = 20.0f * i;
-            model = glm::mat4();
-            model = glm::translate(model, cubePositions[i]);
-            model = glm::rotate(model, angle, glm::vec3(1.0f, 0.3f, 0.5f));
-            uModelViewProjection = projection * cam.getViewMatrix() * model;
-            cubeProgram.setUniform4x4Matrix("uModel", model);
-            cubeProgram.setUniform4x4Matrix("uModelViewProjection", uModelViewProjection);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            RayHit hit;
+            if (cubeBVH.raycast(cam.getRay(lastX, lastY, viewportWidth, viewportHeight), hit))
+                std::cout << "Picked cube " << hit.object << " at a distance of " << hit.distance << "." << std::endl;
+            pickRequested = false;
         }
         
-        tex0.unbind();
-        tex1.unbind();
+        visibleCubes.clear();
+        cubeBVH.queryFrustum(frustum, visibleCubes, &cullStats);
+        visibleModels.clear();
+        for (size_t index: visibleCubes)
+            visibleModels.push_back(cubeModels[index]);
+        
+        DrawItem cubes = DrawItem();
+        cubes.program = &cubeProgram;
+        cubes.mesh = &cube;
+        cubes.instances = &visibleModels;
+        cubes.zone = "Cube pass";
+        renderQueue.submit(cubes);
         
-        cubeProgram.end();
+        cubePass.end();
         //=================================================================== Cube program ends
     
         
         //=================================================================== Light program begins
+        ProfileScope lightPass("Light pass");
         lightProgram.begin();
+        lightProgram.set(lightViewProjectionUniform, viewProjection);
         
-        glBindVertexArray(lightVAO);
+        lightTransforms.update();
+        cube.cullInstances(frustum, lightTransforms.getModelMatrices(), visibleLights, cullStats);
         
-        for (GLuint i = 0; i < 4; ++i)
+        DrawItem lamps = DrawItem();
+        lamps.program = &lightProgram;
+        lamps.mesh = &cube;
+        lamps.instances = &visibleLights;
+        lamps.zone = "Light pass";
+        renderQueue.submit(lamps);
+        
+        lightPass.end();
+        //=================================================================== Light program ends
+        
+        
+        //=================================================================== Model program begins
+        ProfileScope modelPass("Model pass");
+        modelProgram.begin();
+        modelProgram.set(modelViewPosUniform, cam.getPositionVector());
+        
+        // The queue sets the transforms for each of its draws; the other two paths leave them to us
+        if (modelDrawPath == MODEL_DRAW_QUEUE)
+        {
+            nanosuit.submit(renderQueue, modelProgram, nanosuitTransform, cam.getViewMatrix());
+        }
+        else
         {
-            model = glm::mat4();
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));
-            uModelViewProjection = projection * cam.getViewMatrix() * model;
-            lightProgram.setUniform4x4Matrix("uModelViewProjection", uModelViewProjection);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glm::mat4 vertexModel = nanosuitTransform * nanosuit.getVertexTransform();
+            modelProgram.set(modelModelUniform, vertexModel);
+            modelProgram.set(modelModelViewProjectionUniform, viewProjection * vertexModel);
+            modelProgram.set(modelNormalMatrixUniform, computeNormalMatrix(nanosuitTransform));
+            profiler.beginGpuZone("Model pass");
+            if (modelDrawPath == MODEL_DRAW_INDIRECT)
+                nanosuit.drawIndirect(modelProgram);
+            else
+                nanosuit.drawLOD(modelProgram, nanosuitTransform, cam, static_cast<float>(viewportHeight));
+            profiler.endGpuZone();
         }
         
-        lightProgram.end();
-        //=================================================================== Light program ends
+        modelPass.end();
+        //=================================================================== Model program ends
         
+        // The passes' GPU zones are timed in here, where they're actually drawn
+        ProfileScope drawZone("Render queue");
+        renderQueue.sort();
+        renderQueue.execute(viewProjection);
+        renderQueue.clear();
+        drawZone.end();
         
-        glBindVertexArray(0);
+        nanosuit.touchTextures(textureResidency);
+        if (!visibleCubes.empty())
+            for (const auto &texture: cubeTextures)
+                textureResidency.touch(texture.img);
+        textureResidency.update();
+        
+        if (queueBenchmarkRequested)
+        {
+            RenderQueue::benchmark(std::cout);
+            queueBenchmarkRequested = false;
+        }
+        if (normalMatrixBenchmarkRequested)
+        {
+            benchmarkNormalMatrices(std::cout);
+            normalMatrixBenchmarkRequested = false;
+        }
+        if (bvhBenchmarkRequested)
+        {
+            for (size_t objectCount: BVH_BENCHMARK_SIZES)
+                BVH::benchmark(std::cout, objectCount);
+            bvhBenchmarkRequested = false;
+        }
+        if (loadBenchmarkRequested)
+        {
+            Model::benchmarkLoad(std::cout, NANOSUIT_MODEL);
+            loadBenchmarkRequested = false;
+        }
         
 
         // ===============================
         // Rendering ends here
         // ===============================
         
-        glfwSwapBuffers(window);
+        if (!headless && currentFrame - lastStatsTime >= 1.0f)
+        {
+            std::stringstream title;
+            title << "LearnOpenGL - tested " << cullStats.tested << ", culled " << cullStats.culled << ", drawn " << cullStats.drawn;
+            glfwSetWindowTitle(window, title.str().c_str());
+            lastStatsTime = currentFrame;
+        }
+        
+        if (headless)
+        {
+            headlessContext->finishFrame();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - frameStartTime;
+            headlessFrameTimes.record(elapsed.count());
+            if (!dumpDirectory.empty())
+            {
+                char fileName[32];
+                std::snprintf(fileName, sizeof(fileName), "/frame_%05d.bmp", frame);
+                headlessContext->writeFrame(dumpDirectory + fileName);
+            }
+        }
+        else
+            glfwSwapBuffers(window);
+        
+        frameZone.end();
+        profiler.endFrame();
+        if (traceRequested)
+        {
+            profiler.printStats(std::cout);
+            textureResidency.printStats(std::cout);
+            if (profiler.writeChromeTrace(TRACE_PATH))
+                std::cout << "Wrote the profiler trace to " << TRACE_PATH << "." << std::endl;
+            traceRequested = false;
+        }
     }
     
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &cubeVBO);
+    // These release their textures, which needs the context
+    streamedTextures.clear();
+    streamer.reset();
     
-    glfwTerminate();                                                
+    if (headless)
+    {
+        std::stringstream description;
+        description << "Headless frame times at " << viewportWidth << "x" << viewportHeight;
+        headlessFrameTimes.print(std::cout, description.str());
+    }
+    glState.printCounters(std::cout);
+    textureResidency.printStats(std::cout);
+    profiler.printStats(std::cout);
+    if (!tracePath.empty() && profiler.writeChromeTrace(tracePath))
+        std::cout << "Wrote the profiler trace to " << tracePath << "." << std::endl;
+    if (!headless) glfwTerminate();
     std::cout << "Terminating the application." << std::endl;
     return 0;
 }
@@ -14,6 +14,7 @@ out VS_OUT
 
 uniform mat4 uModelViewProjection;
 uniform mat4 uModel;
+uniform mat3 uNormalMatrix;
 uniform vec3 uViewPos;
 
 void main()
@@ -21,12 +22,11 @@ void main()
     /* 
      * Inversing matrices is a costly operation even for shaders so wherever possible, 
      * try to avoid doing inverse operations in shaders since they have to be done on 
-     * each vertex of your scene. For learning purposes this is fine, but for an efficient 
-     * application you'll likely want to calculate the normal matrix on the CPU and send 
-     * it to the shaders via a uniform before drawing (just like the model matrix).
+     * each vertex of your scene. Instead, the normal matrix is calculated once per object 
+     * on the CPU (see computeNormalMatrix in Transform.h) and sent along as a uniform, 
+     * just like the model matrix.
      */
-    mat3 normalMatrix = mat3(transpose(inverse(uModel)));
-    vs_out.normal = normalMatrix * normal;
+    vs_out.normal = uNormalMatrix * normal;
     vs_out.texCoord = texCoord;
     vs_out.worldPos = vec3(uModel * vec4(position, 1.0f));
     
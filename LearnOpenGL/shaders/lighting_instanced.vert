@@ -0,0 +1,31 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoord;
+layout (location = 3) in mat4 instanceModel;                   // Occupies locations 3 through 6
+layout (location = 7) in mat3 instanceNormalMatrix;            // Occupies locations 7 through 9
+
+out VS_OUT
+{
+    vec3 color;
+    vec2 texCoord;
+    vec3 normal;
+    vec3 worldPos;
+} vs_out;
+
+uniform mat4 uViewProjection;
+
+void main()
+{
+    /*
+     * Same as lighting.vert, except that the model and normal matrices come from per-instance
+     * vertex attributes (see Mesh::drawInstanced), so the whole batch is drawn with a single call.
+     */
+    vec4 worldPos = instanceModel * vec4(position, 1.0f);
+    vs_out.normal = instanceNormalMatrix * normal;
+    vs_out.texCoord = texCoord;
+    vs_out.worldPos = vec3(worldPos);
+    
+    gl_Position = uViewProjection * worldPos;
+}
\ No newline at end of file
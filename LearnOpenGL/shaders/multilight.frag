@@ -14,15 +14,20 @@ in VS_OUT
 //=================================================================== Material properties
 struct Material
 {
-    sampler2D diffuse;
-    sampler2D specular;
+    sampler2D texture_diffuse0;
+    sampler2D texture_specular0;
     float shininess;
 };
 
 uniform Material material;
 uniform vec3 uViewPos;
 
-//=================================================================== Directional light(s)
+//=================================================================== Light structures
+/*
+ * All of the lights live in a single std140 uniform block that the application fills from one
+ * uniform buffer (see LightBlock.h, whose structs must mirror the ones below). Under std140 a vec3
+ * takes up 16 bytes, so wherever possible each vec3 is followed by a float that fills the gap.
+ */
 struct DirLight
 {
     vec3 direction;
@@ -31,8 +36,42 @@ struct DirLight
     vec3 specular;
 };
 
-uniform DirLight dirLight;
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
 
+struct SpotLight
+{
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutoff;
+    vec3 specular;
+    float outerCutoff;
+};
+
+const int MAX_POINT_LIGHTS = 64;
+
+layout (std140) uniform LightBlock
+{
+    int numPointLights;
+    DirLight dirLight;
+    SpotLight spotLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+//=================================================================== Directional light(s)
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
@@ -45,30 +84,14 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     
     // Combine results
-    vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, fs_in.texCoord));
-    vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, fs_in.texCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, fs_in.texCoord));
+    vec3 ambient  = light.ambient  * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
+    vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
+    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular0, fs_in.texCoord));
     
     return (ambient + diffuse + specular);
 }
 
 //=================================================================== Point light(s)
-struct PointLight
-{
-    vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-const int NR_POINT_LIGHTS = 4;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
@@ -85,9 +108,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     
     // Combine results
-    vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, fs_in.texCoord));
-    vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, fs_in.texCoord));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, fs_in.texCoord));
+    vec3 ambient  = light.ambient  * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
+    vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
+    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular0, fs_in.texCoord));
     ambient  *= attenuation;
     diffuse  *= attenuation;
     specular *= attenuation;
@@ -96,39 +119,20 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 }
 
 //=================================================================== Spotlight(s)
-struct SpotLight
-{
-    vec3 position;
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    
-    float constant;
-    float linear;
-    float quadratic;
-    
-    vec3 direction;
-    float cutoff;
-    float outerCutoff;
-};
-
-uniform SpotLight spotLight;
-
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // Ambient shading
-    vec3 ambient            = light.ambient * vec3(texture(material.diffuse, fs_in.texCoord));
+    vec3 ambient            = light.ambient * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
     
     // Diffuse shading
     vec3 lightDir           = normalize(light.position - fragPos);
     float diffuseStrength   = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse            = light.diffuse * diffuseStrength * vec3(texture(material.diffuse, fs_in.texCoord));
+    vec3 diffuse            = light.diffuse * diffuseStrength * vec3(texture(material.texture_diffuse0, fs_in.texCoord));
     
     // Specular shading
     vec3 reflectDir         = reflect(-lightDir, normal);
     float specularStrength  = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular           = light.specular * specularStrength * vec3(texture(material.specular, fs_in.texCoord));
+    vec3 specular           = light.specular * specularStrength * vec3(texture(material.texture_specular0, fs_in.texCoord));
     
     // Inner and outer cone
     float theta             = dot(lightDir, normalize(-light.direction));
@@ -157,7 +161,7 @@ void main()
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
     
     // Point light(s)
-    for (int i = 0; i < NR_POINT_LIGHTS; ++i)
+    for (int i = 0; i < numPointLights; ++i)
     {
         result += CalcPointLight(pointLights[i], norm, fs_in.worldPos, viewDir);
     }
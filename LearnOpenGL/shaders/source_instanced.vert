@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 3) in mat4 instanceModel;                   // Occupies locations 3 through 6
+
+uniform mat4 uViewProjection;
+
+void main()
+{
+    gl_Position = uViewProjection * instanceModel * vec4(position, 1.0);
+}
\ No newline at end of file
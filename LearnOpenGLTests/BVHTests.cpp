@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "BVH.h"
+
+static AABB makeBox(const glm::vec3 &center, float halfSize)
+{
+    AABB box;
+    box.min = center - glm::vec3(halfSize);
+    box.max = center + glm::vec3(halfSize);
+    return box;
+}
+
+static Ray makeRay(const glm::vec3 &origin, const glm::vec3 &direction)
+{
+    Ray ray;
+    ray.origin = origin;
+    ray.direction = glm::normalize(direction);
+    return ray;
+}
+
+// Where the ray enters the box, the slow way: the largest entry over the three slabs, if it's before every exit
+static float getEntryDistance(const Ray &ray, const AABB &box)
+{
+    float enter = 0.0f;
+    float exit = INFINITY;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t0 = (box.min[axis] - ray.origin[axis]) / ray.direction[axis];
+        float t1 = (box.max[axis] - ray.origin[axis]) / ray.direction[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return enter <= exit ? enter : INFINITY;
+}
+
+// Small boxes scattered through a 200 unit cube, enough of them for a tree several levels deep
+static std::vector<AABB> makeScene(size_t count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> pickCoordinate(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> pickSize(0.5f, 3.0f);
+    std::vector<AABB> bounds(count);
+    for (auto &box: bounds)
+        box = makeBox(glm::vec3(pickCoordinate(random), pickCoordinate(random), pickCoordinate(random)), pickSize(random));
+    return bounds;
+}
+
+TEST(BVHTest, PicksTheNearestOfSeveralBoxesOnTheRay)
+{
+    // Boxes along +x, added far to near, plus some off to the side of the ray
+    std::vector<AABB> bounds;
+    for (int i = 10; i > 0; --i)
+        bounds.push_back(makeBox(glm::vec3(i * 5.0f, 0.0f, 0.0f), 1.0f));
+    for (int i = 0; i < 50; ++i)
+        bounds.push_back(makeBox(glm::vec3(i * 2.0f, 10.0f, 0.0f), 0.5f));
+
+    BVH bvh;
+    bvh.build(bounds);
+    ASSERT_EQ(bounds.size(), bvh.getObjectCount());
+
+    RayHit hit;
+    ASSERT_TRUE(bvh.raycast(makeRay(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), hit));
+    EXPECT_EQ(9u, hit.object);
+    EXPECT_FLOAT_EQ(4.0f, hit.distance);
+
+    // From the other end, the first box added is the nearest
+    ASSERT_TRUE(bvh.raycast(makeRay(glm::vec3(100.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f)), hit));
+    EXPECT_EQ(0u, hit.object);
+    EXPECT_FLOAT_EQ(49.0f, hit.distance);
+}
+
+TEST(BVHTest, RespectsMaxDistanceAndMisses)
+{
+    std::vector<AABB> bounds = { makeBox(glm::vec3(10.0f, 0.0f, 0.0f), 1.0f), makeBox(glm::vec3(20.0f, 0.0f, 0.0f), 1.0f) };
+    BVH bvh;
+    bvh.build(bounds);
+
+    RayHit hit;
+    EXPECT_FALSE(bvh.raycast(makeRay(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), hit, 5.0f));
+    EXPECT_FALSE(bvh.raycast(makeRay(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), hit));
+    EXPECT_FALSE(bvh.raycast(makeRay(glm::vec3(0.0f), glm::vec3(-1.0f, 0.0f, 0.0f)), hit));
+
+    BVH empty;
+    EXPECT_FALSE(empty.raycast(makeRay(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), hit));
+}
+
+// A ray that starts inside a box hits it right away
+TEST(BVHTest, PicksTheBoxTheRayStartsIn)
+{
+    std::vector<AABB> bounds = { makeBox(glm::vec3(10.0f, 0.0f, 0.0f), 1.0f), makeBox(glm::vec3(0.0f), 2.0f) };
+    BVH bvh;
+    bvh.build(bounds);
+
+    RayHit hit;
+    ASSERT_TRUE(bvh.raycast(makeRay(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), hit));
+    EXPECT_EQ(1u, hit.object);
+    EXPECT_EQ(0.0f, hit.distance);
+}
+
+TEST(BVHTest, PickingMatchesTestingEveryBox)
+{
+    std::vector<AABB> bounds = makeScene(5000, 3);
+    BVH bvh;
+    bvh.build(bounds);
+
+    std::mt19937 random(4);
+    std::uniform_real_distribution<float> pickUnit(-1.0f, 1.0f);
+    size_t hits = 0;
+    for (int i = 0; i < 500; ++i)
+    {
+        Ray ray = makeRay(glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random)) * 120.0f,
+                          glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random) + 0.01f));
+        float nearest = INFINITY;
+        for (const auto &box: bounds)
+            nearest = std::min(nearest, getEntryDistance(ray, box));
+
+        RayHit hit;
+        bool found = bvh.raycast(ray, hit);
+        ASSERT_EQ(nearest != INFINITY, found) << "ray " << i;
+        if (!found) continue;
+        ++hits;
+        EXPECT_NEAR(nearest, hit.distance, 1e-3f) << "ray " << i;
+        EXPECT_NEAR(nearest, getEntryDistance(ray, bounds[hit.object]), 1e-3f) << "ray " << i;
+    }
+    EXPECT_GT(hits, 50u);
+}
+
+TEST(BVHTest, FrustumQueryMatchesTestingEveryBox)
+{
+    std::vector<AABB> bounds = makeScene(5000, 5);
+    BVH bvh;
+    bvh.build(bounds);
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 150.0f);
+    const glm::vec3 targets[] = { glm::vec3(0.0f), glm::vec3(100.0f, 0.0f, 0.0f), glm::vec3(0.0f, -100.0f, 50.0f) };
+    for (const auto &target: targets)
+    {
+        Frustum frustum(projection * glm::lookAt(glm::vec3(-20.0f, 10.0f, 30.0f), target, glm::vec3(0.0f, 1.0f, 0.0f)));
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < bounds.size(); ++i)
+            if (frustum.intersects(bounds[i])) expected.push_back(i);
+
+        std::vector<size_t> visible;
+        CullStats stats;
+        EXPECT_EQ(expected.size(), bvh.queryFrustum(frustum, visible, &stats));
+        std::sort(visible.begin(), visible.end());
+        EXPECT_EQ(expected, visible);
+        EXPECT_EQ(bounds.size(), stats.tested);
+        EXPECT_EQ(expected.size(), stats.drawn);
+    }
+}
+
+TEST(BVHTest, RefitFollowsMovedObjects)
+{
+    std::vector<AABB> bounds = makeScene(1000, 6);
+    BVH bvh;
+    bvh.build(bounds);
+
+    // Move one box far outside everything else; only a refit tree can still find it there
+    bounds[123] = makeBox(glm::vec3(0.0f, 0.0f, 500.0f), 1.0f);
+    bvh.refit(bounds);
+
+    RayHit hit;
+    ASSERT_TRUE(bvh.raycast(makeRay(glm::vec3(0.0f, 0.0f, 600.0f), glm::vec3(0.0f, 0.0f, -1.0f)), hit));
+    EXPECT_EQ(123u, hit.object);
+    EXPECT_FLOAT_EQ(99.0f, hit.distance);
+}
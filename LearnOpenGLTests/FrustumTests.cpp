@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Frustum.h"
+#include "Mesh.h"
+
+static AABB makeBox(const glm::vec3 &center, float halfSize)
+{
+    AABB box;
+    box.min = center - glm::vec3(halfSize);
+    box.max = center + glm::vec3(halfSize);
+    return box;
+}
+
+static BoundingSphere makeSphere(const glm::vec3 &center, float radius)
+{
+    BoundingSphere sphere;
+    sphere.center = center;
+    sphere.radius = radius;
+    return sphere;
+}
+
+/*
+ * A camera at the origin looking down -z with a 90 degree field of view and a square viewport, so the
+ * side planes are x = +-z and y = +-z, with the near plane at z = -1 and the far plane at z = -100.
+ */
+class FrustumCullingTest : public ::testing::Test
+{
+
+protected:
+
+    void SetUp() override
+    {
+        projection = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 100.0f);
+        view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        frustum.update(projection * view);
+    }
+
+    // classify() and intersects() have to agree on what's outside
+    ::FrustumTest classify(const AABB &box) const
+    {
+        ::FrustumTest result = frustum.classify(box);
+        EXPECT_EQ(result != FRUSTUM_OUTSIDE, frustum.intersects(box));
+        return result;
+    }
+
+    glm::mat4 projection;
+    glm::mat4 view;
+    Frustum frustum;
+
+};
+
+TEST_F(FrustumCullingTest, PlanesPointInwardsWithUnitNormals)
+{
+    glm::vec4 center(0.0f, 0.0f, -50.0f, 1.0f);
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        const glm::vec4 &plane = frustum.getPlane(static_cast<FrustumPlane>(i));
+        EXPECT_NEAR(1.0f, glm::length(glm::vec3(plane)), 1e-5f);
+        EXPECT_GT(glm::dot(plane, center), 0.0f);
+    }
+    EXPECT_NEAR(49.0f, glm::dot(frustum.getPlane(FRUSTUM_NEAR), center), 1e-3f);
+    EXPECT_NEAR(50.0f, glm::dot(frustum.getPlane(FRUSTUM_FAR), center), 1e-3f);
+}
+
+TEST_F(FrustumCullingTest, ClassifiesBoxesInside)
+{
+    EXPECT_EQ(FRUSTUM_INSIDE, classify(makeBox(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f)));
+    EXPECT_EQ(FRUSTUM_INSIDE, classify(makeBox(glm::vec3(5.0f, -5.0f, -50.0f), 10.0f)));
+}
+
+TEST_F(FrustumCullingTest, ClassifiesBoxesOutside)
+{
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f)));      // Behind the camera
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(0.0f, 0.0f, -200.0f), 1.0f)));    // Past the far plane
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(-30.0f, 0.0f, -10.0f), 1.0f)));   // Left
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(30.0f, 0.0f, -10.0f), 1.0f)));    // Right
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(0.0f, -30.0f, -10.0f), 1.0f)));   // Below
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(0.0f, 30.0f, -10.0f), 1.0f)));    // Above
+}
+
+TEST_F(FrustumCullingTest, ClassifiesBoxesStraddlingAPlane)
+{
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(0.0f, 0.0f, -1.0f), 0.5f)));   // Near
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(0.0f, 0.0f, -100.0f), 1.0f))); // Far
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(-10.0f, 0.0f, -10.0f), 1.0f)));// Left
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(0.0f, 10.0f, -10.0f), 1.0f))); // Top
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(0.0f, 0.0f, -50.0f), 500.0f)));// Around the whole frustum
+}
+
+TEST_F(FrustumCullingTest, MovingTheCameraMovesTheFrustum)
+{
+    // Now at (20, 0, 0) looking down +x: what used to be ahead is off to the left
+    view = glm::lookAt(glm::vec3(20.0f, 0.0f, 0.0f), glm::vec3(21.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frustum.update(projection * view);
+    EXPECT_EQ(FRUSTUM_OUTSIDE, classify(makeBox(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f)));
+    EXPECT_EQ(FRUSTUM_INSIDE, classify(makeBox(glm::vec3(40.0f, 0.0f, 0.0f), 1.0f)));
+    EXPECT_EQ(FRUSTUM_INTERSECTS, classify(makeBox(glm::vec3(30.0f, 0.0f, 10.0f), 1.0f)));
+}
+
+// With a pure translation the object space test has to give exactly the answer of the world space one
+TEST_F(FrustumCullingTest, TransformedFrustumTestsObjectSpaceBoxes)
+{
+    AABB local = makeBox(glm::vec3(0.0f), 1.0f);
+    const glm::vec3 offsets[] = { glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(-10.0f, 0.0f, -10.0f) };
+    for (const auto &offset: offsets)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(), offset);
+        EXPECT_EQ(frustum.classify(transformAABB(local, model)), frustum.transformed(model).classify(local));
+    }
+}
+
+// Nine spheres, so the SSE path handles two batches of four and the scalar path the last one
+TEST_F(FrustumCullingTest, CullsSpheres)
+{
+    std::vector<BoundingSphere> spheres = {
+        makeSphere(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f),        // Inside
+        makeSphere(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f),         // Behind
+        makeSphere(glm::vec3(-10.5f, 0.0f, -10.0f), 1.0f),      // Straddling the left plane
+        makeSphere(glm::vec3(30.0f, 0.0f, -10.0f), 1.0f),       // Right
+        makeSphere(glm::vec3(0.0f, 0.0f, -100.5f), 1.0f),       // Straddling the far plane
+        makeSphere(glm::vec3(0.0f, 0.0f, -102.0f), 1.0f),       // Past the far plane
+        makeSphere(glm::vec3(0.0f, 0.0f, -0.5f), 1.0f),         // Straddling the near plane
+        makeSphere(glm::vec3(0.0f, -30.0f, -10.0f), 1.0f),      // Below
+        makeSphere(glm::vec3(0.0f, 31.0f, -30.5f), 1.0f)        // Straddling the top plane
+    };
+    std::vector<size_t> visible;
+    CullStats stats;
+    EXPECT_EQ(5u, frustum.cullSpheres(&spheres[0], spheres.size(), visible, &stats));
+    EXPECT_EQ(std::vector<size_t>({ 0, 2, 4, 6, 8 }), visible);
+    EXPECT_EQ(9u, stats.tested);
+    EXPECT_EQ(4u, stats.culled);
+    EXPECT_EQ(5u, stats.drawn);
+
+    for (size_t i = 0; i < spheres.size(); ++i)
+        EXPECT_EQ(std::find(visible.begin(), visible.end(), i) != visible.end(), frustum.intersects(spheres[i])) << "sphere " << i;
+}
+
+TEST_F(FrustumCullingTest, CullsMeshInstances)
+{
+    std::vector<Vertex> vertices(4);
+    for (int i = 0; i < 4; ++i)
+        vertices[i].position = glm::vec3(float(i & 1) * 2.0f - 1.0f, float(i >> 1) * 2.0f - 1.0f, 0.0f);
+    Mesh mesh(vertices, std::vector<GLuint>({ 0, 1, 2, 2, 1, 3 }), std::vector<Texture>(), false);
+
+    std::vector<glm::mat4> modelMatrices = {
+        glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -10.0f)),
+        glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, 10.0f)),
+        glm::translate(glm::mat4(), glm::vec3(-10.0f, 0.0f, -10.0f)),
+        glm::scale(glm::translate(glm::mat4(), glm::vec3(-18.0f, 0.0f, -10.0f)), glm::vec3(5.0f)),
+        glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -150.0f))
+    };
+    std::vector<glm::mat4> visibleMatrices;
+    CullStats stats;
+    mesh.cullInstances(frustum, modelMatrices, visibleMatrices, stats);
+
+    // The scaled instance reaches back into the frustum through its grown bounding sphere
+    ASSERT_EQ(3u, visibleMatrices.size());
+    EXPECT_EQ(modelMatrices[0][3], visibleMatrices[0][3]);
+    EXPECT_EQ(modelMatrices[2][3], visibleMatrices[1][3]);
+    EXPECT_EQ(modelMatrices[3][3], visibleMatrices[2][3]);
+    EXPECT_EQ(5u, stats.tested);
+    EXPECT_EQ(2u, stats.culled);
+}
@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "GlState.h"
+
+// Every call that reaches the mock driver, in order, e.g. "bindTexture 3553 5"
+static std::vector<std::string> calls;
+
+static void record(const char *name, std::initializer_list<GLuint> arguments)
+{
+    std::ostringstream call;
+    call << name;
+    for (GLuint argument: arguments)
+        call << " " << argument;
+    calls.push_back(call.str());
+}
+
+static const GlDispatch MOCK_DISPATCH =
+{
+    [](GLuint program) { record("useProgram", { program }); },
+    [](GLuint array) { record("bindVertexArray", { array }); },
+    [](GLenum target, GLuint buffer) { record("bindBuffer", { target, buffer }); },
+    [](GLenum target, GLuint index, GLuint buffer) { record("bindBufferBase", { target, index, buffer }); },
+    [](GLenum texture) { record("activeTexture", { texture }); },
+    [](GLenum target, GLuint texture) { record("bindTexture", { target, texture }); },
+    [](GLenum capability) { record("enable", { capability }); },
+    [](GLenum capability) { record("disable", { capability }); },
+    [](GLenum func) { record("depthFunc", { func }); },
+    [](GLboolean flag) { record("depthMask", { flag }); },
+    [](GLenum sourceFactor, GLenum destinationFactor) { record("blendFunc", { sourceFactor, destinationFactor }); },
+    [](GLint x, GLint y, GLsizei width, GLsizei height) { record("viewport", { GLuint(x), GLuint(y), GLuint(width), GLuint(height) }); },
+    [](GLuint program) { record("deleteProgram", { program }); },
+    [](GLsizei n, const GLuint *arrays) { record("deleteVertexArrays", { GLuint(n), arrays[0] }); },
+    [](GLsizei n, const GLuint *buffers) { record("deleteBuffers", { GLuint(n), buffers[0] }); },
+    [](GLsizei n, const GLuint *textures) { record("deleteTextures", { GLuint(n), textures[0] }); }
+};
+
+class GlStateTest : public ::testing::Test
+{
+
+protected:
+
+    GlStateTest() : state(MOCK_DISPATCH) {}
+
+    void SetUp() override
+    {
+        calls.clear();
+    }
+
+    // Whether the last call reached the driver as expected; either way, the log starts over
+    bool issued(const std::string &expected)
+    {
+        bool found = calls.size() == 1 && calls[0] == expected;
+        calls.clear();
+        return found;
+    }
+
+    bool skipped()
+    {
+        bool none = calls.empty();
+        calls.clear();
+        return none;
+    }
+
+    GlState state;
+
+};
+
+TEST_F(GlStateTest, SkipsRedundantCalls)
+{
+    state.useProgram(3);
+    EXPECT_TRUE(issued("useProgram 3"));
+    state.useProgram(3);
+    EXPECT_TRUE(skipped());
+    state.useProgram(4);
+    EXPECT_TRUE(issued("useProgram 4"));
+
+    state.enable(GL_DEPTH_TEST);
+    EXPECT_TRUE(issued("enable 2929"));
+    state.enable(GL_DEPTH_TEST);
+    EXPECT_TRUE(skipped());
+    state.disable(GL_DEPTH_TEST);
+    EXPECT_TRUE(issued("disable 2929"));
+
+    state.viewport(0, 0, 800, 600);
+    EXPECT_TRUE(issued("viewport 0 0 800 600"));
+    state.viewport(0, 0, 800, 600);
+    EXPECT_TRUE(skipped());
+    state.viewport(0, 0, 320, 240);
+    EXPECT_TRUE(issued("viewport 0 0 320 240"));
+}
+
+// Binding a texture only affects the active unit, so the same texture on another unit is a new bind
+TEST_F(GlStateTest, ShadowsTexturesPerUnit)
+{
+    state.activeTexture(GL_TEXTURE0);
+    EXPECT_TRUE(issued("activeTexture 33984"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(issued("bindTexture 3553 5"));
+
+    state.activeTexture(GL_TEXTURE1);
+    EXPECT_TRUE(issued("activeTexture 33985"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(issued("bindTexture 3553 5"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(skipped());
+
+    state.activeTexture(GL_TEXTURE0);
+    EXPECT_TRUE(issued("activeTexture 33984"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(skipped());
+    state.activeTexture(GL_TEXTURE0);
+    EXPECT_TRUE(skipped());
+
+    // Other targets aren't shadowed
+    state.bindTexture(GL_TEXTURE_CUBE_MAP, 6);
+    EXPECT_TRUE(issued("bindTexture 34067 6"));
+    state.bindTexture(GL_TEXTURE_CUBE_MAP, 6);
+    EXPECT_TRUE(issued("bindTexture 34067 6"));
+}
+
+// Until a unit has been made active through us, we can't know which unit a bind lands on
+TEST_F(GlStateTest, BindsTexturesOnAnUnknownUnit)
+{
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(issued("bindTexture 3553 5"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(issued("bindTexture 3553 5"));
+}
+
+// The element array buffer belongs to the vertex array object; the array buffer doesn't
+TEST_F(GlStateTest, ForgetsTheElementArrayBufferWithTheVertexArray)
+{
+    state.bindVertexArray(1);
+    EXPECT_TRUE(issued("bindVertexArray 1"));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    EXPECT_TRUE(issued("bindBuffer 34963 7"));
+    state.bindBuffer(GL_ARRAY_BUFFER, 8);
+    EXPECT_TRUE(issued("bindBuffer 34962 8"));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    EXPECT_TRUE(skipped());
+
+    state.bindVertexArray(2);
+    EXPECT_TRUE(issued("bindVertexArray 2"));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    EXPECT_TRUE(issued("bindBuffer 34963 7"));
+    state.bindBuffer(GL_ARRAY_BUFFER, 8);
+    EXPECT_TRUE(skipped());
+
+    // Binding the same vertex array again leaves its element array buffer known
+    state.bindVertexArray(2);
+    EXPECT_TRUE(skipped());
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    EXPECT_TRUE(skipped());
+}
+
+// Indexed binds also bind the generic binding point, and only uniform buffer indices are shadowed
+TEST_F(GlStateTest, ShadowsUniformBufferBindings)
+{
+    state.bindBufferBase(GL_UNIFORM_BUFFER, 0, 9);
+    EXPECT_TRUE(issued("bindBufferBase 35345 0 9"));
+    state.bindBufferBase(GL_UNIFORM_BUFFER, 0, 9);
+    EXPECT_TRUE(skipped());
+    state.bindBuffer(GL_UNIFORM_BUFFER, 9);
+    EXPECT_TRUE(skipped());
+    state.bindBufferBase(GL_UNIFORM_BUFFER, 1, 9);
+    EXPECT_TRUE(issued("bindBufferBase 35345 1 9"));
+}
+
+/*
+ * OpenGL unbinds a deleted object and hands its name out again, so binding the new object of the
+ * same name has to reach the driver.
+ */
+TEST_F(GlStateTest, BindsReusedNamesAfterDeletion)
+{
+    state.activeTexture(GL_TEXTURE3);
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    state.bindVertexArray(1);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    state.bindBuffer(GL_ARRAY_BUFFER, 8);
+    state.bindBufferBase(GL_UNIFORM_BUFFER, 2, 8);
+    state.useProgram(4);
+    calls.clear();
+
+    state.deleteTexture(5);
+    EXPECT_TRUE(issued("deleteTextures 1 5"));
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    EXPECT_TRUE(issued("bindTexture 3553 5"));
+
+    state.deleteBuffer(8);
+    EXPECT_TRUE(issued("deleteBuffers 1 8"));
+    state.bindBuffer(GL_ARRAY_BUFFER, 8);
+    EXPECT_TRUE(issued("bindBuffer 34962 8"));
+    state.bindBufferBase(GL_UNIFORM_BUFFER, 2, 8);
+    EXPECT_TRUE(issued("bindBufferBase 35345 2 8"));
+
+    state.deleteVertexArray(1);
+    EXPECT_TRUE(issued("deleteVertexArrays 1 1"));
+    state.bindVertexArray(1);
+    EXPECT_TRUE(issued("bindVertexArray 1"));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 7);
+    EXPECT_TRUE(issued("bindBuffer 34963 7"));
+
+    // A deleted program stays in use until it's replaced, so it doesn't change what's bound
+    state.deleteProgram(4);
+    EXPECT_TRUE(issued("deleteProgram 4"));
+    state.useProgram(4);
+    EXPECT_TRUE(skipped());
+
+    // Deleting name 0 is a no-op and never reaches the driver
+    state.deleteTexture(0);
+    state.deleteBuffer(0);
+    state.deleteVertexArray(0);
+    state.deleteProgram(0);
+    EXPECT_TRUE(skipped());
+}
+
+// Deleting an object that isn't bound leaves the bindings alone
+TEST_F(GlStateTest, KeepsBindingsWhenDeletingOtherObjects)
+{
+    state.activeTexture(GL_TEXTURE0);
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    state.bindVertexArray(1);
+    calls.clear();
+
+    state.deleteTexture(6);
+    state.deleteVertexArray(2);
+    calls.clear();
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    state.bindVertexArray(1);
+    EXPECT_TRUE(skipped());
+}
+
+TEST_F(GlStateTest, InvalidateForgetsEverything)
+{
+    state.useProgram(3);
+    state.activeTexture(GL_TEXTURE0);
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    state.depthFunc(GL_LESS);
+    calls.clear();
+
+    state.invalidate();
+    state.useProgram(3);
+    state.activeTexture(GL_TEXTURE0);
+    state.bindTexture(GL_TEXTURE_2D, 5);
+    state.depthFunc(GL_LESS);
+    EXPECT_EQ(std::vector<std::string>({ "useProgram 3", "activeTexture 33984", "bindTexture 3553 5", "depthFunc 513" }), calls);
+}
+
+TEST_F(GlStateTest, CountsIssuedAndSkippedCalls)
+{
+    state.activeTexture(GL_TEXTURE0);
+    for (int i = 0; i < 3; ++i)
+    {
+        state.useProgram(3);
+        state.bindTexture(GL_TEXTURE_2D, 5);
+        state.bindTexture(GL_TEXTURE_2D, 6);
+    }
+    state.depthMask(GL_FALSE);
+    state.depthMask(GL_FALSE);
+    state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    const GlStateCounters &counters = state.getCounters();
+    EXPECT_EQ(1u, counters.issued[GL_STATE_PROGRAM]);
+    EXPECT_EQ(2u, counters.skipped[GL_STATE_PROGRAM]);
+    EXPECT_EQ(6u, counters.issued[GL_STATE_TEXTURE]);
+    EXPECT_EQ(0u, counters.skipped[GL_STATE_TEXTURE]);
+    EXPECT_EQ(1u, counters.issued[GL_STATE_ACTIVE_TEXTURE]);
+    EXPECT_EQ(1u, counters.issued[GL_STATE_DEPTH]);
+    EXPECT_EQ(1u, counters.skipped[GL_STATE_DEPTH]);
+    EXPECT_EQ(1u, counters.issued[GL_STATE_BLEND]);
+    EXPECT_EQ(0u, counters.issued[GL_STATE_VIEWPORT] + counters.skipped[GL_STATE_VIEWPORT]);
+
+    // The counters only ever count calls that went through us, and every one of them exactly once
+    size_t total = 0;
+    for (int i = 0; i < GL_STATE_CATEGORY_COUNT; ++i)
+        total += counters.issued[i];
+    EXPECT_EQ(calls.size(), total);
+
+    state.resetCounters();
+    for (int i = 0; i < GL_STATE_CATEGORY_COUNT; ++i)
+    {
+        EXPECT_EQ(0u, state.getCounters().issued[i]);
+        EXPECT_EQ(0u, state.getCounters().skipped[i]);
+    }
+}
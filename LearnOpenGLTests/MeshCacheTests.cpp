@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "MeshCache.h"
+
+static const uint64_t SOURCE_HASH = 0x0123456789ABCDEFULL;
+static const uint32_t IMPORT_FLAGS = 0x8;
+
+// A textured quad with one simplified LOD (a single triangle), the way Model hands its meshes to the cache
+static std::vector<Mesh> makeMeshes()
+{
+    std::vector<Vertex> vertices(4);
+    for (int i = 0; i < 4; ++i)
+    {
+        vertices[i].position = glm::vec3(float(i & 1), float(i >> 1), 0.0f);
+        vertices[i].normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        vertices[i].texCoord = glm::vec2(float(i & 1), float(i >> 1));
+    }
+    std::vector<GLuint> indices = { 0, 1, 2, 2, 1, 3 };
+    Texture texture;
+    texture.type = "texture_diffuse";
+    texture.path = aiString("diffuse.png");
+    std::vector<Mesh> meshes(1, Mesh(vertices, indices, std::vector<Texture>(1, texture), 96.0f, false));
+    MeshLOD lod = { 6, 3, 0.25f };
+    meshes[0].setLODs(std::vector<GLuint>({ 0, 1, 3 }), std::vector<MeshLOD>(1, lod));
+    return meshes;
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
+    stream.write(contents.data(), contents.size());
+}
+
+class MeshCacheTest : public ::testing::Test
+{
+
+protected:
+
+    void SetUp() override
+    {
+        path = ::testing::TempDir() + "MeshCacheTest.meshcache";
+        ASSERT_TRUE(MeshCache::write(path, SOURCE_HASH, IMPORT_FLAGS, makeMeshes()));
+        contents = readFile(path);
+    }
+
+    // Where the first texture reference is in the file: right after the header and the one mesh entry
+    MeshCacheTextureRef *getTextureRef()
+    {
+        return reinterpret_cast<MeshCacheTextureRef*>(&contents[sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry)]);
+    }
+
+    MeshCacheEntry *getEntry()
+    {
+        return reinterpret_cast<MeshCacheEntry*>(&contents[sizeof(MeshCacheHeader)]);
+    }
+
+    bool openModified()
+    {
+        writeFile(path, contents);
+        MeshCache cache;
+        return cache.open(path, SOURCE_HASH, IMPORT_FLAGS);
+    }
+
+    std::string path;
+    std::string contents;
+
+};
+
+TEST_F(MeshCacheTest, RoundTripsMeshes)
+{
+    MeshCache cache;
+    ASSERT_TRUE(cache.open(path, SOURCE_HASH, IMPORT_FLAGS));
+    ASSERT_EQ(1u, cache.getMeshCount());
+    EXPECT_EQ(4u, cache.getEntry(0).vertexCount);
+    EXPECT_EQ(6u, cache.getEntry(0).indexCount);
+    EXPECT_EQ(1.0f, cache.getVertices(0)[3].position.x);
+    EXPECT_EQ(3u, cache.getIndices(0)[5]);
+    EXPECT_EQ("texture_diffuse", cache.getTextureType(0));
+    EXPECT_EQ("diffuse.png", cache.getTexturePath(0));
+    EXPECT_EQ(96.0f, cache.getEntry(0).shininess);
+}
+
+TEST_F(MeshCacheTest, RoundTripsLODs)
+{
+    MeshCache cache;
+    ASSERT_TRUE(cache.open(path, SOURCE_HASH, IMPORT_FLAGS));
+    ASSERT_EQ(1u, cache.getEntry(0).lodCount);
+    ASSERT_EQ(3u, cache.getEntry(0).lodIndexCount);
+    EXPECT_EQ(6u, cache.getLODs(0)[0].firstIndex);
+    EXPECT_EQ(3, cache.getLODs(0)[0].indexCount);
+    EXPECT_EQ(0.25f, cache.getLODs(0)[0].error);
+    EXPECT_EQ(3u, cache.getLODIndices(0)[2]);
+    EXPECT_EQ(0u, cache.getEntry(0).lodOffset % 16);
+}
+
+TEST_F(MeshCacheTest, MissesOnDifferentSource)
+{
+    MeshCache cache;
+    EXPECT_FALSE(cache.open(path, SOURCE_HASH + 1, IMPORT_FLAGS));
+    EXPECT_FALSE(cache.open(path, SOURCE_HASH, IMPORT_FLAGS | 0x2));
+    EXPECT_FALSE(cache.isOpen());
+}
+
+TEST_F(MeshCacheTest, MissesOnTruncatedFile)
+{
+    contents.resize(contents.size() - 1);
+    EXPECT_FALSE(openModified());
+    contents.resize(sizeof(MeshCacheHeader) - 1);
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnStringOutsideFile)
+{
+    getTextureRef()->pathOffset = static_cast<uint32_t>(contents.size() - 2);
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnStringLengthOutsideFile)
+{
+    getTextureRef()->typeLength = 0xFFFFFFFF;
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnBlobOffsetThatWouldOverflow)
+{
+    getEntry()->vertexOffset = 0xFFFFFFFFFFFFFFF0ULL;
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnTextureRangeOutsideTable)
+{
+    getEntry()->firstTexture = 0xFFFFFFFF;
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnLODOutsideIndices)
+{
+    MeshLOD *lod = reinterpret_cast<MeshLOD*>(&contents[getEntry()->lodOffset]);
+    lod->firstIndex = 7;
+    EXPECT_FALSE(openModified());
+}
+
+TEST_F(MeshCacheTest, MissesOnLODBlobOutsideFile)
+{
+    getEntry()->lodIndexCount = 0x10000000;
+    EXPECT_FALSE(openModified());
+}
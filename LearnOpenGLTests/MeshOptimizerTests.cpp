@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <tuple>
+#include <vector>
+#include "MeshOptimizer.h"
+
+static const int GRID_SIZE = 64;                                    // Quads along each side of the reference mesh
+
+typedef std::array<float, 9> TrianglePositions;
+
+/*
+ * A triangle by the positions of its corners, rotated so the smallest corner comes first. That keeps
+ * the winding, so a flipped triangle still compares as different.
+ */
+static TrianglePositions getTrianglePositions(const std::vector<Vertex> &vertices, const GLuint *corners)
+{
+    int first = 0;
+    for (int corner = 1; corner < 3; ++corner)
+    {
+        const glm::vec3 &a = vertices[corners[corner]].position;
+        const glm::vec3 &b = vertices[corners[first]].position;
+        if (std::make_tuple(a.x, a.y, a.z) < std::make_tuple(b.x, b.y, b.z)) first = corner;
+    }
+
+    TrianglePositions triangle;
+    for (int corner = 0; corner < 3; ++corner)
+    {
+        const glm::vec3 &position = vertices[corners[(first + corner) % 3]].position;
+        triangle[corner * 3] = position.x;
+        triangle[corner * 3 + 1] = position.y;
+        triangle[corner * 3 + 2] = position.z;
+    }
+    return triangle;
+}
+
+static std::vector<TrianglePositions> getTriangles(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices)
+{
+    std::vector<TrianglePositions> triangles;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        triangles.push_back(getTrianglePositions(vertices, &indices[i]));
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+class MeshOptimizerTest : public ::testing::Test
+{
+
+protected:
+
+    /*
+     * The reference mesh: a GRID_SIZE x GRID_SIZE grid of quads, unindexed the way an exporter without
+     * welding writes it (three vertices per triangle), with the triangles in random order so the vertex
+     * cache does as badly as it can.
+     */
+    void SetUp() override
+    {
+        std::vector<std::array<GLuint, 3>> triangles;
+        for (int y = 0; y < GRID_SIZE; ++y)
+        {
+            for (int x = 0; x < GRID_SIZE; ++x)
+            {
+                GLuint corner = y * (GRID_SIZE + 1) + x;
+                triangles.push_back({{ corner, corner + 1, corner + GRID_SIZE + 1 }});
+                triangles.push_back({{ corner + 1, corner + GRID_SIZE + 2, corner + GRID_SIZE + 1 }});
+            }
+        }
+        std::mt19937 random(13);
+        std::shuffle(triangles.begin(), triangles.end(), random);
+
+        for (const auto &triangle: triangles)
+        {
+            for (GLuint corner: triangle)
+            {
+                Vertex vertex;
+                vertex.position = glm::vec3(float(corner % (GRID_SIZE + 1)), 0.0f, float(corner / (GRID_SIZE + 1)));
+                vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                vertex.texCoord = glm::vec2(vertex.position.x / GRID_SIZE, vertex.position.z / GRID_SIZE);
+                indices.push_back(static_cast<GLuint>(vertices.size()));
+                vertices.push_back(vertex);
+            }
+        }
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+};
+
+TEST_F(MeshOptimizerTest, WeldingMergesIdenticalVertices)
+{
+    std::vector<TrianglePositions> expected = getTriangles(vertices, indices);
+    weldVertices(vertices, indices);
+    EXPECT_EQ(size_t((GRID_SIZE + 1) * (GRID_SIZE + 1)), vertices.size());
+    EXPECT_EQ(expected, getTriangles(vertices, indices));
+}
+
+// Vertices that only differ in an attribute other than the position have to stay apart
+TEST_F(MeshOptimizerTest, WeldingKeepsVerticesThatDiffer)
+{
+    std::vector<Vertex> seam(4, vertices[0]);
+    seam[1].normal = glm::vec3(0.0f, -1.0f, 0.0f);
+    seam[2].texCoord = glm::vec2(0.5f, 0.5f);
+    std::vector<GLuint> seamIndices = { 0, 1, 2, 3, 2, 1 };
+    weldVertices(seam, seamIndices);
+    EXPECT_EQ(3u, seam.size());
+    EXPECT_EQ(std::vector<GLuint>({ 0, 1, 2, 0, 2, 1 }), seamIndices);
+}
+
+TEST_F(MeshOptimizerTest, VertexCacheOrderKeepsTheTriangles)
+{
+    weldVertices(vertices, indices);
+    std::vector<TrianglePositions> expected = getTriangles(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    EXPECT_EQ(expected, getTriangles(vertices, indices));
+}
+
+TEST_F(MeshOptimizerTest, VertexFetchOrderKeepsTheTrianglesAndDropsUnusedVertices)
+{
+    // Dropping the last two triangles can leave vertices nothing refers to
+    weldVertices(vertices, indices);
+    indices.resize(indices.size() - 6);
+    std::vector<TrianglePositions> expected = getTriangles(vertices, indices);
+    optimizeVertexFetch(vertices, indices);
+    EXPECT_EQ(expected, getTriangles(vertices, indices));
+
+    // Every vertex is referenced, and first referenced in order
+    GLuint next = 0;
+    for (GLuint index: indices)
+    {
+        ASSERT_LE(index, next);
+        if (index == next) ++next;
+    }
+    EXPECT_EQ(vertices.size(), next);
+}
+
+TEST_F(MeshOptimizerTest, OptimizingImprovesACMR)
+{
+    std::vector<TrianglePositions> expected = getTriangles(vertices, indices);
+    VertexCacheStats before, after;
+    optimizeMesh(vertices, indices, &before, &after);
+
+    EXPECT_EQ(expected, getTriangles(vertices, indices));
+    EXPECT_EQ(size_t((GRID_SIZE + 1) * (GRID_SIZE + 1)), vertices.size());
+    EXPECT_EQ(size_t(GRID_SIZE * GRID_SIZE * 2), after.triangles);
+    EXPECT_FLOAT_EQ(3.0f, before.getACMR());                        // Unwelded, every corner is a miss
+
+    // A regular grid this size gets close to 0.5 with a good ordering; shuffled and welded it's well over 1
+    weldVertices(vertices, indices);
+    std::vector<GLuint> shuffled = indices;
+    std::vector<size_t> order(shuffled.size() / 3);
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::mt19937 random(17);
+    std::shuffle(order.begin(), order.end(), random);
+    for (size_t i = 0; i < order.size(); ++i)
+        std::copy(&indices[order[i] * 3], &indices[order[i] * 3] + 3, &shuffled[i * 3]);
+    float shuffledACMR = simulateVertexCache(shuffled, vertices.size()).getACMR();
+
+    EXPECT_LT(after.getACMR(), shuffledACMR);
+    EXPECT_LT(after.getACMR(), 0.8f);
+    EXPECT_NEAR(1.0f, after.getATVR(), 0.6f);
+}
+
+// Running the passes on an already optimized mesh must not make it worse
+TEST_F(MeshOptimizerTest, OptimizingTwiceDoesNotRegress)
+{
+    VertexCacheStats first, second;
+    optimizeMesh(vertices, indices, nullptr, &first);
+    optimizeMesh(vertices, indices, nullptr, &second);
+    EXPECT_LE(second.getACMR(), first.getACMR());
+    EXPECT_EQ(first.vertices, second.vertices);
+}
+
+TEST(VertexCacheStatsTest, SimulatesAFifoCache)
+{
+    // One triangle, then the same three vertices again: all hits
+    VertexCacheStats stats = simulateVertexCache(std::vector<GLuint>({ 0, 1, 2, 2, 1, 0 }), 3);
+    EXPECT_EQ(2u, stats.triangles);
+    EXPECT_EQ(3u, stats.vertices);
+    EXPECT_EQ(3u, stats.misses);
+    EXPECT_FLOAT_EQ(1.5f, stats.getACMR());
+    EXPECT_FLOAT_EQ(1.0f, stats.getATVR());
+
+    // With room for only three vertices, the fourth pushes out the first even though it was just hit
+    stats = simulateVertexCache(std::vector<GLuint>({ 0, 1, 2, 0, 1, 3, 0, 4, 5 }), 6, 3);
+    EXPECT_EQ(7u, stats.misses);
+
+    EXPECT_EQ(0.0f, simulateVertexCache(std::vector<GLuint>(), 0).getACMR());
+}
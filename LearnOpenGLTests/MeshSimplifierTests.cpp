@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "MeshSimplifier.h"
+
+static const int SPHERE_RINGS = 32;
+static const int SPHERE_SEGMENTS = 64;
+static const float TARGET_FRACTIONS[] = { 0.5f, 0.25f, 0.1f };
+
+// Distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection, 5.1.5)
+static float pointTriangleDistance(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return glm::length(p - a);
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return glm::length(p - b);
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return glm::length(p - c);
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+
+    float denominator = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+class MeshSimplifierTest : public ::testing::Test
+{
+
+protected:
+
+    /*
+     * A unit UV sphere, closed and without seams: the poles are single vertices, the last segment
+     * wraps around to the first, and every vertex has its own position, so nothing is locked and
+     * the simplifier can reach any target.
+     */
+    void SetUp() override
+    {
+        addVertex(glm::vec3(0.0f, 1.0f, 0.0f));
+        for (int ring = 1; ring < SPHERE_RINGS; ++ring)
+        {
+            for (int segment = 0; segment < SPHERE_SEGMENTS; ++segment)
+            {
+                float theta = float(M_PI) * ring / SPHERE_RINGS;
+                float phi = 2.0f * float(M_PI) * segment / SPHERE_SEGMENTS;
+                addVertex(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+            }
+        }
+        addVertex(glm::vec3(0.0f, -1.0f, 0.0f));
+        GLuint south = static_cast<GLuint>(vertices.size() - 1);
+
+        for (int segment = 0; segment < SPHERE_SEGMENTS; ++segment)
+        {
+            addTriangle(0, getVertex(1, segment + 1), getVertex(1, segment));
+            addTriangle(south, getVertex(SPHERE_RINGS - 1, segment), getVertex(SPHERE_RINGS - 1, segment + 1));
+            for (int ring = 1; ring < SPHERE_RINGS - 1; ++ring)
+            {
+                addTriangle(getVertex(ring, segment), getVertex(ring, segment + 1), getVertex(ring + 1, segment));
+                addTriangle(getVertex(ring, segment + 1), getVertex(ring + 1, segment + 1), getVertex(ring + 1, segment));
+            }
+        }
+    }
+
+    void addVertex(const glm::vec3 &position)
+    {
+        Vertex vertex;
+        vertex.position = position;
+        vertex.normal = position;
+        vertex.texCoord = glm::vec2(0.0f, 0.0f);
+        vertices.push_back(vertex);
+    }
+
+    GLuint getVertex(int ring, int segment) const
+    {
+        return static_cast<GLuint>(1 + (ring - 1) * SPHERE_SEGMENTS + segment % SPHERE_SEGMENTS);
+    }
+
+    void addTriangle(GLuint a, GLuint b, GLuint c)
+    {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    size_t getTargetIndexCount(float fraction) const
+    {
+        return static_cast<size_t>(indices.size() / 3 * fraction) * 3;
+    }
+
+    // How far the furthest source vertex is from the simplified surface
+    float getSourceDeviation(const std::vector<GLuint> &simplified) const
+    {
+        float deviation = 0.0f;
+        for (const auto &vertex: vertices)
+        {
+            float closest = INFINITY;
+            for (size_t i = 0; i + 2 < simplified.size(); i += 3)
+                closest = std::min(closest, pointTriangleDistance(vertex.position, vertices[simplified[i]].position,
+                                                                  vertices[simplified[i + 1]].position, vertices[simplified[i + 2]].position));
+            deviation = std::max(deviation, closest);
+        }
+        return deviation;
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+};
+
+TEST_F(MeshSimplifierTest, StaysWithinTheTriangleBudget)
+{
+    for (float fraction: TARGET_FRACTIONS)
+    {
+        size_t target = getTargetIndexCount(fraction);
+        std::vector<GLuint> simplified = simplifyMesh(vertices, indices, target);
+        EXPECT_LE(simplified.size(), target) << fraction;
+        EXPECT_GT(simplified.size(), target * 9 / 10) << fraction;
+        EXPECT_EQ(0u, simplified.size() % 3) << fraction;
+    }
+}
+
+/*
+ * The error only promises a bound on each moved vertex's distance to the planes merged into it (see
+ * simplifyMesh()), not on the distance between the surfaces. On a smooth, closed surface like this
+ * one those planes hug the surface, so it should cover every source vertex's distance to the result.
+ */
+TEST_F(MeshSimplifierTest, SourceDeviationStaysWithinTheReportedError)
+{
+    for (float fraction: TARGET_FRACTIONS)
+    {
+        float error = -1.0f;
+        std::vector<GLuint> simplified = simplifyMesh(vertices, indices, getTargetIndexCount(fraction), &error);
+        EXPECT_GT(error, 0.0f) << fraction;
+        EXPECT_LE(getSourceDeviation(simplified), error) << fraction;
+    }
+}
+
+// Every triangle of the result still faces away from the centre, as every one of the source's does
+TEST_F(MeshSimplifierTest, DoesNotFlipTriangles)
+{
+    for (float fraction: TARGET_FRACTIONS)
+    {
+        std::vector<GLuint> simplified = simplifyMesh(vertices, indices, getTargetIndexCount(fraction));
+        for (size_t i = 0; i + 2 < simplified.size(); i += 3)
+        {
+            const glm::vec3 &a = vertices[simplified[i]].position;
+            const glm::vec3 &b = vertices[simplified[i + 1]].position;
+            const glm::vec3 &c = vertices[simplified[i + 2]].position;
+            ASSERT_GT(glm::dot(glm::cross(b - a, c - a), a + b + c), 0.0f) << fraction << ", triangle " << i / 3;
+        }
+    }
+}
+
+TEST_F(MeshSimplifierTest, LODErrorsAccumulateAndBudgetsHalve)
+{
+    std::vector<GLuint> lodIndices;
+    std::vector<MeshLOD> lods;
+    size_t sourceTriangles = generateMeshLODs(vertices, indices, lodIndices, lods);
+    ASSERT_GE(lods.size(), 2u);
+    EXPECT_GE(sourceTriangles, indices.size() / 3);
+
+    // Each level follows the one before it in lodIndices, and is at most half its size
+    GLuint nextIndex = static_cast<GLuint>(indices.size());
+    size_t previousIndexCount = indices.size();
+    float previousError = 0.0f;
+    for (const auto &lod: lods)
+    {
+        EXPECT_EQ(nextIndex, lod.firstIndex);
+        EXPECT_LE(size_t(lod.indexCount), previousIndexCount / 6 * 3);
+        EXPECT_GE(lod.error, previousError);
+        nextIndex += lod.indexCount;
+        previousIndexCount = lod.indexCount;
+        previousError = lod.error;
+    }
+    EXPECT_EQ(indices.size() + lodIndices.size(), size_t(nextIndex));
+
+    // A level's error covers its deviation from the full mesh, not just from the level it was simplified from
+    const MeshLOD &coarsest = lods.back();
+    std::vector<GLuint> coarsestIndices(lodIndices.begin() + (coarsest.firstIndex - indices.size()),
+                                        lodIndices.begin() + (coarsest.firstIndex - indices.size()) + coarsest.indexCount);
+    EXPECT_LE(getSourceDeviation(coarsestIndices), coarsest.error);
+}
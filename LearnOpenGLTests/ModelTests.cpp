@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include "HeadlessContext.h"
+#include "MeshCache.h"
+#include "Model.h"
+
+static const int STEADY_STATE_DRAWS = 100;
+
+/*
+ * Every allocation in the test binary goes through these. Only the ones made on the thread that asked
+ * for counting are counted, so the driver's worker threads don't show up.
+ */
+static std::atomic<size_t> allocationCount(0);
+static thread_local bool countAllocations = false;
+
+void *operator new(std::size_t size)
+{
+    if (countAllocations) ++allocationCount;
+    void *memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+static const char *VERTEX_SHADER =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec3 normal;\n"
+    "layout (location = 2) in vec2 texCoord;\n"
+    "out vec2 TexCoord;\n"
+    "void main() { gl_Position = vec4(position, 1.0); TexCoord = texCoord; }\n";
+static const char *FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "struct Material { sampler2D texture_diffuse0; float shininess; };\n"
+    "uniform Material material;\n"
+    "in vec2 TexCoord;\n"
+    "out vec4 color;\n"
+    "void main() { color = texture(material.texture_diffuse0, TexCoord) * material.shininess; }\n";
+
+// Two quads with a material each, sharing a diffuse map: one with its own shininess, one without
+static const char *MODEL_OBJ =
+    "mtllib test.mtl\n"
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "v 2 0 0\nv 3 0 0\nv 3 1 0\nv 2 1 0\n"
+    "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+    "vn 0 0 1\n"
+    "usemtl shiny\n"
+    "f 1/1/1 2/2/1 3/3/1\nf 1/1/1 3/3/1 4/4/1\n"
+    "usemtl plain\n"
+    "f 5/1/1 6/2/1 7/3/1\nf 5/1/1 7/3/1 8/4/1\n";
+static const char *MODEL_MTL =
+    "newmtl shiny\n"
+    "Ns 64\n"
+    "map_Kd ModelTest.tga\n"
+    "newmtl plain\n"
+    "map_Kd ModelTest.tga\n";
+
+// A 2x2 white image: an uncompressed true color TGA header, then the texels as BGR
+static const unsigned char TEXTURE_TGA[] = {
+    0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 2, 0, 24, 0,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+};
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
+    stream << contents;
+}
+
+class ModelTest : public ::testing::Test
+{
+
+protected:
+
+    void SetUp() override
+    {
+        objPath = ::testing::TempDir() + "ModelTest.obj";
+        mtlPath = ::testing::TempDir() + "test.mtl";
+        texturePath = ::testing::TempDir() + "ModelTest.tga";
+        writeFile(objPath, MODEL_OBJ);
+        writeFile(mtlPath, MODEL_MTL);
+        writeFile(texturePath, std::string(reinterpret_cast<const char*>(TEXTURE_TGA), sizeof(TEXTURE_TGA)));
+        std::remove(MeshCache::getCachePath(objPath).c_str());
+    }
+
+    void TearDown() override
+    {
+        std::remove(objPath.c_str());
+        std::remove(mtlPath.c_str());
+        std::remove(texturePath.c_str());
+        std::remove(MeshCache::getCachePath(objPath).c_str());
+    }
+
+    std::string objPath;
+    std::string mtlPath;
+    std::string texturePath;
+
+};
+
+// Once each mesh has resolved its material for the program, drawing is binds and draw calls only
+TEST_F(ModelTest, DrawDoesNotAllocateInSteadyState)
+{
+    HeadlessContext context(16, 16);
+    if (!context.isValid()) GTEST_SKIP() << "No OpenGL context available";
+
+    Model model(objPath.c_str());
+    GlslProgram program;
+    program.setupProgramFromSource(VERTEX_SHADER, FRAGMENT_SHADER);
+    ASSERT_TRUE(program.isLoaded());
+    program.begin();
+    model.draw(program);
+    model.draw(program);
+
+    allocationCount = 0;
+    countAllocations = true;
+    for (int i = 0; i < STEADY_STATE_DRAWS; ++i)
+        model.draw(program);
+    countAllocations = false;
+    context.finishFrame();
+
+    EXPECT_EQ(0u, allocationCount.load());
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+}
+
+// The import reads the shininess off the material, and the mesh cache keeps it for the next load
+TEST_F(ModelTest, CachesTheMaterialsShininess)
+{
+    HeadlessContext context(16, 16);
+    if (!context.isValid()) GTEST_SKIP() << "No OpenGL context available";
+
+    Model model(objPath.c_str());
+    const GLuint importFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+    MeshCache cache;
+    ASSERT_TRUE(cache.open(MeshCache::getCachePath(objPath), MeshCache::hashSource(objPath, importFlags), importFlags));
+    ASSERT_EQ(2u, cache.getMeshCount());
+    EXPECT_EQ(64.0f, cache.getEntry(0).shininess);
+    EXPECT_EQ(MATERIAL_DEFAULT_SHININESS, cache.getEntry(1).shininess);
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "HeadlessContext.h"
+#include "ShaderWatcher.h"
+
+static const int POLL_INTERVAL_MS = 20;
+static const int TIMEOUT_MS = 3000;                                 // How long a change may take to show up
+
+static const char *VERTEX_SHADER =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 position;\n"
+    "void main() { gl_Position = vec4(position, 1.0); }\n";
+static const char *FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "out vec4 color;\n"
+    "void main() { color = vec4(1.0); }\n";
+static const char *EDITED_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "out vec4 color;\n"
+    "void main() { color = vec4(0.5, 0.25, 1.0, 1.0); }\n";
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
+    stream << contents;
+}
+
+// Waits for the watcher to report any changed files, or gives up after TIMEOUT_MS
+static std::vector<std::string> waitForChanges(ShaderWatcher &watcher)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    std::vector<std::string> files;
+    while (files.empty() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+        files = watcher.takeChangedFiles();
+    }
+    return files;
+}
+
+class ShaderWatcherTest : public ::testing::Test
+{
+
+protected:
+
+    void SetUp() override
+    {
+        directory = ::testing::TempDir() + "ShaderWatcherTest";
+        mkdir(directory.c_str(), 0755);
+        vertPath = directory + "/test.vert";
+        fragPath = directory + "/test.frag";
+        writeFile(vertPath, VERTEX_SHADER);
+        writeFile(fragPath, FRAGMENT_SHADER);
+    }
+
+    void TearDown() override
+    {
+        std::remove(vertPath.c_str());
+        std::remove(fragPath.c_str());
+        std::remove((directory + "/other.txt").c_str());
+        rmdir(directory.c_str());
+    }
+
+    // Saved in place, and saved the way most editors do it: into a new file renamed over the old one
+    void expectChangesReported(ShaderWatcher &watcher)
+    {
+        watcher.addFile(vertPath);
+        watcher.addFile(fragPath);
+        EXPECT_TRUE(watcher.takeChangedFiles().empty());
+
+        writeFile(fragPath, EDITED_FRAGMENT_SHADER);
+        EXPECT_EQ(std::vector<std::string>({ fragPath }), waitForChanges(watcher));
+
+        std::string tempPath = directory + "/test.vert.tmp";
+        writeFile(tempPath, std::string(VERTEX_SHADER) + "// Edited\n");
+        ASSERT_EQ(0, std::rename(tempPath.c_str(), vertPath.c_str()));
+        EXPECT_EQ(std::vector<std::string>({ vertPath }), waitForChanges(watcher));
+    }
+
+    std::string directory;
+    std::string vertPath;
+    std::string fragPath;
+
+};
+
+TEST_F(ShaderWatcherTest, ReportsChangesThroughInotify)
+{
+    ShaderWatcher watcher(POLL_INTERVAL_MS);
+    if (watcher.isPolling()) GTEST_SKIP() << "inotify is unavailable";
+    expectChangesReported(watcher);
+
+    // Other files in the watched directory don't count
+    writeFile(directory + "/other.txt", "Not a shader");
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS * 5));
+    EXPECT_TRUE(watcher.takeChangedFiles().empty());
+}
+
+TEST_F(ShaderWatcherTest, ReportsChangesByPolling)
+{
+    ShaderWatcher watcher(POLL_INTERVAL_MS, true);
+    ASSERT_TRUE(watcher.isPolling());
+    expectChangesReported(watcher);
+}
+
+// What the application actually relies on: update() relinks the program, and keeps it if the edit doesn't compile
+TEST_F(ShaderWatcherTest, UpdateReloadsWatchedPrograms)
+{
+    HeadlessContext context(16, 16);
+    if (!context.isValid()) GTEST_SKIP() << "No OpenGL context available";
+
+    GlslProgram program;
+    program.setupProgramFromFile(vertPath, fragPath);
+    ASSERT_TRUE(program.isLoaded());
+    unsigned int linkCount = program.getLinkCount();
+
+    ShaderWatcher watcher(POLL_INTERVAL_MS);
+    watcher.watch(program);
+    writeFile(fragPath, EDITED_FRAGMENT_SHADER);
+    size_t reloaded = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    while (reloaded == 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+        reloaded = watcher.update();
+    }
+    EXPECT_EQ(1u, reloaded);
+    EXPECT_EQ(linkCount + 1, program.getLinkCount());
+
+    writeFile(fragPath, "#version 330 core\nvoid main() { this does not compile }\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS * 10));
+    EXPECT_EQ(0u, watcher.update());
+    EXPECT_EQ(linkCount + 1, program.getLinkCount());
+    EXPECT_TRUE(program.isLoaded());
+}
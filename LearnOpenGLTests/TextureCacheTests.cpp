@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include "TextureCache.h"
+
+/*
+ * Stands in for GLTextureBackend: records what the cache asks for and hands back empty images, so
+ * the cache can be tested without a GL context. Paths containing "missing" fail to load.
+ */
+class FakeTextureBackend : public TextureBackend
+{
+
+public:
+
+    FakeTextureBackend() : releases(0) {}
+
+    void load(const std::vector<std::string> &paths, std::vector<Image> &images, std::vector<size_t> &sizes) override
+    {
+        batches.push_back(paths);
+        images.assign(paths.size(), Image());
+        sizes.clear();
+        for (const auto &path: paths)
+            sizes.push_back(path.find("missing") == std::string::npos ? TEXTURE_BYTES : 0);
+    }
+
+    void release(Image &) override
+    {
+        ++releases;
+    }
+
+    static const size_t TEXTURE_BYTES = 1024;
+
+    std::vector<std::vector<std::string>> batches;
+    size_t releases;
+
+};
+
+const size_t FakeTextureBackend::TEXTURE_BYTES;
+
+class TextureCacheTest : public ::testing::Test
+{
+
+protected:
+
+    TextureCacheTest() : cache(backend) {}
+
+    // Declared first, so the cache (and with it any handle's deleter) never outlives it
+    FakeTextureBackend backend;
+    TextureCache cache;
+
+};
+
+TEST_F(TextureCacheTest, MissesOnceThenHits)
+{
+    TextureHandle first = cache.load("textures/wood.png");
+    TextureHandle second = cache.load("textures/wood.png");
+    EXPECT_EQ(first, second);
+    ASSERT_EQ(1u, backend.batches.size());
+    EXPECT_EQ(std::vector<std::string>({ "textures/wood.png" }), backend.batches[0]);
+
+    const TextureCacheStats &stats = cache.getStats();
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(0u, stats.failures);
+    EXPECT_EQ(1u, stats.residentTextures);
+    EXPECT_EQ(FakeTextureBackend::TEXTURE_BYTES, stats.residentBytes);
+}
+
+// Every miss goes to the backend in one batch, and different spellings of one path share an entry
+TEST_F(TextureCacheTest, BatchesMissesAndSharesEquivalentPaths)
+{
+    TextureHandle resident = cache.load("textures/stone.png");
+    std::vector<TextureHandle> handles = cache.load(std::vector<std::string>({ "textures/wood.png", "textures/./wood.png", "textures/metal.png",
+                                                                               "textures/../textures/stone.png", "textures//wood.png" }));
+    ASSERT_EQ(5u, handles.size());
+    ASSERT_EQ(2u, backend.batches.size());
+    EXPECT_EQ(std::vector<std::string>({ "textures/wood.png", "textures/metal.png" }), backend.batches[1]);
+
+    EXPECT_EQ(handles[0], handles[1]);
+    EXPECT_EQ(handles[0], handles[4]);
+    EXPECT_NE(handles[0], handles[2]);
+    EXPECT_EQ(resident, handles[3]);
+    EXPECT_EQ(3u, cache.getStats().misses);
+    EXPECT_EQ(3u, cache.getStats().hits);
+    EXPECT_EQ(3u, cache.getStats().residentTextures);
+}
+
+TEST_F(TextureCacheTest, ReleasesWithTheLastHandle)
+{
+    TextureHandle first = cache.load("textures/wood.png");
+    TextureHandle second = cache.load("textures/wood.png");
+    first.reset();
+    EXPECT_EQ(0u, backend.releases);
+    EXPECT_EQ(1u, cache.getStats().residentTextures);
+
+    second.reset();
+    EXPECT_EQ(1u, backend.releases);
+    EXPECT_EQ(0u, cache.getStats().residentTextures);
+    EXPECT_EQ(0u, cache.getStats().residentBytes);
+
+    // Once released, the next load has to go back to the backend
+    TextureHandle third = cache.load("textures/wood.png");
+    EXPECT_EQ(2u, backend.batches.size());
+    EXPECT_EQ(2u, cache.getStats().misses);
+    EXPECT_EQ(1u, cache.getStats().residentTextures);
+}
+
+TEST_F(TextureCacheTest, CachesFailures)
+{
+    TextureHandle first = cache.load("textures/missing.png");
+    ASSERT_TRUE(first != nullptr);
+    EXPECT_EQ(0u, first->getTextureRef());
+    EXPECT_EQ(1u, cache.getStats().failures);
+
+    TextureHandle second = cache.load("textures/missing.png");
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(1u, backend.batches.size());
+    EXPECT_EQ(1u, cache.getStats().hits);
+    EXPECT_EQ(0u, cache.getStats().residentBytes);
+}
+
+TEST(TextureCachePathTest, NormalizesPaths)
+{
+    EXPECT_EQ("a/b", TextureCache::normalizePath("a//b"));
+    EXPECT_EQ("a/b", TextureCache::normalizePath("./a/./b/"));
+    EXPECT_EQ("a/b", TextureCache::normalizePath("a/c/../b"));
+    EXPECT_EQ("../a", TextureCache::normalizePath("../a"));
+    EXPECT_EQ("/a", TextureCache::normalizePath("/../a"));
+    EXPECT_EQ("a/b", TextureCache::normalizePath("a\\b"));
+    EXPECT_EQ(".", TextureCache::normalizePath("a/.."));
+}
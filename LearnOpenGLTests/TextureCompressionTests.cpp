@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "TextureCompression.h"
+
+static const int IMAGE_SIZE = 64;
+static const size_t IDENTIFIER_SIZE = 12;                           // The KTX header fields start after the identifier
+
+// The KTX header fields the corruption tests change, as indices of uint32_t after the identifier
+static const int KTX_INTERNAL_FORMAT = 4;
+static const int KTX_MIPMAP_LEVELS = 11;
+static const int KTX_FIRST_IMAGE_SIZE = 13;                       // writeKTX writes no key/value data, so level 0 follows the header
+
+// How many of each format's channels carry data, and the PSNR in dB each image must keep through it
+struct FormatCase
+{
+    BlockFormat format;
+    int channels;
+    double gradientPSNR;
+    double noisePSNR;
+};
+
+/*
+ * A couple of dB under what the encoder reaches now: 38.7/39.9/54.2 dB on the gradient, and
+ * 13.8/15.0/29.3 dB on the noise, which no block's endpoints can fit but which should still come
+ * out closer than unrelated noise would (about 8 dB).
+ */
+static const FormatCase FORMAT_CASES[] = {
+    { BLOCK_FORMAT_BC1, 3, 36.0, 12.0 },
+    { BLOCK_FORMAT_BC3, 4, 37.0, 13.0 },
+    { BLOCK_FORMAT_BC5, 2, 51.0, 27.0 }
+};
+
+static std::vector<uint8_t> makeGradient()
+{
+    std::vector<uint8_t> rgba(IMAGE_SIZE * IMAGE_SIZE * 4);
+    for (int y = 0; y < IMAGE_SIZE; ++y)
+    {
+        for (int x = 0; x < IMAGE_SIZE; ++x)
+        {
+            uint8_t *texel = &rgba[(y * IMAGE_SIZE + x) * 4];
+            texel[0] = static_cast<uint8_t>(x * 255 / (IMAGE_SIZE - 1));
+            texel[1] = static_cast<uint8_t>(y * 255 / (IMAGE_SIZE - 1));
+            texel[2] = static_cast<uint8_t>((x + y) * 255 / (2 * IMAGE_SIZE - 2));
+            texel[3] = static_cast<uint8_t>(255 - x * 255 / (IMAGE_SIZE - 1));
+        }
+    }
+    return rgba;
+}
+
+static std::vector<uint8_t> makeNoise()
+{
+    std::mt19937 random(17);
+    std::uniform_int_distribution<int> pickByte(0, 255);
+    std::vector<uint8_t> rgba(IMAGE_SIZE * IMAGE_SIZE * 4);
+    for (auto &value: rgba)
+        value = static_cast<uint8_t>(pickByte(random));
+    return rgba;
+}
+
+static double getRoundTripPSNR(const std::vector<uint8_t> &rgba, const FormatCase &formatCase)
+{
+    std::vector<uint8_t> blocks = compressImage(&rgba[0], IMAGE_SIZE, IMAGE_SIZE, formatCase.format);
+    EXPECT_EQ(getLevelSize(formatCase.format, IMAGE_SIZE, IMAGE_SIZE), blocks.size());
+    std::vector<uint8_t> decoded = decompressImage(&blocks[0], IMAGE_SIZE, IMAGE_SIZE, formatCase.format);
+    return computePSNR(&rgba[0], &decoded[0], IMAGE_SIZE, IMAGE_SIZE, formatCase.channels);
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+static void writeFile(const std::string &path, const std::string &contents)
+{
+    std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
+    stream.write(contents.data(), contents.size());
+}
+
+class TextureCompressionTest : public ::testing::Test
+{
+
+protected:
+
+    void SetUp() override
+    {
+        path = ::testing::TempDir() + "TextureCompressionTest.ktx";
+        std::vector<uint8_t> gradient = makeGradient();
+        texture = compressTexture(&gradient[0], IMAGE_SIZE, IMAGE_SIZE, BLOCK_FORMAT_BC3);
+        ASSERT_TRUE(writeKTX(path, texture));
+        contents = readFile(path);
+    }
+
+    void TearDown() override
+    {
+        std::remove(path.c_str());
+    }
+
+    uint32_t *getHeaderField(int field)
+    {
+        return reinterpret_cast<uint32_t*>(&contents[IDENTIFIER_SIZE + field * sizeof(uint32_t)]);
+    }
+
+    bool readModified()
+    {
+        writeFile(path, contents);
+        CompressedTexture result;
+        return readKTX(path, result);
+    }
+
+    std::string path;
+    std::string contents;
+    CompressedTexture texture;
+
+};
+
+TEST_F(TextureCompressionTest, GradientKeepsItsQuality)
+{
+    std::vector<uint8_t> gradient = makeGradient();
+    for (const auto &formatCase: FORMAT_CASES)
+        EXPECT_GT(getRoundTripPSNR(gradient, formatCase), formatCase.gradientPSNR) << formatCase.format;
+}
+
+TEST_F(TextureCompressionTest, NoiseKeepsItsQuality)
+{
+    std::vector<uint8_t> noise = makeNoise();
+    for (const auto &formatCase: FORMAT_CASES)
+        EXPECT_GT(getRoundTripPSNR(noise, formatCase), formatCase.noisePSNR) << formatCase.format;
+}
+
+TEST_F(TextureCompressionTest, RoundTripsKTX)
+{
+    CompressedTexture result;
+    ASSERT_TRUE(readKTX(path, result));
+    EXPECT_EQ(texture.internalFormat, result.internalFormat);
+    EXPECT_EQ(texture.baseFormat, result.baseFormat);
+    EXPECT_EQ(IMAGE_SIZE, result.width);
+    EXPECT_EQ(IMAGE_SIZE, result.height);
+    ASSERT_EQ(7u, result.levels.size());                            // 64x64 down to 1x1
+    EXPECT_EQ(texture.levels, result.levels);
+}
+
+TEST_F(TextureCompressionTest, RejectsUnknownFormat)
+{
+    *getHeaderField(KTX_INTERNAL_FORMAT) = GL_RGBA8;
+    EXPECT_FALSE(readModified());
+}
+
+TEST_F(TextureCompressionTest, RejectsMoreLevelsThanAFullChain)
+{
+    *getHeaderField(KTX_MIPMAP_LEVELS) = 0xFFFFFFFF;
+    EXPECT_FALSE(readModified());
+}
+
+TEST_F(TextureCompressionTest, RejectsWrongLevelSize)
+{
+    uint32_t *imageSize = getHeaderField(KTX_FIRST_IMAGE_SIZE);
+    ASSERT_EQ(getLevelSize(BLOCK_FORMAT_BC3, IMAGE_SIZE, IMAGE_SIZE), *imageSize);
+    *imageSize = 0x7FFFFFFF;
+    EXPECT_FALSE(readModified());
+}
+
+TEST_F(TextureCompressionTest, RejectsTruncatedFile)
+{
+    contents.resize(contents.size() - 1);
+    EXPECT_FALSE(readModified());
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "TransformStore.h"
+
+static const float TOLERANCE = 1e-4f;
+
+// What main.cpp composed by hand before the store existed: translate * rotate * scale
+struct ReferenceTransform
+{
+    glm::vec3 position;
+    float angle;
+    glm::vec3 axis;
+    glm::vec3 scale;
+
+    glm::mat4 getModelMatrix() const
+    {
+        glm::mat4 model = glm::translate(glm::mat4(), position);
+        model = glm::rotate(model, angle, axis);
+        return glm::scale(model, scale);
+    }
+};
+
+// Relative to the matrix's largest element, so projected matrices with large entries get the same slack
+static void expectMatrixNear(const glm::mat4 &expected, const glm::mat4 &actual, size_t index)
+{
+    float magnitude = 1.0f;
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row)
+            magnitude = std::max(magnitude, std::fabs(expected[column][row]));
+
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row)
+            ASSERT_NEAR(expected[column][row], actual[column][row], TOLERANCE * magnitude)
+                << "object " << index << ", column " << column << ", row " << row;
+}
+
+class TransformStoreTest : public ::testing::Test
+{
+
+protected:
+
+    // An odd count, so the last SSE block is only partially filled
+    void SetUp() override
+    {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> pickUnit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> pickScale(0.25f, 4.0f);
+        for (size_t i = 0; i < 1003; ++i)
+        {
+            ReferenceTransform transform;
+            transform.position = glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random)) * 50.0f;
+            transform.angle = pickUnit(random) * 3.14159f;
+            transform.axis = glm::vec3(pickUnit(random), pickUnit(random), pickUnit(random) + 2.0f);
+            transform.scale = glm::vec3(pickScale(random), pickScale(random), pickScale(random));
+            transforms.push_back(transform);
+
+            size_t index = store.add(transform.position, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), transform.scale);
+            store.setRotation(index, transform.angle, transform.axis);
+        }
+    }
+
+    TransformStore store;
+    std::vector<ReferenceTransform> transforms;
+
+};
+
+TEST_F(TransformStoreTest, ModelMatricesMatchGlm)
+{
+    store.update();
+    ASSERT_EQ(transforms.size(), store.getModelMatrices().size());
+    EXPECT_TRUE(store.getModelViewProjections().empty());
+    for (size_t i = 0; i < transforms.size(); ++i)
+        expectMatrixNear(transforms[i].getModelMatrix(), store.getModelMatrices()[i], i);
+}
+
+TEST_F(TransformStoreTest, ModelViewProjectionsMatchGlm)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 2.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+
+    store.update(viewProjection);
+    ASSERT_EQ(transforms.size(), store.getModelViewProjections().size());
+    for (size_t i = 0; i < transforms.size(); ++i)
+    {
+        glm::mat4 model = transforms[i].getModelMatrix();
+        expectMatrixNear(model, store.getModelMatrices()[i], i);
+        expectMatrixNear(viewProjection * model, store.getModelViewProjections()[i], i);
+    }
+}
+
+TEST_F(TransformStoreTest, UpdatesPickUpChanges)
+{
+    store.update();
+    transforms[1002].position = glm::vec3(-4.0f, 5.0f, 6.0f);
+    transforms[1002].angle = 1.0f;
+    transforms[1002].axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    store.setPosition(1002, transforms[1002].position);
+    store.setRotation(1002, transforms[1002].angle, transforms[1002].axis);
+
+    store.update();
+    expectMatrixNear(transforms[1002].getModelMatrix(), store.getModelMatrices()[1002], 1002);
+    expectMatrixNear(transforms[1001].getModelMatrix(), store.getModelMatrices()[1001], 1001);
+}
+
+TEST_F(TransformStoreTest, ClearResetsToIdentity)
+{
+    store.clear();
+    EXPECT_EQ(0u, store.size());
+    size_t index = store.add(glm::vec3(1.0f, 2.0f, 3.0f));
+    store.update();
+    ASSERT_EQ(1u, store.getModelMatrices().size());
+    expectMatrixNear(glm::translate(glm::mat4(), glm::vec3(1.0f, 2.0f, 3.0f)), store.getModelMatrices()[index], index);
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "VertexCompression.h"
+
+static const float PI = 3.14159265f;
+
+// The worst case errors VertexCompression.h promises
+static const float POSITION_STEPS = 131070.0f;                     // Half a step of a 16-bit unsigned normalized value
+static const float NORMAL_DEGREES = 0.1f;
+static const float TEXCOORD_RELATIVE = 1.0f / 2048.0f;
+
+class VertexCompressionTest : public ::testing::Test
+{
+
+protected:
+
+    // Random vertices in a box that's far from the origin and much longer along one axis
+    void SetUp() override
+    {
+        bounds.min = glm::vec3(-120.0f, 40.0f, -3.0f);
+        bounds.max = glm::vec3(380.0f, 45.0f, 7.0f);
+
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> pickUnit(0.0f, 1.0f);
+        std::uniform_real_distribution<float> pickSigned(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> pickTexCoord(-4.0f, 4.0f);
+        for (int i = 0; i < 10000; ++i)
+        {
+            Vertex vertex;
+            glm::vec3 t(pickUnit(random), pickUnit(random), pickUnit(random));
+            vertex.position = bounds.min + t * (bounds.max - bounds.min);
+            glm::vec3 normal(pickSigned(random), pickSigned(random), pickSigned(random));
+            vertex.normal = glm::length(normal) > 1e-3f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+            vertex.texCoord = glm::vec2(pickTexCoord(random), pickTexCoord(random));
+            vertices.push_back(vertex);
+        }
+
+        // The corners and the axes, where rounding and clamping are most likely to go wrong
+        Vertex vertex;
+        vertex.texCoord = glm::vec2(0.0f, 1.0f);
+        vertex.position = bounds.min;
+        vertex.normal = glm::vec3(1.0f, 0.0f, 0.0f);
+        vertices.push_back(vertex);
+        vertex.position = bounds.max;
+        vertex.normal = glm::vec3(0.0f, -1.0f, 0.0f);
+        vertices.push_back(vertex);
+        vertex.normal = glm::vec3(0.0f, 0.0f, -1.0f);
+        vertices.push_back(vertex);
+    }
+
+    AABB bounds;
+    std::vector<Vertex> vertices;
+
+};
+
+TEST_F(VertexCompressionTest, PositionsStayWithinHalfAStep)
+{
+    glm::vec3 maxError = (bounds.max - bounds.min) / POSITION_STEPS;
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        Vertex decoded = decompressVertex(compressVertex(vertices[i], bounds), bounds);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // Plus what float rounding costs at these magnitudes
+            float slack = std::fabs(vertices[i].position[axis]) * std::numeric_limits<float>::epsilon() * 4.0f;
+            ASSERT_LE(std::fabs(decoded.position[axis] - vertices[i].position[axis]), maxError[axis] + slack) << "vertex " << i << ", axis " << axis;
+        }
+    }
+}
+
+TEST_F(VertexCompressionTest, NormalsStayWithinATenthOfADegree)
+{
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        Vertex decoded = decompressVertex(compressVertex(vertices[i], bounds), bounds);
+        float cosine = glm::dot(glm::normalize(decoded.normal), vertices[i].normal);
+        float degrees = std::acos(std::min(cosine, 1.0f)) * 180.0f / PI;
+        ASSERT_LE(degrees, NORMAL_DEGREES) << "vertex " << i;
+    }
+}
+
+TEST_F(VertexCompressionTest, TexCoordsStayWithinHalfPrecision)
+{
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        Vertex decoded = decompressVertex(compressVertex(vertices[i], bounds), bounds);
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            float value = vertices[i].texCoord[axis];
+            ASSERT_LE(std::fabs(decoded.texCoord[axis] - value), std::fabs(value) * TEXCOORD_RELATIVE) << "vertex " << i << ", axis " << axis;
+        }
+    }
+}
+
+TEST_F(VertexCompressionTest, CompressVerticesMatchesCompressVertex)
+{
+    std::vector<CompactVertex> compact(vertices.size());
+    compressVertices(vertices.data(), vertices.size(), bounds, compact.data());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        CompactVertex single = compressVertex(vertices[i], bounds);
+        ASSERT_EQ(0, std::memcmp(&single, &compact[i], sizeof(CompactVertex))) << "vertex " << i;
+    }
+}
+
+// What the vertex shader computes from the normalized position has to match decompressVertex()
+TEST_F(VertexCompressionTest, DequantizationMatrixRestoresPositions)
+{
+    glm::mat4 dequantize = getDequantizationMatrix(bounds);
+    for (size_t i = 0; i < vertices.size(); i += 97)
+    {
+        CompactVertex compact = compressVertex(vertices[i], bounds);
+        glm::vec4 normalized(compact.position[0] / 65535.0f, compact.position[1] / 65535.0f, compact.position[2] / 65535.0f, 1.0f);
+        glm::vec3 expected = decompressVertex(compact, bounds).position;
+        glm::vec3 actual = glm::vec3(dequantize * normalized);
+        for (int axis = 0; axis < 3; ++axis)
+            EXPECT_NEAR(expected[axis], actual[axis], 1e-4f) << "vertex " << i << ", axis " << axis;
+    }
+}
+
+TEST_F(VertexCompressionTest, FlatBoxesDoNotDivideByZero)
+{
+    AABB flat = bounds;
+    flat.max.y = flat.min.y;
+    Vertex decoded = decompressVertex(compressVertex(vertices[0], flat), flat);
+    EXPECT_EQ(flat.min.y, decoded.position.y);
+    EXPECT_NEAR(vertices[0].position.x, decoded.position.x, (flat.max.x - flat.min.x) / POSITION_STEPS + 1e-4f);
+}
+
+TEST(HalfFloatTest, ConvertsSpecialValues)
+{
+    EXPECT_EQ(0x0000, floatToHalf(0.0f));
+    EXPECT_EQ(0x8000, floatToHalf(-0.0f));
+    EXPECT_EQ(0x3c00, floatToHalf(1.0f));
+    EXPECT_EQ(0xc000, floatToHalf(-2.0f));
+    EXPECT_EQ(0x7bff, floatToHalf(65504.0f));                       // The largest half
+    EXPECT_EQ(0x7c00, floatToHalf(65520.0f));                       // Rounds up to infinity
+    EXPECT_EQ(0x7c00, floatToHalf(std::numeric_limits<float>::infinity()));
+    EXPECT_EQ(0x0001, floatToHalf(std::ldexp(1.0f, -24)));          // The smallest denormal
+    EXPECT_EQ(0x0000, floatToHalf(std::ldexp(1.0f, -36)));
+    EXPECT_TRUE(std::isnan(halfToFloat(floatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+    EXPECT_EQ(1.0f, halfToFloat(0x3c00));
+    EXPECT_EQ(65504.0f, halfToFloat(0x7bff));
+    EXPECT_EQ(std::ldexp(1.0f, -24), halfToFloat(0x0001));
+    EXPECT_TRUE(std::isinf(halfToFloat(0x7c00)));
+}
+
+// Every half that isn't a NaN survives a trip through float and back
+TEST(HalfFloatTest, RoundTripsEveryHalf)
+{
+    for (uint32_t half = 0; half <= 0xffff; ++half)
+    {
+        if ((half & 0x7c00) == 0x7c00 && (half & 0x3ff)) continue;
+        ASSERT_EQ(half, floatToHalf(halfToFloat(static_cast<uint16_t>(half)))) << std::hex << half;
+    }
+}
+
+TEST(PackedNormalTest, PacksAxesExactly)
+{
+    EXPECT_EQ(glm::vec3(1.0f, 0.0f, 0.0f), unpackNormal(packNormal(glm::vec3(1.0f, 0.0f, 0.0f))));
+    EXPECT_EQ(glm::vec3(0.0f, -1.0f, 0.0f), unpackNormal(packNormal(glm::vec3(0.0f, -1.0f, 0.0f))));
+    EXPECT_EQ(glm::vec3(0.0f, 0.0f, -1.0f), unpackNormal(packNormal(glm::vec3(0.0f, 0.0f, -2.0f))));   // Clamped
+    EXPECT_EQ(0u, packNormal(glm::vec3(1.0f, 1.0f, 1.0f)) >> 30);  // w stays 0
+}